@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DConsole: a line-oriented diagnostics console over DSerial, to inspect
+ * and exercise the DWire buses of a running system.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+/**** INCLUDES ****/
+
+extern "C" {
+#include <string.h>
+}
+
+#include "DConsole.h"
+#include "modulemap.h"
+
+/**** PROTOTYPES ****/
+bool parseNumber( const char *, uint32_t * );
+
+/**** GLOBAL VARIABLES ****/
+
+const uint32_t consoleModules[] = { EUSCI_B0_BASE, EUSCI_B1_BASE,
+        EUSCI_B2_BASE, EUSCI_B3_BASE };
+
+/**** CONSTRUCTORS ****/
+
+DConsole::DConsole( DSerial * serial ) {
+    this->serial = serial;
+    lineLength = 0;
+}
+
+/**** PUBLIC METHODS ****/
+
+/**
+ * Print the prompt. The serial port must have been started
+ */
+void DConsole::begin( void ) {
+    lineLength = 0;
+    _prompt( );
+}
+
+/**
+ * Process the received characters and run a command once a line is
+ * complete. Returns immediately if nothing was received
+ */
+void DConsole::poll( void ) {
+    int_fast16_t c;
+
+    while ( (c = serial->read( )) >= 0 ) {
+        if ( c == '\r' || c == '\n' ) {
+            serial->println( );
+            line[lineLength] = '\0';
+            _execute( );
+            lineLength = 0;
+            _prompt( );
+        } else if ( c == '\b' || c == 0x7F ) {
+            if ( lineLength ) {
+                lineLength--;
+                serial->print("\b \b");
+            }
+        } else if ( c >= ' ' && lineLength < CONSOLE_LINE_LENGTH - 1 ) {
+            line[lineLength++] = c;
+            // Echo
+            serial->print((uint_fast8_t) c);
+        }
+    }
+}
+
+/**** PRIVATE METHODS ****/
+
+void DConsole::_prompt( void ) {
+    serial->print("> ");
+}
+
+void DConsole::_printHex( uint32_t value ) {
+    serial->print("0x");
+    serial->print(value, HEX);
+}
+
+/**
+ * Split the line into words and run the command
+ */
+void DConsole::_execute( void ) {
+    char * args[CONSOLE_MAX_ARGS];
+    uint8_t count = 0;
+    char * word = line;
+
+    while ( *word && count < CONSOLE_MAX_ARGS ) {
+        while ( *word == ' ' )
+            *word++ = '\0';
+        if ( !*word )
+            break;
+
+        args[count++] = word;
+        while ( *word && *word != ' ' )
+            word++;
+    }
+
+    if ( count == 0 )
+        return;
+
+    if ( !strcmp(args[0], "help") )
+        _help( );
+    else if ( !strcmp(args[0], "stats") )
+        _stats( );
+    else if ( !strcmp(args[0], "speed") )
+        _speed(args, count);
+    else if ( !strcmp(args[0], "scan") )
+        _scan(args, count);
+    else if ( !strcmp(args[0], "xfer") )
+        _transfer(args, count);
+    else
+        serial->println("unknown command, try help");
+}
+
+/**
+ * Get the master bus for a module number, or print an error
+ */
+DWire * DConsole::_getBus( const char * text ) {
+    uint32_t index;
+    DWire * bus = NULL;
+
+    if ( parseNumber(text, &index) && index < 4 )
+        bus = getInstance(consoleModules[index]);
+
+    if ( !bus || !bus->isMaster( ) ) {
+        serial->println("no master on that module");
+        return NULL;
+    }
+    return bus;
+}
+
+void DConsole::_help( void ) {
+    serial->println("stats                          bus counters and speed");
+    serial->println("speed <m> <hz>                 set SCL frequency");
+    serial->println("scan <m>                       list responding addresses");
+    serial->println("xfer <m> <addr> [bytes] [r <n>]  write and/or read");
+}
+
+void DConsole::_stats( void ) {
+    for ( int i = 0; i < 4; i++ ) {
+        DWire * bus = getInstance(consoleModules[i]);
+        if ( !bus )
+            continue;
+
+        const DWireStats * stats = bus->getStats( );
+        serial->print("B");
+        serial->print(i, DEC);
+        if ( bus->isMaster( ) ) {
+            serial->print(" master ");
+            serial->print(bus->getSpeed( ), DEC);
+            serial->print(" Hz, arbitration lost ");
+        } else
+            serial->print(" slave, arbitration lost ");
+        serial->print(stats->arbitrationLost, DEC);
+        serial->print(", retries ");
+        serial->print(stats->arbitrationRetries, DEC);
+        serial->print(", NAK retries ");
+        serial->print(stats->nakRetries, DEC);
+#ifdef DWIRE_PROFILE
+        serial->print(", ISR cycles ");
+        serial->print(bus->getIrqCycles( ), DEC);
+        serial->print(" / events ");
+        serial->print(bus->getIrqEvents( ), DEC);
+#endif
+        serial->println( );
+    }
+}
+
+void DConsole::_speed( char ** args, uint8_t count ) {
+    uint32_t speed;
+
+    if ( count != 3 || !parseNumber(args[2], &speed) ) {
+        serial->println("usage: speed <m> <hz>");
+        return;
+    }
+
+    DWire * bus = _getBus(args[1]);
+    if ( !bus )
+        return;
+
+    serial->println(bus->setSpeed(speed) ? "ok" : "bus busy");
+}
+
+void DConsole::_scan( char ** args, uint8_t count ) {
+    uint8_t bitmap[SCAN_BITMAP_SIZE];
+
+    if ( count != 2 ) {
+        serial->println("usage: scan <m>");
+        return;
+    }
+
+    DWire * bus = _getBus(args[1]);
+    if ( !bus )
+        return;
+
+    if ( !bus->scan(bitmap) ) {
+        serial->println("bus busy");
+        return;
+    }
+
+    for ( int address = SCAN_FIRST_ADDRESS; address <= SCAN_LAST_ADDRESS;
+            address++ ) {
+        if ( bus->isPresent(bitmap, address) ) {
+            _printHex(address);
+            serial->print(" ");
+        }
+    }
+    serial->println( );
+}
+
+/**
+ * Raw transaction: write the given bytes (if any), then read n bytes (if
+ * requested) after a repeated start
+ */
+void DConsole::_transfer( char ** args, uint8_t count ) {
+    uint8_t txData[TX_BUFFER_SIZE];
+    uint8_t rxData[RX_BUFFER_SIZE];
+    uint8_t txLength = 0;
+    uint32_t rxLength = 0;
+    uint32_t address;
+    uint32_t value;
+
+    if ( count < 3 || !parseNumber(args[2], &address) || address > 0x7F ) {
+        serial->println("usage: xfer <m> <addr> [bytes] [r <n>]");
+        return;
+    }
+
+    for ( int i = 3; i < count; i++ ) {
+        if ( !strcmp(args[i], "r") ) {
+            if ( i + 2 != count || !parseNumber(args[i + 1], &rxLength)
+                    || rxLength > RX_BUFFER_SIZE ) {
+                serial->println("bad read length");
+                return;
+            }
+            break;
+        }
+        if ( !parseNumber(args[i], &value) || value > 0xFF
+                || txLength == TX_BUFFER_SIZE ) {
+            serial->println("bad data byte");
+            return;
+        }
+        txData[txLength++] = value;
+    }
+
+    DWire * bus = _getBus(args[1]);
+    if ( !bus )
+        return;
+
+    bus->lock( );
+    bool started = bus->startTransfer(address, txData, txLength, rxData,
+            rxLength, NULL, NULL);
+    while ( started && bus->isBusy( ) )
+        bus->_waitEvent( );
+    bool acknowledged = started && !bus->hasFailed( );
+    bus->unlock( );
+
+    if ( !started ) {
+        serial->println("bus busy or nothing to do");
+    } else if ( !acknowledged ) {
+        serial->println("NAK");
+    } else {
+        for ( uint32_t i = 0; i < rxLength; i++ ) {
+            _printHex(rxData[i]);
+            serial->print(" ");
+        }
+        serial->println("ok");
+    }
+}
+
+/**
+ * Parse a decimal or 0x-prefixed hexadecimal number
+ */
+bool parseNumber( const char * text, uint32_t * value ) {
+    uint8_t base = 10;
+    *value = 0;
+
+    if ( text[0] == '0' && (text[1] == 'x' || text[1] == 'X') ) {
+        base = 16;
+        text += 2;
+    }
+    if ( !*text )
+        return false;
+
+    for ( ; *text; text++ ) {
+        uint8_t digit;
+        if ( *text >= '0' && *text <= '9' )
+            digit = *text - '0';
+        else if ( *text >= 'a' && *text <= 'f' )
+            digit = *text - 'a' + 10;
+        else if ( *text >= 'A' && *text <= 'F' )
+            digit = *text - 'A' + 10;
+        else
+            return false;
+
+        if ( digit >= base )
+            return false;
+        *value = *value * base + digit;
+    }
+    return true;
+}
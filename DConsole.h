@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DConsole: a line-oriented diagnostics console over DSerial, to inspect
+ * and exercise the DWire buses of a running system. Call poll() from the
+ * main loop. Commands (numbers are decimal or 0x-prefixed hex, <m> is the
+ * eUSCI_B module number 0-3):
+ *
+ *   help                          list the commands
+ *   stats                         counters and speed of every bus
+ *   speed <m> <hz>                change the SCL frequency
+ *   scan <m>                      list the addresses that acknowledge
+ *   xfer <m> <addr> [bytes] [r <n>]  write bytes and/or read n bytes
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_DCONSOLE_H_
+#define DWIRE_DCONSOLE_H_
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#include "DWire.h"
+#include "DSerial.h"
+
+// Maximum length of a command line
+#define CONSOLE_LINE_LENGTH 80
+
+// Maximum number of words in a command line
+#define CONSOLE_MAX_ARGS (TX_BUFFER_SIZE + 6)
+
+/* Main class definition */
+class DConsole {
+private:
+
+    DSerial * serial;
+
+    char line[CONSOLE_LINE_LENGTH];
+    uint8_t lineLength;
+
+    void _execute( void );
+    void _prompt( void );
+    void _printHex( uint32_t );
+    DWire * _getBus( const char * );
+
+    void _help( void );
+    void _stats( void );
+    void _speed( char **, uint8_t );
+    void _scan( char **, uint8_t );
+    void _transfer( char **, uint8_t );
+
+public:
+
+    DConsole( DSerial * );
+
+    void begin( void );
+    void poll( void );
+};
+
+#endif /* DWIRE_DCONSOLE_H_ */
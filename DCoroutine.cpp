@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DCoroutine: C++20 coroutines on top of DWire's interrupt-driven
+ * transfers. A DTask is written as linear code that co_awaits transfers;
+ * while the ISR does the work, the cooperative DLoop runs other tasks.
+ * Coroutine frames come from a fixed pool, so no heap is used.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "DCoroutine.h"
+
+#if __cplusplus >= 202002L
+
+/**** PROTOTYPES ****/
+void coroutineComplete( void *, bool );
+
+/**** GLOBAL VARIABLES ****/
+
+DLoop * activeLoop = NULL;
+
+// The frame pool. Frames are only taken and returned by tasks, which never
+// run in interrupt context
+alignas(max_align_t) uint8_t coroutineFrames[COROUTINE_FRAMES][COROUTINE_FRAME_SIZE];
+bool coroutineFrameUsed[COROUTINE_FRAMES];
+uint32_t coroutineFailures = 0;
+
+/**** FRAME ALLOCATION ****/
+
+void * coroutineAllocate( size_t size ) {
+    if ( size <= COROUTINE_FRAME_SIZE ) {
+        for ( int i = 0; i < COROUTINE_FRAMES; i++ ) {
+            if ( !coroutineFrameUsed[i] ) {
+                coroutineFrameUsed[i] = true;
+                return coroutineFrames[i];
+            }
+        }
+    }
+
+    coroutineFailures++;
+    return NULL;
+}
+
+/**
+ * Returns the number of tasks that could not get a frame
+ */
+uint32_t coroutineAllocationFailures( void ) {
+    return coroutineFailures;
+}
+
+void coroutineFree( void * frame ) {
+    for ( int i = 0; i < COROUTINE_FRAMES; i++ ) {
+        if ( frame == coroutineFrames[i] )
+            coroutineFrameUsed[i] = false;
+    }
+}
+
+/**** AWAITERS ****/
+
+DAwaiter::DAwaiter( void ) {
+    rejected = false;
+}
+
+/**
+ * Register with the loop, which resumes the task once poll() is true.
+ * Without a running loop or a free slot in it, the task is not suspended
+ * and the awaiter is rejected instead
+ */
+bool DAwaiter::await_suspend( std::coroutine_handle<> handle ) {
+    this->handle = handle;
+    rejected = !activeLoop || !activeLoop->_wait(this);
+    return !rejected;
+}
+
+bool DYield::poll( void ) {
+    return true;
+}
+
+DTransfer::DTransfer( DWire * bus, uint8_t address, const uint8_t * txData,
+        uint8_t txLength, uint8_t * rxData, uint8_t rxLength ) {
+    this->bus = bus;
+    this->address = address;
+    this->txData = txData;
+    this->txLength = txLength;
+    this->rxData = rxData;
+    this->rxLength = rxLength;
+
+    headerLength = 0;
+    started = false;
+    done = false;
+    nak = false;
+}
+
+/**
+ * Write up to two register bytes instead of a caller's buffer
+ */
+void DTransfer::setHeader( uint8_t length, uint8_t first, uint8_t second ) {
+    header[0] = first;
+    header[1] = second;
+    headerLength = length;
+}
+
+/**
+ * Start the transfer if that has not happened yet. Returns true once it
+ * has finished
+ */
+bool DTransfer::poll( void ) {
+    if ( started )
+        return done;
+
+    const uint8_t * data = headerLength ? header : txData;
+    uint8_t length = headerLength ? headerLength : txLength;
+
+    // Invalid lengths fail immediately rather than waiting forever
+    if ( length > TX_BUFFER_SIZE || rxLength > RX_BUFFER_SIZE
+            || (length == 0 && rxLength == 0) ) {
+        nak = true;
+        return true;
+    }
+
+    started = bus->startTransfer(address, data, length, rxData, rxLength,
+            coroutineComplete, this);
+    return false;
+}
+
+/**** TASKS ****/
+
+DTask::DTask( void ) {
+    handle = NULL;
+}
+
+DTask::DTask( std::coroutine_handle<promise_type> handle ) {
+    this->handle = handle;
+}
+
+DTask::DTask( DTask && other ) {
+    handle = other.handle;
+    other.handle = NULL;
+}
+
+DTask::~DTask( void ) {
+    if ( handle )
+        handle.destroy( );
+}
+
+/**
+ * Returns false if no frame could be allocated for this task
+ */
+bool DTask::isValid( void ) {
+    return (bool) handle;
+}
+
+/**
+ * Give up ownership of the coroutine
+ */
+std::coroutine_handle<DTask::promise_type> DTask::release( void ) {
+    std::coroutine_handle<promise_type> released = handle;
+    handle = NULL;
+    return released;
+}
+
+/**** BUS ****/
+
+DAsyncBus::DAsyncBus( DWire * bus ) {
+    this->bus = bus;
+}
+
+DTransfer DAsyncBus::write( uint8_t address, const uint8_t * data,
+        uint8_t length ) {
+    return DTransfer(bus, address, data, length, NULL, 0);
+}
+
+DTransfer DAsyncBus::read( uint8_t address, uint8_t * data, uint8_t length ) {
+    return DTransfer(bus, address, NULL, 0, data, length);
+}
+
+/**
+ * Write the register number, then read length bytes after a repeated start
+ */
+DTransfer DAsyncBus::writeRead( uint8_t address, uint8_t reg, uint8_t * data,
+        uint8_t length ) {
+    DTransfer transfer(bus, address, NULL, 0, data, length);
+    transfer.setHeader(1, reg, 0);
+    return transfer;
+}
+
+DTransfer DAsyncBus::writeRegister( uint8_t address, uint8_t reg,
+        uint8_t value ) {
+    DTransfer transfer(bus, address, NULL, 0, NULL, 0);
+    transfer.setHeader(2, reg, value);
+    return transfer;
+}
+
+/**** LOOP ****/
+
+DLoop::DLoop( void ) {
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ ) {
+        tasks[i] = NULL;
+        started[i] = false;
+        waiting[i] = NULL;
+    }
+    idleHandler = NULL;
+}
+
+/**
+ * Add a task. It starts on the next pass of the loop. Returns false if the
+ * task is invalid or the loop is full
+ */
+bool DLoop::spawn( DTask && task ) {
+    if ( !task.isValid( ) )
+        return false;
+
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ ) {
+        if ( !tasks[i] ) {
+            tasks[i] = task.release( );
+            started[i] = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Make one pass: start new tasks, resume tasks whose awaiter is ready and
+ * clean up finished ones. Returns true if any task ran
+ */
+bool DLoop::runOnce( void ) {
+    bool progress = false;
+    activeLoop = this;
+
+#ifdef DWIRE_DEFERRED
+    // Transfers complete through the queued callbacks
+    DWire::poll( );
+#endif
+
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ ) {
+        if ( tasks[i] && !started[i] ) {
+            started[i] = true;
+            tasks[i].resume( );
+            progress = true;
+        }
+    }
+
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ ) {
+        DAwaiter * awaiter = waiting[i];
+        if ( awaiter && awaiter->poll( ) ) {
+            waiting[i] = NULL;
+            awaiter->handle.resume( );
+            progress = true;
+        }
+    }
+
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ ) {
+        if ( tasks[i] && tasks[i].done( ) ) {
+            tasks[i].destroy( );
+            tasks[i] = NULL;
+        }
+    }
+    return progress;
+}
+
+/**
+ * Run until all tasks have finished. When no task can make progress, the
+ * idle handler is called (e.g. to sleep until the next interrupt)
+ */
+void DLoop::run( void ) {
+    while ( !isDone( ) ) {
+        if ( !runOnce( ) && idleHandler )
+            idleHandler( );
+    }
+}
+
+bool DLoop::isDone( void ) {
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ ) {
+        if ( tasks[i] )
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Set the function called when all tasks are waiting
+ */
+void DLoop::onIdle( void (*handler)( void ) ) {
+    idleHandler = handler;
+}
+
+/**
+ * Called by an awaiter when its task suspends. Returns false if all
+ * COROUTINE_MAX_TASKS slots are taken, which only happens when coroutines
+ * other than the loop's own tasks await
+ */
+bool DLoop::_wait( DAwaiter * awaiter ) {
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ ) {
+        if ( !waiting[i] ) {
+            waiting[i] = awaiter;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**** ISR/IRQ Handles ****/
+
+void coroutineComplete( void * context, bool nak ) {
+    DTransfer * transfer = (DTransfer *) context;
+    transfer->nak = nak;
+    transfer->done = true;
+}
+
+#endif /* __cplusplus >= 202002L */
@@ -0,0 +1,260 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DCoroutine: C++20 coroutines on top of DWire's interrupt-driven
+ * transfers. A DTask is written as linear code that co_awaits transfers;
+ * while the ISR does the work, the cooperative DLoop runs other tasks.
+ * Coroutine frames come from a fixed pool, so no heap is used.
+ *
+ *   DTask readSensor( DAsyncBus & bus ) {
+ *       uint8_t data[2];
+ *       if ( co_await bus.writeRegister(0x48, 0x01, 0x60) )
+ *           co_await bus.writeRead(0x48, 0x00, data, 2);
+ *   }
+ *
+ * Requires C++20; with older standards this file declares nothing.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_DCOROUTINE_H_
+#define DWIRE_DCOROUTINE_H_
+
+#if __cplusplus >= 202002L
+
+#include <coroutine>
+#include <stddef.h>
+
+#include "DWire.h"
+
+// Number and size of the statically allocated coroutine frames. Every
+// running task and every task it is awaiting takes one frame
+#ifndef COROUTINE_FRAMES
+#define COROUTINE_FRAMES 8
+#endif
+#ifndef COROUTINE_FRAME_SIZE
+#define COROUTINE_FRAME_SIZE 384
+#endif
+
+// Maximum number of top-level tasks in a DLoop
+#ifndef COROUTINE_MAX_TASKS
+#define COROUTINE_MAX_TASKS 4
+#endif
+
+/**
+ * Take a frame from the pool, or return NULL if none is free or the frame
+ * does not fit
+ */
+void * coroutineAllocate( size_t );
+
+/**
+ * Return a frame to the pool
+ */
+void coroutineFree( void * );
+
+/**
+ * Get the number of tasks that could not be created for lack of a frame.
+ * Such tasks are invalid; increase COROUTINE_FRAMES or COROUTINE_FRAME_SIZE
+ */
+uint32_t coroutineAllocationFailures( void );
+
+/**
+ * Something a suspended task waits for. The loop polls it and resumes the
+ * task once poll() returns true. If the loop has no room for it, the task
+ * does not suspend and the awaiter is rejected
+ */
+class DAwaiter {
+public:
+    std::coroutine_handle<> handle;
+    bool rejected;
+
+    DAwaiter( void );
+
+    virtual bool poll( void ) = 0;
+
+    bool await_ready( void ) {
+        return false;
+    }
+    bool await_suspend( std::coroutine_handle<> );
+};
+
+/**
+ * A coroutine. It does not start until it is spawned on a DLoop or
+ * co_awaited by another task. If no frame was available, the task is
+ * invalid: spawning it fails and awaiting it returns immediately
+ */
+class DTask {
+public:
+
+    struct promise_type {
+        // The task awaiting this one, if any
+        std::coroutine_handle<> continuation;
+
+        struct FinalAwaiter {
+            bool await_ready( void ) noexcept {
+                return false;
+            }
+            std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<promise_type> handle ) noexcept {
+                std::coroutine_handle<> next = handle.promise( ).continuation;
+                return next ? next : std::noop_coroutine( );
+            }
+            void await_resume( void ) noexcept {
+            }
+        };
+
+        DTask get_return_object( void ) {
+            return DTask(
+                    std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        static DTask get_return_object_on_allocation_failure( void ) {
+            return DTask( );
+        }
+        std::suspend_always initial_suspend( void ) noexcept {
+            return { };
+        }
+        FinalAwaiter final_suspend( void ) noexcept {
+            return { };
+        }
+        void return_void( void ) {
+        }
+        void unhandled_exception( void ) {
+        }
+
+        static void * operator new( size_t size ) noexcept {
+            return coroutineAllocate(size);
+        }
+        static void operator delete( void * frame ) {
+            coroutineFree(frame);
+        }
+    };
+
+    DTask( void );
+    explicit DTask( std::coroutine_handle<promise_type> );
+    DTask( DTask && );
+    DTask( const DTask & ) = delete;
+    ~DTask( void );
+
+    bool isValid( void );
+    std::coroutine_handle<promise_type> release( void );
+
+    /* Awaiting a task runs it to completion, like a subroutine */
+    bool await_ready( void ) {
+        return !handle;
+    }
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<> caller ) {
+        handle.promise( ).continuation = caller;
+        return handle;
+    }
+    void await_resume( void ) {
+    }
+
+private:
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * Suspend until the next pass of the loop, letting other tasks run
+ */
+class DYield: public DAwaiter {
+public:
+    bool poll( void );
+
+    void await_resume( void ) {
+    }
+};
+
+/**
+ * A transfer started from a task. Awaiting it returns false if the slave
+ * did not acknowledge, or if the loop could not take the awaiter, in which
+ * case nothing was sent. If the bus is busy, the start is retried on every
+ * pass of the loop
+ */
+class DTransfer: public DAwaiter {
+private:
+
+    DWire * bus;
+    uint8_t address;
+    const uint8_t * txData;
+    uint8_t txLength;
+    uint8_t * rxData;
+    uint8_t rxLength;
+
+    // Register bytes written instead of txData, if headerLength is set
+    uint8_t header[2];
+    uint8_t headerLength;
+    bool started;
+
+public:
+
+    volatile bool done;
+    volatile bool nak;
+
+    DTransfer( DWire *, uint8_t, const uint8_t *, uint8_t, uint8_t *,
+            uint8_t );
+
+    void setHeader( uint8_t, uint8_t, uint8_t );
+
+    bool poll( void );
+
+    bool await_resume( void ) {
+        return !nak && !rejected;
+    }
+};
+
+/**
+ * Awaitable transfers on a master bus
+ */
+class DAsyncBus {
+private:
+
+    DWire * bus;
+
+public:
+
+    DAsyncBus( DWire * );
+
+    DTransfer write( uint8_t, const uint8_t *, uint8_t );
+    DTransfer read( uint8_t, uint8_t *, uint8_t );
+    DTransfer writeRead( uint8_t, uint8_t, uint8_t *, uint8_t );
+    DTransfer writeRegister( uint8_t, uint8_t, uint8_t );
+};
+
+/**
+ * Cooperative scheduler for tasks. Tasks only run from run() or
+ * runOnce(), never from an interrupt
+ */
+class DLoop {
+private:
+
+    std::coroutine_handle<> tasks[COROUTINE_MAX_TASKS];
+    bool started[COROUTINE_MAX_TASKS];
+    DAwaiter * waiting[COROUTINE_MAX_TASKS];
+
+    void (*idleHandler)( void );
+
+public:
+
+    DLoop( void );
+
+    bool spawn( DTask && );
+    bool runOnce( void );
+    void run( void );
+    bool isDone( void );
+
+    void onIdle( void (*)( void ) );
+
+    /* Internal */
+    bool _wait( DAwaiter * );
+};
+
+/* The loop currently running tasks */
+extern DLoop * activeLoop;
+
+#endif /* __cplusplus >= 202002L */
+
+#endif /* DWIRE_DCOROUTINE_H_ */
@@ -0,0 +1,309 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DDevice: a lightweight handle for one slave on a shared DWire bus. Any
+ * number of handles can share a bus; their transfers are serialised, the
+ * slave address register is only written when the address changes, and
+ * each device's bus speed is applied just before its transfers.
+ *
+ * Optionally, register writes are combined: writes to consecutive
+ * registers are buffered and sent as one auto-increment burst. A combining
+ * timeout is only checked by poll(), which must then be called regularly.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "DDevice.h"
+
+/**** PROTOTYPES ****/
+void deviceComplete( void *, bool );
+
+/**** GLOBAL VARIABLES ****/
+
+// The SCL rates tried by calibrate(), slowest first. The eUSCI divides
+// SMCLK by an integer, so the actual rates are at or just above these
+const uint32_t calibrationRates[] = {
+    EUSCI_B_I2C_SET_DATA_RATE_100KBPS, 200000,
+    EUSCI_B_I2C_SET_DATA_RATE_400KBPS, 600000, 800000,
+    EUSCI_B_I2C_SET_DATA_RATE_1MBPS };
+
+#define CALIBRATION_STEPS (sizeof(calibrationRates) / sizeof(uint32_t))
+
+/**** CONSTRUCTORS ****/
+
+/**
+ * Create a handle for the slave at the given address on an initialised
+ * master bus. speed is the SCL frequency to use for this device, in Hz
+ */
+DDevice::DDevice( DWire * bus, uint8_t address, uint32_t speed ) {
+    this->bus = bus;
+    this->address = address;
+    this->speed = speed;
+
+    busy = false;
+    failed = false;
+
+    combining = false;
+    combineLength = 0;
+}
+
+/**** PUBLIC METHODS ****/
+
+/**
+ * Start a transfer to this device without waiting, like
+ * DWire::startTransfer(). Returns false if the bus is busy with a transfer
+ * of any device, or while combined writes are buffered: it would overtake
+ * them, so call flush() first. Can be called from ISRs, including
+ * completion callbacks
+ */
+bool DDevice::startTransfer( const uint8_t * txData, uint8_t txLength,
+        uint8_t * rxData, uint8_t rxLength, DWireCallback callback,
+        void * context ) {
+    if ( combineLength )
+        return false;
+
+    // Changing the speed and starting must not be split by a transfer that
+    // another device starts from an interrupt
+    bool wasDisabled = MAP_Interrupt_disableMaster( );
+    bool started = bus->setSpeed(speed)
+            && bus->startTransfer(address, txData, txLength, rxData,
+                    rxLength, callback, context);
+    if ( !wasDisabled )
+        MAP_Interrupt_enableMaster( );
+
+    return started;
+}
+
+/**
+ * Write length bytes to the device and wait for the STOP. Waits for the
+ * bus if another device is using it. Returns false on a NAK
+ */
+bool DDevice::write( const uint8_t * data, uint8_t length ) {
+    return writeRead(data, length, NULL, 0);
+}
+
+/**
+ * Read length bytes from the device. Returns false on a NAK
+ */
+bool DDevice::read( uint8_t * data, uint8_t length ) {
+    return writeRead(NULL, 0, data, length);
+}
+
+/**
+ * Write txLength bytes, then read rxLength bytes after a repeated start.
+ * Either part may be empty. Buffered writes are sent first. Returns false
+ * on a NAK or invalid lengths
+ */
+bool DDevice::writeRead( const uint8_t * txData, uint8_t txLength,
+        uint8_t * rxData, uint8_t rxLength ) {
+    if ( txLength > TX_BUFFER_SIZE || rxLength > RX_BUFFER_SIZE
+            || (txLength == 0 && rxLength == 0) )
+        return false;
+
+    // flush() empties the buffer before it gets here
+    if ( !flush( ) )
+        return false;
+
+    bus->lock( );
+
+    busy = true;
+    failed = false;
+
+    // Wait for our turn on the bus
+    while ( !startTransfer(txData, txLength, rxData, rxLength, deviceComplete,
+            this) )
+        bus->_waitEvent( );
+
+    while ( busy )
+        bus->_waitEvent( );
+
+    bus->unlock( );
+    return !failed;
+}
+
+/**
+ * Write a single 8-bit register. With write combining, the write is
+ * buffered if it continues the current run of registers; a NAK is then
+ * only reported by the call that sends the run
+ */
+bool DDevice::writeRegister( uint8_t reg, uint8_t value ) {
+    if ( !combining ) {
+        txBuffer[0] = reg;
+        txBuffer[1] = value;
+        return write(txBuffer, 2);
+    }
+
+    // Writes are never reordered: anything but the next register in line
+    // sends the run first
+    bool contiguous = reg == (uint8_t) (combineBuffer[0] + combineLength - 1)
+            && combineLength < TX_BUFFER_SIZE;
+    bool acknowledged = true;
+
+    if ( combineLength && (!contiguous || _expired( )) )
+        acknowledged = flush( );
+
+    if ( !combineLength ) {
+        combineBuffer[0] = reg;
+        combineLength = 1;
+        combineSince = DWIRE_CYCLES();
+    }
+
+    combineBuffer[combineLength++] = value;
+    return acknowledged;
+}
+
+/**
+ * Read length consecutive 8-bit registers starting at reg
+ */
+bool DDevice::readRegisters( uint8_t reg, uint8_t * data, uint8_t length ) {
+    txBuffer[0] = reg;
+    return writeRead(txBuffer, 1, data, length);
+}
+
+/**
+ * Enable or disable write combining. Only for devices that auto-increment
+ * the register address. Buffered writes are sent before any other blocking
+ * transfer through this handle, on flush() and when the run is full.
+ * startTransfer() refuses to start while writes are buffered.
+ *
+ * timeoutUs, if not 0, bounds how long a write may stay buffered, but there
+ * is no timer behind it: the timeout is only checked by poll() and the next
+ * writeRegister(). Call poll() regularly, e.g. from the main loop, or a
+ * buffered write is not sent until the next transfer
+ */
+void DDevice::setWriteCombining( bool enabled, uint32_t timeoutUs ) {
+    if ( !enabled )
+        flush( );
+
+    combining = enabled;
+    combineTimeout = timeoutUs * (MAP_CS_getMCLK( ) / 1000000);
+
+    // The timeout is measured with the cycle counter
+    if ( enabled && timeoutUs )
+        DWIRE_CYCLES_ENABLE();
+}
+
+/**
+ * Send the buffered writes, if any, as a single burst. Returns false if the
+ * device did not acknowledge
+ */
+bool DDevice::flush( void ) {
+    if ( !combineLength )
+        return true;
+
+    uint8_t length = combineLength;
+    combineLength = 0;
+    return writeRead(combineBuffer, length, NULL, 0);
+}
+
+/**
+ * Send the buffered writes if they have timed out. Must be called
+ * regularly when using a timeout, as nothing else sends them in time.
+ * Returns false if the device did not acknowledge them
+ */
+bool DDevice::poll( void ) {
+    if ( !_expired( ) )
+        return true;
+    return flush( );
+}
+
+/**
+ * Find the fastest SCL rate at which the device reads back reliably, and
+ * use it for its transfers from now on. length bytes are read from reg,
+ * which must not change by itself (e.g. an ID register), and compared with
+ * expected; if expected is NULL, the value read at the slowest rate is the
+ * reference. Each step of calibrationRates is read CALIBRATION_REPEATS
+ * times, and calibration stops at the first step with a NAK or different
+ * data. Returns the chosen rate, or 0 if the device fails even at the
+ * slowest one, in which case its speed is left unchanged
+ */
+uint32_t DDevice::calibrate( uint8_t reg, const uint8_t * expected,
+        uint8_t length ) {
+    uint8_t reference[RX_BUFFER_SIZE];
+    uint8_t data[RX_BUFFER_SIZE];
+    uint32_t original = speed;
+    uint32_t best = 0;
+
+    if ( length == 0 || length > RX_BUFFER_SIZE )
+        return 0;
+
+    bus->lock( );
+
+    for ( unsigned int step = 0; step < CALIBRATION_STEPS; step++ ) {
+        speed = calibrationRates[step];
+        bool reliable = true;
+
+        for ( int i = 0; i < CALIBRATION_REPEATS && reliable; i++ ) {
+            if ( !readRegisters(reg, data, length) ) {
+                reliable = false;
+                break;
+            }
+
+            if ( !expected ) {
+                for ( int j = 0; j < length; j++ )
+                    reference[j] = data[j];
+                expected = reference;
+            }
+
+            for ( int j = 0; j < length; j++ )
+                if ( data[j] != expected[j] )
+                    reliable = false;
+        }
+
+        if ( !reliable )
+            break;
+        best = speed;
+    }
+
+    speed = best ? best : original;
+
+    bus->unlock( );
+    return best;
+}
+
+/**
+ * Set the SCL frequency for this device's transfers, in Hz, e.g. to
+ * restore a rate found by calibrate()
+ */
+void DDevice::setSpeed( uint32_t speed ) {
+    this->speed = speed;
+}
+
+uint32_t DDevice::getSpeed( void ) {
+    return speed;
+}
+
+/**** PRIVATE METHODS ****/
+
+/**
+ * Returns true if buffered writes have reached the timeout
+ */
+bool DDevice::_expired( void ) {
+    return combineLength && combineTimeout
+            && DWIRE_CYCLES() - combineSince >= combineTimeout;
+}
+
+uint8_t DDevice::getAddress( void ) {
+    return address;
+}
+
+DWire * DDevice::getBus( void ) {
+    return bus;
+}
+
+/**
+ * Called from the DWire ISR when a blocking transfer has finished
+ */
+void DDevice::_handleComplete( bool nak ) {
+    failed = nak;
+    busy = false;
+}
+
+/**** ISR/IRQ Handles ****/
+
+void deviceComplete( void * context, bool nak ) {
+    ((DDevice *) context)->_handleComplete(nak);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DDevice: a lightweight handle for one slave on a shared DWire bus. Any
+ * number of handles can share a bus; their transfers are serialised, the
+ * slave address register is only written when the address changes, and
+ * each device's bus speed is applied just before its transfers.
+ *
+ * Optionally, register writes are combined: writes to consecutive
+ * registers are buffered and sent as one auto-increment burst. A combining
+ * timeout is only checked by poll(), which must then be called regularly.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_DDEVICE_H_
+#define DWIRE_DDEVICE_H_
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#include "DWire.h"
+
+// Reads of the reference register per step of calibrate()
+#ifndef CALIBRATION_REPEATS
+#define CALIBRATION_REPEATS 16
+#endif
+
+/* Main class definition */
+class DDevice {
+private:
+
+    DWire * bus;
+    uint8_t address;
+    uint32_t speed;
+
+    /* State of the current blocking transfer */
+    volatile bool busy;
+    volatile bool failed;
+
+    uint8_t txBuffer[2];
+
+    /* Write combining: the register of the first buffered write, followed
+     * by the data of the run */
+    bool combining;
+    uint8_t combineBuffer[TX_BUFFER_SIZE];
+    uint8_t combineLength;
+    uint32_t combineTimeout;
+    uint32_t combineSince;
+
+    bool _expired( void );
+
+public:
+
+    DDevice( DWire *, uint8_t, uint32_t );
+
+    bool startTransfer( const uint8_t *, uint8_t, uint8_t *, uint8_t,
+            DWireCallback, void * );
+
+    bool write( const uint8_t *, uint8_t );
+    bool read( uint8_t *, uint8_t );
+    bool writeRead( const uint8_t *, uint8_t, uint8_t *, uint8_t );
+
+    bool writeRegister( uint8_t, uint8_t );
+    bool readRegisters( uint8_t, uint8_t *, uint8_t );
+
+    void setWriteCombining( bool, uint32_t );
+    bool flush( void );
+    bool poll( void );
+
+    uint32_t calibrate( uint8_t, const uint8_t *, uint8_t );
+    void setSpeed( uint32_t );
+    uint32_t getSpeed( void );
+
+    uint8_t getAddress( void );
+    DWire * getBus( void );
+
+    /* Internal */
+    void _handleComplete( bool );
+};
+
+#endif /* DWIRE_DDEVICE_H_ */
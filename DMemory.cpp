@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DMemory: paged reads and writes of I2C EEPROM and FRAM devices on top of
+ * DWire. Writes of any length are split on page boundaries and the pages
+ * are sent back to back from the ISR, using acknowledge polling to wait for
+ * each write cycle. A read of any length is one transaction, streamed
+ * through the receive buffer.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "DMemory.h"
+
+/**** PROTOTYPES ****/
+void memoryData( void *, const uint8_t *, uint8_t );
+void memoryComplete( void *, bool );
+
+// Acknowledge polling while the device is in its write cycle. Passed with
+// each chunk, so that the bus's own policy is left alone
+const DWireNAKPolicy memoryPolicy = { MEMORY_WRITE_ATTEMPTS, 0 };
+
+/**** CONSTRUCTORS ****/
+
+/**
+ * Create a helper for the device at the given address on an initialised
+ * master bus. addressBytes is 1 for small devices (the upper address bits
+ * then go into the device address, as on the 24C04-24C16) or 2
+ */
+DMemory::DMemory( DWire * bus, uint8_t address, uint16_t pageSize,
+        uint8_t addressBytes ) {
+    this->bus = bus;
+    this->address = address;
+    this->pageSize = pageSize;
+    this->addressBytes = addressBytes;
+
+    busy = false;
+    failed = false;
+}
+
+/**** PUBLIC METHODS ****/
+
+/**
+ * Start writing length bytes from data to the given memory address. The
+ * data must stay valid until isBusy() returns false
+ */
+bool DMemory::startWrite( uint32_t memAddress, const uint8_t * data,
+        uint32_t length ) {
+    if ( busy || length == 0 )
+        return false;
+
+    writing = true;
+    position = memAddress;
+    remaining = length;
+    writeData = data;
+    failed = false;
+    busy = true;
+
+    if ( !_startChunk( ) ) {
+        busy = false;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Start reading length bytes from the given memory address into data
+ */
+bool DMemory::startRead( uint32_t memAddress, uint8_t * data,
+        uint32_t length ) {
+    if ( busy || length == 0 )
+        return false;
+
+    writing = false;
+    position = memAddress;
+    remaining = length;
+    readData = data;
+    failed = false;
+    busy = true;
+
+    if ( !_startChunk( ) ) {
+        busy = false;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Write and wait until the last page has been sent. Returns false if the
+ * device did not acknowledge
+ */
+bool DMemory::write( uint32_t memAddress, const uint8_t * data,
+        uint32_t length ) {
+    bus->lock( );
+    bool done = startWrite(memAddress, data, length) && _wait( );
+    bus->unlock( );
+    return done;
+}
+
+/**
+ * Read and wait for the data. Returns false if the device did not
+ * acknowledge
+ */
+bool DMemory::read( uint32_t memAddress, uint8_t * data, uint32_t length ) {
+    bus->lock( );
+    bool done = startRead(memAddress, data, length) && _wait( );
+    bus->unlock( );
+    return done;
+}
+
+bool DMemory::isBusy( void ) {
+    return busy;
+}
+
+/**
+ * Returns true if the last operation was aborted
+ */
+bool DMemory::hasFailed( void ) {
+    return failed;
+}
+
+/**** PRIVATE METHODS ****/
+
+bool DMemory::_wait( void ) {
+    while ( busy )
+        bus->_waitEvent( );
+    return !failed;
+}
+
+/**
+ * Start the transfer of the next chunk. A write chunk never crosses a page
+ * boundary, as the device would wrap around within the page. A read is a
+ * single stream: the device is addressed once and keeps sending
+ */
+bool DMemory::_startChunk( void ) {
+    uint8_t deviceAddress = address;
+    uint8_t header = 0;
+
+    if ( addressBytes == 2 ) {
+        txBuffer[header++] = position >> 8;
+    } else {
+        // Small devices take the upper address bits as 'block' bits
+        deviceAddress |= (position >> 8) & 0x07;
+    }
+    txBuffer[header++] = position & 0xFF;
+
+    if ( writing ) {
+        uint32_t length = pageSize - (position % pageSize);
+        if ( length > (uint32_t) (TX_BUFFER_SIZE - header) )
+            length = TX_BUFFER_SIZE - header;
+        if ( length > remaining )
+            length = remaining;
+        chunkLength = length;
+
+        for ( int i = 0; i < chunkLength; i++ )
+            txBuffer[header + i] = writeData[i];
+
+        return bus->startTransfer(deviceAddress, txBuffer,
+                header + chunkLength, NULL, 0, memoryComplete, this,
+                &memoryPolicy);
+    }
+
+    // A read right after a write has to wait for the last write cycle too
+    return bus->startStreamRead(deviceAddress, txBuffer, header, remaining,
+            memoryData, memoryComplete, this, &memoryPolicy);
+}
+
+/**
+ * Called from the DWire ISR with each chunk of a read
+ */
+void DMemory::_handleData( const uint8_t * data, uint8_t length ) {
+    for ( int i = 0; i < length; i++ )
+        readData[i] = data[i];
+
+    position += length;
+    remaining -= length;
+    readData += length;
+}
+
+/**
+ * Called from the DWire ISR when a chunk has finished, or a read
+ */
+void DMemory::_handleComplete( bool nak ) {
+    if ( nak ) {
+        failed = true;
+        busy = false;
+        return;
+    }
+
+    // Reads have been advanced by _handleData()
+    if ( writing ) {
+        position += chunkLength;
+        remaining -= chunkLength;
+        writeData += chunkLength;
+    }
+
+    if ( !remaining ) {
+        busy = false;
+        return;
+    }
+
+    // Pipeline the next chunk straight from the ISR
+    if ( !_startChunk( ) ) {
+        failed = true;
+        busy = false;
+    }
+}
+
+/**** ISR/IRQ Handles ****/
+
+void memoryData( void * context, const uint8_t * data, uint8_t length ) {
+    ((DMemory *) context)->_handleData(data, length);
+}
+
+void memoryComplete( void * context, bool nak ) {
+    ((DMemory *) context)->_handleComplete(nak);
+}
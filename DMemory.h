@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DMemory: paged reads and writes of I2C EEPROM and FRAM devices on top of
+ * DWire. Writes of any length are split on page boundaries and the pages
+ * are sent back to back from the ISR, using acknowledge polling to wait for
+ * each write cycle. A read of any length is one transaction, streamed
+ * through the receive buffer.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_DMEMORY_H_
+#define DWIRE_DMEMORY_H_
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#include "DWire.h"
+
+// Number of attempts while the device is busy with its write cycle. One
+// attempt takes about 25us at 400kHz, so this covers a 10ms write cycle
+#define MEMORY_WRITE_ATTEMPTS 400
+
+/* Main class definition */
+class DMemory {
+private:
+
+    DWire * bus;
+    uint8_t address;
+    uint16_t pageSize;
+    uint8_t addressBytes;
+
+    /* Progress of the current operation */
+    volatile bool busy;
+    volatile bool failed;
+    bool writing;
+    uint32_t position;
+    uint32_t remaining;
+    const uint8_t * writeData;
+    uint8_t * readData;
+    uint8_t chunkLength;
+
+    uint8_t txBuffer[TX_BUFFER_SIZE];
+
+    bool _startChunk( void );
+    bool _wait( void );
+
+public:
+
+    DMemory( DWire *, uint8_t, uint16_t, uint8_t );
+
+    bool startWrite( uint32_t, const uint8_t *, uint32_t );
+    bool startRead( uint32_t, uint8_t *, uint32_t );
+
+    bool write( uint32_t, const uint8_t *, uint32_t );
+    bool read( uint32_t, uint8_t *, uint32_t );
+
+    bool isBusy( void );
+    bool hasFailed( void );
+
+    /* Internal */
+    void _handleData( const uint8_t *, uint8_t );
+    void _handleComplete( bool );
+};
+
+#endif /* DWIRE_DMEMORY_H_ */
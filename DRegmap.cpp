@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DRegmap: a shadow cache of a device's 8-bit registers, in the style of
+ * Linux's regmap. Reads of cached registers are served from RAM,
+ * updateBits() skips the bus if the value would not change, and in
+ * write-back mode writes only mark registers dirty until sync() sends the
+ * dirty ranges as bursts. Volatile registers (e.g. status and data
+ * registers) always go to the device.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "DRegmap.h"
+
+/**** CONSTRUCTORS ****/
+
+/**
+ * Create an empty cache for the given device. All registers are cacheable
+ * until marked volatile
+ */
+DRegmap::DRegmap( DDevice * device ) {
+    this->device = device;
+    writeBack = false;
+    hits = 0;
+    misses = 0;
+
+    for ( int i = 0; i < REGMAP_BITMAP_SIZE; i++ ) {
+        volatileMap[i] = 0;
+        validMap[i] = 0;
+        dirtyMap[i] = 0;
+    }
+}
+
+/**** PUBLIC METHODS ****/
+
+/**
+ * Mark the registers first to last (inclusive) as volatile: they are never
+ * cached
+ */
+void DRegmap::setVolatile( uint8_t first, uint8_t last ) {
+    for ( int reg = first; reg <= last && reg < REGMAP_REGISTERS; reg++ ) {
+        _setBit(volatileMap, reg, true);
+        _setBit(validMap, reg, false);
+        _setBit(dirtyMap, reg, false);
+    }
+}
+
+/**
+ * In write-back mode, writes to cached registers only update the cache
+ * until sync(). Switching it off syncs first
+ */
+void DRegmap::setWriteBack( bool enabled ) {
+    if ( !enabled )
+        sync( );
+    writeBack = enabled;
+}
+
+/**
+ * Read a register, from the cache if possible. Returns false if the device
+ * did not acknowledge
+ */
+bool DRegmap::read( uint8_t reg, uint8_t * value ) {
+    if ( _isCached(reg) && _getBit(validMap, reg) ) {
+        hits++;
+        *value = values[reg];
+        return true;
+    }
+
+    misses++;
+    if ( !device->readRegisters(reg, value, 1) )
+        return false;
+
+    if ( _isCached(reg) ) {
+        values[reg] = *value;
+        _setBit(validMap, reg, true);
+    }
+    return true;
+}
+
+/**
+ * Write a register. In write-back mode a cached register is only marked
+ * dirty. Returns false if the device did not acknowledge
+ */
+bool DRegmap::write( uint8_t reg, uint8_t value ) {
+    if ( !_isCached(reg) )
+        return device->writeRegister(reg, value);
+
+    if ( writeBack ) {
+        values[reg] = value;
+        _setBit(validMap, reg, true);
+        _setBit(dirtyMap, reg, true);
+        return true;
+    }
+
+    if ( !device->writeRegister(reg, value) ) {
+        // The device state is unknown now
+        _setBit(validMap, reg, false);
+        return false;
+    }
+
+    values[reg] = value;
+    _setBit(validMap, reg, true);
+    return true;
+}
+
+/**
+ * Read-modify-write the bits in mask. For a cached register, neither the
+ * read nor the write touches the bus if the value is already known and
+ * unchanged
+ */
+bool DRegmap::updateBits( uint8_t reg, uint8_t mask, uint8_t value ) {
+    uint8_t current;
+    if ( !read(reg, &current) )
+        return false;
+
+    uint8_t updated = (current & ~mask) | (value & mask);
+    if ( updated == current && _isCached(reg) )
+        return true;
+
+    return write(reg, updated);
+}
+
+/**
+ * Write all dirty registers to the device. Consecutive dirty registers are
+ * sent as one burst, so the device must auto-increment the register
+ * address. Returns false if any burst was not acknowledged; those
+ * registers stay dirty
+ */
+bool DRegmap::sync( void ) {
+    uint8_t burst[TX_BUFFER_SIZE];
+    bool acknowledged = true;
+    int reg = 0;
+
+    while ( reg < REGMAP_REGISTERS ) {
+        if ( !_getBit(dirtyMap, reg) ) {
+            reg++;
+            continue;
+        }
+
+        uint8_t first = reg;
+        uint8_t length = 1;
+        burst[0] = first;
+        while ( reg < REGMAP_REGISTERS && _getBit(dirtyMap, reg)
+                && length < TX_BUFFER_SIZE )
+            burst[length++] = values[reg++];
+
+        if ( device->write(burst, length) ) {
+            for ( int i = first; i < reg; i++ )
+                _setBit(dirtyMap, i, false);
+        } else {
+            acknowledged = false;
+        }
+    }
+    return acknowledged;
+}
+
+/**
+ * Mark every cached register dirty, e.g. to restore the device's
+ * configuration with sync() after it lost power
+ */
+void DRegmap::markDirty( void ) {
+    for ( int i = 0; i < REGMAP_BITMAP_SIZE; i++ )
+        dirtyMap[i] = validMap[i];
+}
+
+/**
+ * Forget all cached values, e.g. after a reset of the device. Dirty values
+ * are lost
+ */
+void DRegmap::invalidate( void ) {
+    for ( int i = 0; i < REGMAP_BITMAP_SIZE; i++ ) {
+        validMap[i] = 0;
+        dirtyMap[i] = 0;
+    }
+}
+
+/**
+ * Returns the number of reads served from the cache
+ */
+uint32_t DRegmap::getHits( void ) {
+    return hits;
+}
+
+/**
+ * Returns the number of reads that went to the device
+ */
+uint32_t DRegmap::getMisses( void ) {
+    return misses;
+}
+
+/**** PRIVATE METHODS ****/
+
+bool DRegmap::_isCached( uint8_t reg ) {
+    return reg < REGMAP_REGISTERS && !_getBit(volatileMap, reg);
+}
+
+bool DRegmap::_getBit( const uint8_t * bitmap, uint8_t reg ) {
+    return (bitmap[reg >> 3] >> (reg & 0x07)) & 0x01;
+}
+
+void DRegmap::_setBit( uint8_t * bitmap, uint8_t reg, bool set ) {
+    if ( set )
+        bitmap[reg >> 3] |= 1 << (reg & 0x07);
+    else
+        bitmap[reg >> 3] &= ~(1 << (reg & 0x07));
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DRegmap: a shadow cache of a device's 8-bit registers, in the style of
+ * Linux's regmap. Reads of cached registers are served from RAM,
+ * updateBits() skips the bus if the value would not change, and in
+ * write-back mode writes only mark registers dirty until sync() sends the
+ * dirty ranges as bursts. Volatile registers (e.g. status and data
+ * registers) always go to the device.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_DREGMAP_H_
+#define DWIRE_DREGMAP_H_
+
+#include "DDevice.h"
+
+// Number of registers (from 0) that can be cached; registers above this
+// are treated as volatile
+#ifndef REGMAP_REGISTERS
+#define REGMAP_REGISTERS 64
+#endif
+
+#define REGMAP_BITMAP_SIZE ((REGMAP_REGISTERS + 7) / 8)
+
+/* Main class definition */
+class DRegmap {
+private:
+
+    DDevice * device;
+
+    bool writeBack;
+
+    uint8_t values[REGMAP_REGISTERS];
+    uint8_t volatileMap[REGMAP_BITMAP_SIZE];
+    uint8_t validMap[REGMAP_BITMAP_SIZE];
+    uint8_t dirtyMap[REGMAP_BITMAP_SIZE];
+
+    uint32_t hits;
+    uint32_t misses;
+
+    bool _isCached( uint8_t );
+    bool _getBit( const uint8_t *, uint8_t );
+    void _setBit( uint8_t *, uint8_t, bool );
+
+public:
+
+    DRegmap( DDevice * );
+
+    void setVolatile( uint8_t, uint8_t );
+    void setWriteBack( bool );
+
+    bool read( uint8_t, uint8_t * );
+    bool write( uint8_t, uint8_t );
+    bool updateBits( uint8_t, uint8_t, uint8_t );
+
+    bool sync( void );
+    void markDirty( void );
+    void invalidate( void );
+
+    uint32_t getHits( void );
+    uint32_t getMisses( void );
+};
+
+#endif /* DWIRE_DREGMAP_H_ */
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DSMBus: SMBus protocol layer on top of DWire, providing the byte, word,
+ * block and process call transactions with optional Packet Error Code
+ * checking. The PEC is computed by the DWire ISR while the bytes pass.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "DSMBus.h"
+
+/**** CONSTRUCTORS ****/
+
+DSMBus::DSMBus( DWire * bus ) {
+    this->bus = bus;
+    pec = false;
+}
+
+/**** PUBLIC METHODS ****/
+
+/**
+ * Enable or disable Packet Error Code checking for the transactions of
+ * this DSMBus. Other users of the bus are not affected
+ */
+void DSMBus::setPEC( bool enabled ) {
+    pec = enabled;
+}
+
+bool DSMBus::writeByte( uint8_t address, uint8_t command, uint8_t value ) {
+    bus->beginTransmission(address);
+    bus->setPEC(pec);
+    bus->write(command);
+    bus->write(value);
+    return _write( );
+}
+
+bool DSMBus::readByte( uint8_t address, uint8_t command, uint8_t * value ) {
+    return _read(address, command, value, 1);
+}
+
+bool DSMBus::writeWord( uint8_t address, uint8_t command, uint16_t value ) {
+    bus->beginTransmission(address);
+    bus->setPEC(pec);
+    bus->write(command);
+    bus->write(value & 0xFF);
+    bus->write(value >> 8);
+    return _write( );
+}
+
+bool DSMBus::readWord( uint8_t address, uint8_t command, uint16_t * value ) {
+    uint8_t data[2];
+    if ( !_read(address, command, data, 2) )
+        return false;
+
+    *value = data[0] | (data[1] << 8);
+    return true;
+}
+
+/**
+ * Write a block of up to SMBUS_MAX_BLOCK bytes, preceded by its length
+ */
+bool DSMBus::blockWrite( uint8_t address, uint8_t command,
+        const uint8_t * data, uint8_t length ) {
+    if ( length > SMBUS_MAX_BLOCK )
+        return false;
+
+    bus->beginTransmission(address);
+    bus->setPEC(pec);
+    bus->write(command);
+    bus->write(length);
+    for ( int i = 0; i < length; i++ )
+        bus->write(data[i]);
+    return _write( );
+}
+
+/**
+ * Read a block whose length is given by the slave. The ISR adjusts the
+ * transfer to the count byte, so data needs room for SMBUS_MAX_READ_BLOCK
+ * bytes. With an RX_BUFFER_SIZE below the default of 34, longer blocks
+ * fail
+ */
+bool DSMBus::blockRead( uint8_t address, uint8_t command, uint8_t * data,
+        uint8_t * length ) {
+    bus->beginTransmission(address);
+    bus->setPEC(pec);
+    bus->write(command);
+
+    uint8_t received = bus->requestBlock(address);
+    if ( received == 0 )
+        return false;
+
+    // Blocks that did not fit in the rx buffer were cut short
+    uint8_t count = bus->read( );
+    if ( count > SMBUS_MAX_READ_BLOCK
+            || received != 1 + count + (pec ? 1 : 0) )
+        return false;
+
+    for ( int i = 0; i < count; i++ )
+        data[i] = bus->read( );
+
+    *length = count;
+    return !pec || bus->isPECValid( );
+}
+
+/**
+ * Write a word and read back the slave's answer in a single transaction
+ */
+bool DSMBus::processCall( uint8_t address, uint8_t command, uint16_t value,
+        uint16_t * result ) {
+    bus->beginTransmission(address);
+    bus->setPEC(pec);
+    bus->write(command);
+    bus->write(value & 0xFF);
+    bus->write(value >> 8);
+
+    uint8_t length = 2 + (pec ? 1 : 0);
+    if ( bus->requestFrom(address, length) != length )
+        return false;
+
+    *result = bus->read( );
+    *result |= bus->read( ) << 8;
+    if ( pec )
+        bus->read( );
+
+    return !pec || bus->isPECValid( );
+}
+
+/**** PRIVATE METHODS ****/
+
+/**
+ * Send the buffered write (the DWire ISR appends the PEC) and wait for it
+ */
+bool DSMBus::_write( void ) {
+    // Keep the bus until the result has been read
+    bus->lock( );
+    bus->endTransmission( );
+    while ( bus->isBusy( ) )
+        bus->_waitEvent( );
+    bool acknowledged = !bus->hasFailed( );
+    bus->unlock( );
+    return acknowledged;
+}
+
+/**
+ * Write the command and read length bytes with a repeated start
+ */
+bool DSMBus::_read( uint8_t address, uint8_t command, uint8_t * data,
+        uint8_t length ) {
+    bus->beginTransmission(address);
+    bus->setPEC(pec);
+    bus->write(command);
+
+    uint8_t total = length + (pec ? 1 : 0);
+    if ( bus->requestFrom(address, total) != total )
+        return false;
+
+    for ( int i = 0; i < length; i++ )
+        data[i] = bus->read( );
+    if ( pec )
+        bus->read( );
+
+    return !pec || bus->isPECValid( );
+}
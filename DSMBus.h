@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DSMBus: SMBus protocol layer on top of DWire, providing the byte, word,
+ * block and process call transactions with optional Packet Error Code
+ * checking. The PEC is computed by the DWire ISR while the bytes pass.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_DSMBUS_H_
+#define DWIRE_DSMBUS_H_
+
+#include "DWire.h"
+
+// Largest block that fits in the tx buffer next to the command and count
+#define SMBUS_MAX_BLOCK (TX_BUFFER_SIZE - 2)
+
+// Largest block a slave may return (SMBus 2.0)
+#define SMBUS_MAX_READ_BLOCK 32
+
+/* Main class definition */
+class DSMBus {
+private:
+
+    DWire * bus;
+    bool pec;
+
+    bool _write( void );
+    bool _read( uint8_t, uint8_t, uint8_t *, uint8_t );
+
+public:
+
+    DSMBus( DWire * );
+
+    void setPEC( bool );
+
+    bool writeByte( uint8_t, uint8_t, uint8_t );
+    bool readByte( uint8_t, uint8_t, uint8_t * );
+    bool writeWord( uint8_t, uint8_t, uint16_t );
+    bool readWord( uint8_t, uint8_t, uint16_t * );
+    bool blockWrite( uint8_t, uint8_t, const uint8_t *, uint8_t );
+    bool blockRead( uint8_t, uint8_t, uint8_t *, uint8_t * );
+    bool processCall( uint8_t, uint8_t, uint16_t, uint16_t * );
+};
+
+#endif /* DWIRE_DSMBUS_H_ */
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DScheduler: periodic, interrupt-driven polling of I2C registers
+ * on top of DWire. A Timer32 interrupt starts the reads, the eUSCI
+ * interrupts finish them and the results are stored in double-buffered
+ * snapshots which the application can read at any time.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "DScheduler.h"
+
+/**** PROTOTYPES ****/
+void pollComplete( void *, bool );
+
+/**** GLOBAL VARIABLES ****/
+
+// The scheduler driven by the Timer32 interrupt
+DScheduler * activeScheduler = NULL;
+
+/**** CONSTRUCTORS ****/
+
+DScheduler::DScheduler( void ) {
+    numPolls = 0;
+}
+
+/**** PUBLIC METHODS ****/
+
+/**
+ * Start the Timer32 module, generating a tick every tickMs milliseconds.
+ * Poll periods are rounded to a multiple of this tick
+ */
+void DScheduler::begin( uint_fast16_t tickMs ) {
+    activeScheduler = this;
+
+    MAP_Timer32_initModule(TIMER32_0_BASE, TIMER32_PRESCALER_1, TIMER32_32BIT,
+            TIMER32_PERIODIC_MODE);
+    MAP_Timer32_setCount(TIMER32_0_BASE, (MAP_CS_getMCLK( ) / 1000) * tickMs);
+
+    MAP_Timer32_registerInterrupt(TIMER32_0_INTERRUPT, T32_INT1_IRQHandler);
+    MAP_Timer32_clearInterruptFlag(TIMER32_0_BASE);
+    MAP_Timer32_enableInterrupt(TIMER32_0_BASE);
+    MAP_Interrupt_enableInterrupt(INT_T32_INT1);
+    MAP_Interrupt_enableMaster( );
+
+    MAP_Timer32_startTimer(TIMER32_0_BASE, false);
+}
+
+/**
+ * Stop polling. Transfers already in progress still complete
+ */
+void DScheduler::end( void ) {
+    MAP_Timer32_haltTimer(TIMER32_0_BASE);
+    MAP_Timer32_disableInterrupt(TIMER32_0_BASE);
+    activeScheduler = NULL;
+}
+
+/**
+ * Register a periodic read of length bytes from register reg. The period
+ * is given in ticks. Returns the identifier of the poll, or -1 if it
+ * could not be added
+ */
+int_fast8_t DScheduler::addPoll( DWire * bus, uint8_t address, uint8_t reg,
+        uint8_t length, uint_fast16_t period ) {
+    if ( numPolls == SCHEDULER_MAX_POLLS || length == 0
+            || length > SCHEDULER_MAX_LENGTH || period == 0 )
+        return -1;
+
+    PollEntry * poll = &polls[numPolls];
+    poll->bus = bus;
+    poll->address = address;
+    poll->reg = reg;
+    poll->length = length;
+    poll->period = period;
+    poll->countdown = period;
+    poll->due = false;
+    poll->front = 0;
+    poll->sequence = 0;
+    poll->failures = 0;
+
+    // Only make the entry visible to the ISR once it is complete
+    numPolls++;
+    return numPolls - 1;
+}
+
+/**
+ * Copy the latest snapshot of the given poll into buffer. This never
+ * returns a mix of two samples. Returns false if no sample exists yet
+ */
+bool DScheduler::read( uint8_t id, uint8_t * buffer ) {
+    if ( id >= numPolls )
+        return false;
+
+    PollEntry * poll = &polls[id];
+    uint32_t sequence;
+
+    do {
+        sequence = poll->sequence;
+        const uint8_t * snapshot = poll->snapshot[poll->front];
+        for ( int i = 0; i < poll->length; i++ )
+            buffer[i] = snapshot[i];
+        // Retry if a new sample was published during the copy
+    } while ( sequence != poll->sequence );
+
+    return sequence != 0;
+}
+
+/**
+ * Returns the number of samples published for the given poll
+ */
+uint32_t DScheduler::getSequence( uint8_t id ) {
+    if ( id >= numPolls )
+        return 0;
+    return polls[id].sequence;
+}
+
+/**
+ * Returns the number of reads that were not acknowledged
+ */
+uint32_t DScheduler::getFailures( uint8_t id ) {
+    if ( id >= numPolls )
+        return 0;
+    return polls[id].failures;
+}
+
+/**** PRIVATE METHODS ****/
+
+/**
+ * Start the first due poll on the given bus, if the bus is free
+ */
+void DScheduler::_dispatch( DWire * bus ) {
+    for ( int i = 0; i < numPolls; i++ ) {
+        PollEntry * poll = &polls[i];
+        if ( poll->bus != bus || !poll->due )
+            continue;
+
+        // Always read into the buffer that is not visible
+        uint8_t * back = poll->snapshot[poll->front ^ 1];
+        if ( bus->startTransfer(poll->address, &poll->reg, 1, back,
+                poll->length, pollComplete, poll) )
+            poll->due = false;
+
+        // Either started or the bus is busy: the next completion continues
+        return;
+    }
+}
+
+/**
+ * Called every Timer32 tick
+ */
+void DScheduler::_handleTick( void ) {
+    for ( int i = 0; i < numPolls; i++ ) {
+        PollEntry * poll = &polls[i];
+        poll->countdown = poll->countdown - 1;
+        if ( poll->countdown == 0 ) {
+            poll->countdown = poll->period;
+            poll->due = true;
+        }
+    }
+
+    for ( int i = 0; i < numPolls; i++ ) {
+        if ( polls[i].due )
+            _dispatch(polls[i].bus);
+    }
+}
+
+/**
+ * Called from the DWire ISR when a poll has finished
+ */
+void DScheduler::_handleComplete( PollEntry * poll, bool nak ) {
+    if ( nak ) {
+        poll->failures = poll->failures + 1;
+    } else {
+        // Publish the freshly written buffer
+        poll->front = poll->front ^ 1;
+        poll->sequence = poll->sequence + 1;
+    }
+
+    // Chain the next due poll on the same bus
+    _dispatch(poll->bus);
+}
+
+/**** ISR/IRQ Handles ****/
+
+void pollComplete( void * context, bool nak ) {
+    if ( activeScheduler )
+        activeScheduler->_handleComplete((PollEntry *) context, nak);
+}
+
+extern "C" {
+void T32_INT1_IRQHandler( void ) {
+    MAP_Timer32_clearInterruptFlag(TIMER32_0_BASE);
+
+    if ( activeScheduler )
+        activeScheduler->_handleTick( );
+}
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DScheduler: periodic, interrupt-driven polling of I2C registers
+ * on top of DWire. A Timer32 interrupt starts the reads, the eUSCI
+ * interrupts finish them and the results are stored in double-buffered
+ * snapshots which the application can read at any time.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_DSCHEDULER_H_
+#define DWIRE_DSCHEDULER_H_
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#include "DWire.h"
+
+// Maximum number of polls that can be registered
+#define SCHEDULER_MAX_POLLS 8
+
+// Maximum number of bytes read per poll
+#define SCHEDULER_MAX_LENGTH 8
+
+extern "C" {
+extern void T32_INT1_IRQHandler( void );
+}
+
+/**
+ * A single periodic read and its snapshot buffers
+ */
+typedef struct {
+    DWire * bus;
+    uint8_t address;
+    uint8_t reg;
+    uint8_t length;
+    uint16_t period;
+    volatile uint16_t countdown;
+    volatile bool due;
+
+    // Index of the buffer currently visible to the application
+    volatile uint8_t front;
+    // Incremented every time a new snapshot is published
+    volatile uint32_t sequence;
+    volatile uint32_t failures;
+    uint8_t snapshot[2][SCHEDULER_MAX_LENGTH];
+} PollEntry;
+
+/* Main class definition */
+class DScheduler {
+private:
+
+    PollEntry polls[SCHEDULER_MAX_POLLS];
+    uint8_t numPolls;
+
+    void _dispatch( DWire * );
+
+public:
+
+    DScheduler( void );
+
+    void begin( uint_fast16_t );
+    void end( void );
+
+    int_fast8_t addPoll( DWire *, uint8_t, uint8_t, uint8_t, uint_fast16_t );
+
+    bool read( uint8_t, uint8_t * );
+    uint32_t getSequence( uint8_t );
+    uint32_t getFailures( uint8_t );
+
+    /* Internal */
+    void _handleTick( void );
+    void _handleComplete( PollEntry *, bool );
+};
+
+#endif /* DWIRE_DSCHEDULER_H_ */
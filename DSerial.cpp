@@ -20,14 +20,26 @@ extern "C" {
 
 /**** PROTOTYPES ****/
 void itoa( char *, uint8_t, uint32_t, uint8_t );
+uint_fast8_t putVarint( uint8_t *, int32_t );
 
 
 /**** GLOBAL VARIABLES ****/
 
+// Receive ring buffer, filled by the ISR
+uint8_t serialRxBuffer[SERIAL_RX_BUFFER_SIZE];
+volatile uint16_t serialRxHead = 0;
+volatile uint16_t serialRxTail = 0;
+volatile uint32_t serialRxOverruns = 0;
+
+// Transmit ring buffer for text and binary records, drained by the ISR
+uint8_t serialTxBuffer[SERIAL_TX_BUFFER_SIZE];
+volatile uint16_t serialTxHead = 0;
+volatile uint16_t serialTxTail = 0;
+volatile uint32_t serialTxDropped = 0;
 
 /**** CONSTRUCTORS ****/
 DSerial::DSerial( void ) {
-    // Nothing
+    sequence = 0;
 }
 
 /**** PUBLIC METHODS ****/
@@ -49,13 +61,20 @@ void DSerial::begin( void ) {
     /* Enable UART module */
     MAP_UART_enableModule(EUSCI_A0_BASE);
 
+    /* Receive through the interrupt */
+    serialRxHead = 0;
+    serialRxTail = 0;
+    MAP_UART_registerInterrupt(EUSCI_A0_BASE, EUSCIA0_IRQHandler);
+    MAP_UART_enableInterrupt(EUSCI_A0_BASE, EUSCI_A_UART_RECEIVE_INTERRUPT);
+    MAP_Interrupt_enableInterrupt(INT_EUSCIA0);
+    MAP_Interrupt_enableMaster( );
 }
 
 /**
  * Transmit a single byte over the UART
  */
 void DSerial::print( uint_fast8_t byte ) {
-    MAP_UART_transmitData(EUSCI_A0_BASE, byte);
+    _put(byte);
 }
 
 /**
@@ -80,8 +99,9 @@ void DSerial::print( uint_fast32_t num, uint_fast8_t type ) {
     	print(0x30);
     	return;
     }
-    // Using a 10 char buffer, as an int does not have more characters than that
-    char str[10];
+    // Using a 10 char buffer, as an int does not have more characters than
+    // that, plus the terminator
+    char str[11];
 
     itoa(str, 10, num, type);
 
@@ -100,8 +120,8 @@ void DSerial::print( uint_fast32_t num, uint_fast8_t type ) {
  * Transmit a carriage return
  */
 void DSerial::println( void ) {
-    MAP_UART_transmitData(EUSCI_A0_BASE, '\r');
-    MAP_UART_transmitData(EUSCI_A0_BASE, '\n');
+    _put('\r');
+    _put('\n');
 }
 
 /**
@@ -122,8 +142,209 @@ void DSerial::println( const char * text ) {
     println( );
 }
 
+/**
+ * Returns the number of received bytes waiting to be read
+ */
+uint_fast16_t DSerial::available( void ) {
+    return (serialRxHead + SERIAL_RX_BUFFER_SIZE - serialRxTail)
+            % SERIAL_RX_BUFFER_SIZE;
+}
+
+/**
+ * Read a received byte. Returns -1 if there is none
+ */
+int_fast16_t DSerial::read( void ) {
+    uint16_t tail = serialRxTail;
+    if ( tail == serialRxHead )
+        return -1;
+
+    uint8_t byte = serialRxBuffer[tail];
+    serialRxTail = (tail + 1) % SERIAL_RX_BUFFER_SIZE;
+    return byte;
+}
+
+/**
+ * Returns the number of bytes lost because the receive buffer was full
+ */
+uint32_t DSerial::getOverruns( void ) {
+    return serialRxOverruns;
+}
+
+/**
+ * Queue a COBS-encoded frame, terminated by a zero byte. Returns
+ * immediately; the ISR sends the frame. If the frame does not fit in the
+ * transmit buffer it is dropped as a whole and false is returned. May be
+ * called from an ISR, as interrupts are disabled while the frame is queued
+ */
+bool DSerial::writeFrame( const uint8_t * data, uint_fast8_t length ) {
+    if ( length > SERIAL_MAX_FRAME )
+        return false;
+
+    bool wasDisabled = MAP_Interrupt_disableMaster( );
+
+    uint16_t head = serialTxHead;
+    uint16_t used = (head + SERIAL_TX_BUFFER_SIZE - serialTxTail)
+            % SERIAL_TX_BUFFER_SIZE;
+
+    // One code byte plus the delimiter; one slot always stays empty
+    if ( used + length + 2 >= SERIAL_TX_BUFFER_SIZE ) {
+        serialTxDropped = serialTxDropped + 1;
+        if ( !wasDisabled )
+            MAP_Interrupt_enableMaster( );
+        return false;
+    }
+
+    // Each zero is replaced by the distance to the next one
+    uint16_t code = head;
+    uint8_t distance = 1;
+    head = (head + 1) % SERIAL_TX_BUFFER_SIZE;
+    for ( uint_fast8_t i = 0; i < length; i++ ) {
+        if ( data[i] == 0 ) {
+            serialTxBuffer[code] = distance;
+            code = head;
+            distance = 1;
+        } else {
+            serialTxBuffer[head] = data[i];
+            distance++;
+        }
+        head = (head + 1) % SERIAL_TX_BUFFER_SIZE;
+    }
+    serialTxBuffer[code] = distance;
+    serialTxBuffer[head] = 0;
+    serialTxHead = (head + 1) % SERIAL_TX_BUFFER_SIZE;
+
+    MAP_UART_enableInterrupt(EUSCI_A0_BASE, EUSCI_A_UART_TRANSMIT_INTERRUPT);
+
+    if ( !wasDisabled )
+        MAP_Interrupt_enableMaster( );
+    return true;
+}
+
+/**
+ * Log an event of the given site without formatting it; the host decoder
+ * looks up the format string of the site
+ */
+bool DSerial::log( uint16_t site ) {
+    return _log(site, 0, 0);
+}
+
+/**
+ * Log an event with one argument
+ */
+bool DSerial::log( uint16_t site, int32_t arg0 ) {
+    int32_t args[] = { arg0 };
+    return _log(site, args, 1);
+}
+
+/**
+ * Log an event with two arguments
+ */
+bool DSerial::log( uint16_t site, int32_t arg0, int32_t arg1 ) {
+    int32_t args[] = { arg0, arg1 };
+    return _log(site, args, 2);
+}
+
+/**
+ * Log an event with three arguments
+ */
+bool DSerial::log( uint16_t site, int32_t arg0, int32_t arg1,
+        int32_t arg2 ) {
+    int32_t args[] = { arg0, arg1, arg2 };
+    return _log(site, args, 3);
+}
+
+/**
+ * Send a set of raw 16-bit samples of a sensor channel
+ */
+bool DSerial::sample( uint8_t channel, const int16_t * values,
+        uint_fast8_t count ) {
+    uint8_t record[SERIAL_MAX_FRAME];
+
+    if ( 3 + 2 * count > SERIAL_MAX_FRAME )
+        return false;
+
+    record[0] = SERIAL_RECORD_SAMPLE;
+    record[1] = sequence++;
+    record[2] = channel;
+    for ( uint_fast8_t i = 0; i < count; i++ ) {
+        record[3 + 2 * i] = values[i] & 0xFF;
+        record[4 + 2 * i] = (values[i] >> 8) & 0xFF;
+    }
+    return writeFrame(record, 3 + 2 * count);
+}
+
+/**
+ * Returns the number of records dropped because the transmit buffer was
+ * full
+ */
+uint32_t DSerial::getDropped( void ) {
+    return serialTxDropped;
+}
+
 /**** PRIVATE METHODS ****/
 
+/**
+ * Build a log record: type, sequence number, then the site and the
+ * arguments as zigzag varints, so small values take a single byte
+ */
+bool DSerial::_log( uint16_t site, const int32_t * args,
+        uint_fast8_t count ) {
+    uint8_t record[2 + 5 * 4];
+    uint_fast8_t length = 2;
+
+    record[0] = SERIAL_RECORD_LOG;
+    record[1] = sequence++;
+    length += putVarint(&record[length], site);
+    for ( uint_fast8_t i = 0; i < count; i++ )
+        length += putVarint(&record[length], args[i]);
+
+    return writeFrame(record, length);
+}
+
+/**
+ * Queue a text byte behind the records, so that neither breaks up the
+ * other. If the buffer is full, its oldest byte is sent from here as soon
+ * as the UART can take it, rather than by the ISR: this also works with
+ * interrupts masked and from other ISRs
+ */
+void DSerial::_put( uint8_t byte ) {
+    bool wasDisabled = MAP_Interrupt_disableMaster( );
+
+    uint16_t head = serialTxHead;
+    uint16_t next = (head + 1) % SERIAL_TX_BUFFER_SIZE;
+    if ( next == serialTxTail ) {
+        while ( !MAP_UART_getInterruptStatus(EUSCI_A0_BASE,
+                EUSCI_A_UART_TRANSMIT_INTERRUPT_FLAG) )
+            ;
+        uint16_t tail = serialTxTail;
+        MAP_UART_transmitData(EUSCI_A0_BASE, serialTxBuffer[tail]);
+        serialTxTail = (tail + 1) % SERIAL_TX_BUFFER_SIZE;
+    }
+
+    serialTxBuffer[head] = byte;
+    serialTxHead = next;
+    MAP_UART_enableInterrupt(EUSCI_A0_BASE, EUSCI_A_UART_TRANSMIT_INTERRUPT);
+
+    if ( !wasDisabled )
+        MAP_Interrupt_enableMaster( );
+}
+
+/**
+ * Write a signed value as a zigzag-encoded LEB128 varint. Returns the
+ * number of bytes written (at most 5)
+ */
+uint_fast8_t putVarint( uint8_t * buffer, int32_t value ) {
+    uint32_t zigzag = ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+    uint_fast8_t length = 0;
+
+    while ( zigzag >= 0x80 ) {
+        buffer[length++] = (zigzag & 0x7F) | 0x80;
+        zigzag >>= 7;
+    }
+    buffer[length++] = zigzag;
+    return length;
+}
+
 /**
  * Convert a given integer into a corresponding string
  */
@@ -132,8 +353,50 @@ void itoa( char * str, uint8_t len, uint32_t val, uint8_t base ) {
     uint8_t i;
 
     for ( i = 1; i <= len; i++ ) {
-        str[len - i] = (uint8_t) ((val % base) + '0');
+        str[len - i] = "0123456789ABCDEF"[val % base];
         val /= base;
     }
     str[i - 1] = '\0';
 }
+
+/**** ISR/IRQ Handles ****/
+
+extern "C" {
+void EUSCIA0_IRQHandler( void ) {
+    uint_fast8_t status = MAP_UART_getEnabledInterruptStatus(EUSCI_A0_BASE);
+
+    // The transmit flag stays set while the buffer is empty, so that
+    // enabling its interrupt starts the next record
+    MAP_UART_clearInterruptFlag(EUSCI_A0_BASE,
+            status & EUSCI_A_UART_RECEIVE_INTERRUPT_FLAG);
+
+    if ( status & EUSCI_A_UART_RECEIVE_INTERRUPT_FLAG ) {
+        uint8_t byte = MAP_UART_receiveData(EUSCI_A0_BASE);
+        uint16_t next = (serialRxHead + 1) % SERIAL_RX_BUFFER_SIZE;
+
+        // Drop the byte if the buffer is full
+        if ( next == serialRxTail ) {
+            serialRxOverruns = serialRxOverruns + 1;
+        } else {
+            serialRxBuffer[serialRxHead] = byte;
+            serialRxHead = next;
+        }
+    }
+
+    if ( status & EUSCI_A_UART_TRANSMIT_INTERRUPT_FLAG ) {
+        // A higher-priority ISR printing to a full buffer sends the same
+        // byte otherwise
+        bool wasDisabled = MAP_Interrupt_disableMaster( );
+        uint16_t tail = serialTxTail;
+        if ( tail == serialTxHead ) {
+            MAP_UART_disableInterrupt(EUSCI_A0_BASE,
+                    EUSCI_A_UART_TRANSMIT_INTERRUPT);
+        } else {
+            MAP_UART_transmitData(EUSCI_A0_BASE, serialTxBuffer[tail]);
+            serialTxTail = (tail + 1) % SERIAL_TX_BUFFER_SIZE;
+        }
+        if ( !wasDisabled )
+            MAP_Interrupt_enableMaster( );
+    }
+}
+}
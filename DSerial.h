@@ -28,6 +28,27 @@
 #define HEX 16
 #endif
 
+// Size of the receive ring buffer in bytes
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+#endif
+
+// Size of the transmit ring buffer for text and binary records in bytes
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 128
+#endif
+
+// Largest record writeFrame() accepts, so it fits in one COBS block
+#define SERIAL_MAX_FRAME 253
+
+// Record types of the binary output
+#define SERIAL_RECORD_LOG 0x01
+#define SERIAL_RECORD_SAMPLE 0x02
+
+extern "C" {
+extern void EUSCIA0_IRQHandler( void );
+}
+
 /* UART Configuration Parameter. These are the configuration parameters to
  * make the eUSCI A UART module to operate with a 19200 baud rate. These
  * values were calculated using the online calculator that TI provides
@@ -51,15 +72,34 @@ const eUSCI_UART_Config uartConfig =
 class DSerial {
 private:
 
+    uint8_t sequence;
+
+    bool _log( uint16_t, const int32_t *, uint_fast8_t );
+    void _put( uint8_t );
+
 public:
     DSerial( void );
     void begin( void );
     void print( uint_fast8_t );
     void print( const char * );
-    void print( uint_fast8_t, uint_fast8_t );
+    void print( uint_fast32_t, uint_fast8_t );
     void println( void );
     void println( uint_fast8_t );
     void println( const char * );
+
+    /* Receiving */
+    uint_fast16_t available( void );
+    int_fast16_t read( void );
+    uint32_t getOverruns( void );
+
+    /* Binary output */
+    bool writeFrame( const uint8_t *, uint_fast8_t );
+    bool log( uint16_t );
+    bool log( uint16_t, int32_t );
+    bool log( uint16_t, int32_t, int32_t );
+    bool log( uint16_t, int32_t, int32_t, int32_t );
+    bool sample( uint8_t, const int16_t *, uint_fast8_t );
+    uint32_t getDropped( void );
 };
 
 #endif /* DWIRE_DSERIAL_H_ */
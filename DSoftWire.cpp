@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DSoftWire: an I2C master on any two pins of one GPIO port, for when the
+ * four eUSCI_B modules are not enough. The CPU does not bit-bang: a whole
+ * transfer is prepared as a waveform of port direction values, which the
+ * uDMA writes to the port at the pace of a Timer_A, while a second uDMA
+ * channel samples the port for the acknowledgements and read data.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "DSoftWire.h"
+
+/**** GLOBAL VARIABLES ****/
+
+// The uDMA channel control table, unless the application has set one.
+// Primary and alternate structures for all eight channels
+#if defined(__TI_COMPILER_VERSION__)
+#pragma DATA_ALIGN(softWireControlTable, 256)
+uint8_t softWireControlTable[256];
+#else
+uint8_t softWireControlTable[256] __attribute__((aligned(256)));
+#endif
+
+// The bus using each Timer_A, for the uDMA interrupt
+DSoftWire * softWireInstances[SOFTWIRE_TIMERS];
+
+// uDMA triggers: TAxCCR0 paces the waveform, TAxCCR2 the sampling
+const uint32_t softWireDriveTriggers[SOFTWIRE_TIMERS] = {
+    DMA_CH0_TIMERA0CCR0, DMA_CH2_TIMERA1CCR0, DMA_CH4_TIMERA2CCR0,
+    DMA_CH6_TIMERA3CCR0 };
+const uint32_t softWireSampleTriggers[SOFTWIRE_TIMERS] = {
+    DMA_CH1_TIMERA0CCR2, DMA_CH3_TIMERA1CCR2, DMA_CH5_TIMERA2CCR2,
+    DMA_CH7_TIMERA3CCR2 };
+
+/**** CONSTRUCTORS ****/
+
+/**
+ * Create a bus on the given pins of one port (e.g. GPIO_PORT_P4, GPIO_PIN0,
+ * GPIO_PIN1), paced by a Timer_A module (TIMER_A0_BASE to TIMER_A3_BASE)
+ * and using its two uDMA channels
+ */
+DSoftWire::DSoftWire( uint_fast8_t port, uint_fast8_t sclPin,
+        uint_fast8_t sdaPin, uint32_t timer ) {
+    this->port = port;
+    this->sclPin = sclPin;
+    this->sdaPin = sdaPin;
+    this->timer = timer;
+
+    uint8_t index = ((timer - TIMER_A0_BASE) >> 10) % SOFTWIRE_TIMERS;
+    driveChannel = 2 * index;
+    sampleChannel = 2 * index + 1;
+    softWireInstances[index] = this;
+
+    speed = 100000;
+    busy = false;
+    gotNAK = false;
+    txLength = 0;
+    rxIndex = 0;
+    rxLength = 0;
+}
+
+/**** PUBLIC METHODS ****/
+
+void DSoftWire::begin( void ) {
+    uint8_t index = driveChannel / 2;
+
+    // Both lines are open drain: the output stays low and the direction
+    // register decides whether the line is pulled low or released
+    MAP_GPIO_setOutputLowOnPin(port, sclPin | sdaPin);
+    MAP_GPIO_setAsInputPin(port, sclPin | sdaPin);
+
+    MAP_DMA_enableModule( );
+    if ( !MAP_DMA_getControlBase( ) )
+        MAP_DMA_setControlBase(softWireControlTable);
+
+    MAP_DMA_assignChannel(softWireDriveTriggers[index]);
+    MAP_DMA_assignChannel(softWireSampleTriggers[index]);
+    MAP_DMA_setChannelControl(UDMA_PRI_SELECT | softWireDriveTriggers[index],
+            UDMA_SIZE_8 | UDMA_SRC_INC_8 | UDMA_DST_INC_NONE | UDMA_ARB_1);
+    MAP_DMA_setChannelControl(UDMA_PRI_SELECT | softWireSampleTriggers[index],
+            UDMA_SIZE_8 | UDMA_SRC_INC_NONE | UDMA_DST_INC_8 | UDMA_ARB_1);
+
+    MAP_DMA_registerInterrupt(DMA_INT0, DMA_INT0_IRQHandler);
+    MAP_DMA_enableInterrupt(INT_DMA_INT0);
+    MAP_Interrupt_enableMaster( );
+}
+
+/**
+ * Begin a transmission to the given slave
+ */
+void DSoftWire::beginTransmission( uint_fast8_t slaveAddress ) {
+    while ( busy )
+        ;
+
+    txAddress = slaveAddress;
+    txLength = 0;
+}
+
+/**
+ * Add a byte to the transmission. Bytes beyond SOFTWIRE_BUFFER_SIZE are
+ * dropped
+ */
+void DSoftWire::write( uint8_t dataByte ) {
+    if ( txLength < SOFTWIRE_BUFFER_SIZE )
+        txBuffer[txLength++] = dataByte;
+}
+
+void DSoftWire::endTransmission( void ) {
+    endTransmission(true);
+}
+
+/**
+ * Send the transmission. Without a STOP the bytes are kept and sent by the
+ * next requestFrom(), followed by a repeated start
+ */
+void DSoftWire::endTransmission( bool sendStop ) {
+    if ( !sendStop )
+        return;
+
+    startTransfer(txAddress, txBuffer, txLength, NULL, 0, NULL, NULL);
+    txLength = 0;
+    while ( busy )
+        ;
+}
+
+/**
+ * Read numBytes from a slave, after any pending transmission to it.
+ * Returns the number of bytes available to read(), or 0 on a NAK
+ */
+uint8_t DSoftWire::requestFrom( uint_fast8_t slaveAddress,
+        uint_fast8_t numBytes ) {
+    if ( numBytes > SOFTWIRE_BUFFER_SIZE )
+        numBytes = SOFTWIRE_BUFFER_SIZE;
+
+    rxIndex = 0;
+    rxLength = 0;
+    if ( !startTransfer(slaveAddress, txBuffer, txLength, rxBuffer, numBytes,
+            NULL, NULL) )
+        return 0;
+    txLength = 0;
+
+    while ( busy )
+        ;
+
+    if ( gotNAK )
+        return 0;
+
+    rxLength = numBytes;
+    return numBytes;
+}
+
+/**
+ * Read a byte received by requestFrom()
+ */
+uint8_t DSoftWire::read( void ) {
+    if ( rxIndex >= rxLength )
+        return 0;
+    return rxBuffer[rxIndex++];
+}
+
+/**
+ * Returns true if the slave did not acknowledge the last transfer
+ */
+bool DSoftWire::hasFailed( void ) {
+    return gotNAK;
+}
+
+/**
+ * Start a transfer: write txLength bytes, then read rxLength bytes after a
+ * repeated start. The callback is called from the uDMA interrupt. Returns
+ * false if the bus is busy or the lengths are too large
+ */
+bool DSoftWire::startTransfer( uint_fast8_t slaveAddress,
+        const uint8_t * txData, uint8_t txLength, uint8_t * rxData,
+        uint8_t rxLength, DWireCallback callback, void * context ) {
+    if ( txLength > SOFTWIRE_BUFFER_SIZE || rxLength > SOFTWIRE_BUFFER_SIZE )
+        return false;
+
+    bool wasDisabled = MAP_Interrupt_disableMaster( );
+    bool claimed = !busy;
+    busy = true;
+    if ( !wasDisabled )
+        MAP_Interrupt_enableMaster( );
+    if ( !claimed )
+        return false;
+
+    transferRxBuffer = rxData;
+    transferRxLength = rxLength;
+    transferCallback = callback;
+    transferContext = context;
+
+    return _run(slaveAddress, txData, txLength, rxLength);
+}
+
+bool DSoftWire::isBusy( void ) {
+    return busy;
+}
+
+/**
+ * Set the bus speed in Hz, up to 400 kHz. Returns false while a transfer
+ * is running
+ */
+bool DSoftWire::setSpeed( uint32_t speed ) {
+    if ( busy || speed == 0 || speed > 400000 )
+        return false;
+
+    this->speed = speed;
+    return true;
+}
+
+uint32_t DSoftWire::getSpeed( void ) {
+    return speed;
+}
+
+/**
+ * Called from the uDMA interrupt once the last sample has been taken
+ */
+void DSoftWire::_handleComplete( void ) {
+    MAP_Timer_A_stopTimer(timer);
+
+    // Every byte the master sent must have been acknowledged
+    gotNAK = false;
+    for ( int i = 0; i < ackCount; i++ )
+        if ( samples[ackTicks[i] + 1] & sdaPin )
+            gotNAK = true;
+
+    if ( !gotNAK ) {
+        for ( int i = 0; i < transferRxLength; i++ ) {
+            uint8_t data = 0;
+            for ( int bit = 0; bit < 8; bit++ ) {
+                uint16_t tick = readTick
+                        + (i * 9 + bit + 1) * SOFTWIRE_TICKS_PER_BIT - 1;
+                data = (data << 1) | ((samples[tick + 1] & sdaPin) ? 1 : 0);
+            }
+            transferRxBuffer[i] = data;
+        }
+    }
+
+    busy = false;
+    if ( transferCallback )
+        transferCallback(transferContext, gotNAK);
+}
+
+uint8_t DSoftWire::_getSampleChannel( void ) {
+    return sampleChannel;
+}
+
+/**** PRIVATE METHODS ****/
+
+/**
+ * Build the waveform of a transfer and start playing it
+ */
+bool DSoftWire::_run( uint8_t slaveAddress, const uint8_t * txData,
+        uint8_t txLength, uint8_t rxLength ) {
+    uint8_t index = driveChannel / 2;
+    volatile uint8_t * dir = (volatile uint8_t *) DWIRE_PORT_REG(port,
+            DWIRE_PORT_DIR_OFFSET);
+
+    // The other pins of the port keep their direction
+    dirBase = *dir & ~(sclPin | sdaPin);
+    waveLength = 0;
+    ackCount = 0;
+    sdaLow = false;
+
+    _start( );
+    if ( txLength || !rxLength ) {
+        _writeByte(slaveAddress << 1);
+        for ( int i = 0; i < txLength; i++ )
+            _writeByte(txData[i]);
+        if ( rxLength )
+            _start( );
+    }
+    if ( rxLength ) {
+        _writeByte((slaveAddress << 1) | 0x01);
+        _readBytes(rxLength);
+    }
+    _stop( );
+
+    // The sampling runs half a tick behind and takes one extra sample, so
+    // sample i + 1 shows the lines during tick i
+    MAP_DMA_setChannelTransfer(UDMA_PRI_SELECT | softWireDriveTriggers[index],
+            UDMA_MODE_BASIC, wave, (void *) dir, waveLength);
+    MAP_DMA_setChannelTransfer(
+            UDMA_PRI_SELECT | softWireSampleTriggers[index], UDMA_MODE_BASIC,
+            (void *) DWIRE_PORT_REG(port, DWIRE_PORT_IN_OFFSET), samples,
+            waveLength + 1);
+    MAP_DMA_clearInterruptFlag(driveChannel);
+    MAP_DMA_clearInterruptFlag(sampleChannel);
+    MAP_DMA_enableChannel(driveChannel);
+    MAP_DMA_enableChannel(sampleChannel);
+
+    // Rounded up, so that the bus is never faster than requested
+    uint32_t tickRate = speed * SOFTWIRE_TICKS_PER_BIT;
+    uint16_t period = (MAP_CS_getSMCLK( ) + tickRate - 1) / tickRate;
+    const Timer_A_UpModeConfig upConfig = {
+    TIMER_A_CLOCKSOURCE_SMCLK,
+    TIMER_A_CLOCKSOURCE_DIVIDER_1, (uint_fast16_t) (period - 1),
+    TIMER_A_TAIE_INTERRUPT_DISABLE,
+    TIMER_A_CCIE_CCR0_INTERRUPT_DISABLE,
+    TIMER_A_DO_CLEAR };
+    const Timer_A_CompareModeConfig sampleConfig = {
+    TIMER_A_CAPTURECOMPARE_REGISTER_2,
+    TIMER_A_CAPTURECOMPARE_INTERRUPT_DISABLE,
+    TIMER_A_OUTPUTMODE_OUTBITVALUE, (uint_fast16_t) (period / 2) };
+
+    MAP_Timer_A_configureUpMode(timer, &upConfig);
+    MAP_Timer_A_initCompare(timer, &sampleConfig);
+    MAP_Timer_A_startCounter(timer, TIMER_A_UP_MODE);
+    return true;
+}
+
+/**
+ * Append one tick. A line is pulled low by making its pin an output
+ */
+void DSoftWire::_put( bool sclLow, bool sdaLow ) {
+    wave[waveLength++] = dirBase | (sclLow ? sclPin : 0)
+            | (sdaLow ? sdaPin : 0);
+    this->sdaLow = sdaLow;
+}
+
+/**
+ * Append one bit: SDA changes while SCL is low, then SCL is released for
+ * two ticks. Returns the tick at which the bit is sampled
+ */
+uint16_t DSoftWire::_bit( bool low ) {
+    _put(true, sdaLow);
+    _put(true, low);
+    _put(false, low);
+    _put(false, low);
+    return waveLength - 1;
+}
+
+/**
+ * Append a START, or a repeated START after a previous byte
+ */
+void DSoftWire::_start( void ) {
+    if ( waveLength ) {
+        _put(true, sdaLow);
+        _put(true, false);
+    }
+    _put(false, false);
+    _put(false, true);
+}
+
+void DSoftWire::_stop( void ) {
+    _put(true, sdaLow);
+    _put(true, true);
+    _put(false, true);
+    _put(false, false);
+}
+
+/**
+ * Append a byte sent by the master, releasing SDA for the acknowledgement
+ */
+void DSoftWire::_writeByte( uint8_t data ) {
+    for ( int bit = 7; bit >= 0; bit-- )
+        _bit(!((data >> bit) & 0x01));
+    ackTicks[ackCount++] = _bit(false);
+}
+
+/**
+ * Append bytes sent by the slave. The master acknowledges all but the last
+ */
+void DSoftWire::_readBytes( uint8_t length ) {
+    readTick = waveLength;
+    for ( int i = 0; i < length; i++ ) {
+        for ( int bit = 0; bit < 8; bit++ )
+            _bit(false);
+        _bit(i < length - 1);
+    }
+}
+
+/**** ISR/IRQ Handles ****/
+
+extern "C" {
+void DMA_INT0_IRQHandler( void ) {
+    uint32_t status = MAP_DMA_getInterruptStatus( );
+
+    for ( int i = 0; i < SOFTWIRE_TIMERS; i++ ) {
+        DSoftWire * bus = softWireInstances[i];
+        if ( !bus )
+            continue;
+
+        // The drive channel finishes first; only its flag needs clearing
+        MAP_DMA_clearInterruptFlag(2 * i);
+        if ( status & (1 << bus->_getSampleChannel( )) ) {
+            MAP_DMA_clearInterruptFlag(bus->_getSampleChannel( ));
+            bus->_handleComplete( );
+        }
+    }
+}
+}
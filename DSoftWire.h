@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DSoftWire: an I2C master on any two pins of one GPIO port, for when the
+ * four eUSCI_B modules are not enough. The CPU does not bit-bang: a whole
+ * transfer is prepared as a waveform of port direction values, which the
+ * uDMA writes to the port at the pace of a Timer_A, while a second uDMA
+ * channel samples the port for the acknowledgements and read data.
+ *
+ * The interface follows DWire's master interface. Slaves may not stretch
+ * the clock, and there is no multi-master support.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef DWIRE_DSOFTWIRE_H_
+#define DWIRE_DSOFTWIRE_H_
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#include "DWire.h"
+
+// Maximum number of bytes written and read per transfer
+#ifndef SOFTWIRE_BUFFER_SIZE
+#define SOFTWIRE_BUFFER_SIZE 8
+#endif
+
+// Timer ticks per bit: SDA changes in the second tick, SCL is high in the
+// last two
+#define SOFTWIRE_TICKS_PER_BIT 4
+
+// Waveform length for the largest transfer: two address bytes, the data
+// with acknowledgements and the (repeated) START and STOP conditions
+#define SOFTWIRE_MAX_TICKS ((2 * SOFTWIRE_BUFFER_SIZE + 2) * 9 \
+        * SOFTWIRE_TICKS_PER_BIT + 10)
+
+// A basic uDMA transfer moves at most 1024 items
+#if SOFTWIRE_MAX_TICKS >= 1024
+#error "SOFTWIRE_BUFFER_SIZE is too large"
+#endif
+
+// Number of Timer_A modules, and so of software buses
+#define SOFTWIRE_TIMERS 4
+
+/* Main class definition */
+class DSoftWire {
+private:
+
+    uint_fast8_t port;
+    uint8_t sclPin;
+    uint8_t sdaPin;
+    uint32_t timer;
+    uint8_t driveChannel;
+    uint8_t sampleChannel;
+    uint32_t speed;
+
+    /* Waveform of the current transfer, and the port input during it */
+    uint8_t wave[SOFTWIRE_MAX_TICKS];
+    uint8_t samples[SOFTWIRE_MAX_TICKS + 1];
+    uint16_t waveLength;
+    uint8_t dirBase;
+    bool sdaLow;
+
+    /* Ticks at which the acknowledgements and read data are sampled */
+    uint16_t ackTicks[SOFTWIRE_BUFFER_SIZE + 2];
+    uint8_t ackCount;
+    uint16_t readTick;
+
+    /* Asynchronous transfer state */
+    volatile bool busy;
+    volatile bool gotNAK;
+    uint8_t * transferRxBuffer;
+    uint8_t transferRxLength;
+    DWireCallback transferCallback;
+    void * transferContext;
+
+    /* Wire-style buffers */
+    uint8_t txAddress;
+    uint8_t txBuffer[SOFTWIRE_BUFFER_SIZE];
+    uint8_t txLength;
+    uint8_t rxBuffer[SOFTWIRE_BUFFER_SIZE];
+    uint8_t rxIndex;
+    uint8_t rxLength;
+
+    void _put( bool, bool );
+    uint16_t _bit( bool );
+    void _start( void );
+    void _stop( void );
+    void _writeByte( uint8_t );
+    void _readBytes( uint8_t );
+    bool _run( uint8_t, const uint8_t *, uint8_t, uint8_t );
+
+public:
+
+    DSoftWire( uint_fast8_t, uint_fast8_t, uint_fast8_t, uint32_t );
+
+    void begin( void );
+
+    void beginTransmission( uint_fast8_t );
+    void write( uint8_t );
+    void endTransmission( void );
+    void endTransmission( bool );
+
+    uint8_t requestFrom( uint_fast8_t, uint_fast8_t );
+    uint8_t read( void );
+
+    bool hasFailed( void );
+
+    bool startTransfer( uint_fast8_t, const uint8_t *, uint8_t, uint8_t *,
+            uint8_t, DWireCallback, void * );
+    bool isBusy( void );
+
+    bool setSpeed( uint32_t );
+    uint32_t getSpeed( void );
+
+    /* Internal */
+    void _handleComplete( void );
+    uint8_t _getSampleChannel( void );
+};
+
+extern "C" {
+extern void DMA_INT0_IRQHandler( void );
+}
+
+#endif /* DWIRE_DSOFTWIRE_H_ */
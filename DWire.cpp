@@ -16,22 +16,29 @@
 
 #include "modulemap.h"
 
-/**** PROTOTYPES AND CLASSES ****/
+#ifdef DWIRE_CAPTURE
+#include "capture.h"
+#endif
 
-/* A data structure containing pointers to relevant buffers
- * to be used by ISRs. */
-typedef struct {
-	uint32_t module;
-	uint8_t * rxBuffer;
-	uint8_t * rxBufferIndex;
-	uint8_t * rxBufferSize;
-	uint8_t * txBuffer;
-	uint8_t * txBufferIndex;
-	uint8_t * txBufferSize;
-} IRQParam;
-
-/* The main IRQ handling function */
-void IRQHandler(IRQParam);
+/**** HOT PATH ****/
+
+// An SRAM-resident ISR accesses the data registers directly instead of
+// calling driverlib in flash or ROM for every byte
+#ifdef DWIRE_SRAM_ISR
+#define ISR_MASTER_SEND(module, data) DWIRE_WRITE_TXBUF(module, data)
+#define ISR_MASTER_RECEIVE(module) DWIRE_READ_RXBUF(module)
+#define ISR_SLAVE_PUT(module, data) DWIRE_WRITE_TXBUF(module, data)
+#define ISR_SLAVE_GET(module) DWIRE_READ_RXBUF(module)
+#else
+#define ISR_MASTER_SEND(module, data) MAP_I2C_masterSendMultiByteNext(module, data)
+#define ISR_MASTER_RECEIVE(module) MAP_I2C_masterReceiveMultiByteNext(module)
+#define ISR_SLAVE_PUT(module, data) MAP_I2C_slavePutData(module, data)
+#define ISR_SLAVE_GET(module) MAP_I2C_slaveGetData(module)
+#endif
+
+// A streamed slave response uses the halves of the tx buffer in turn
+#define PULL_HALF (TX_BUFFER_SIZE / 2)
+#define PULL_BOTH 2
 
 /**** GLOBAL VARIABLES ****/
 
@@ -45,6 +52,10 @@ uint8_t EUSCIB0_txBufferSize = 0;
 uint8_t EUSCIB0_rxBuffer[RX_BUFFER_SIZE];
 uint8_t EUSCIB0_rxBufferIndex = 0;
 uint8_t EUSCIB0_rxBufferSize = 0;
+
+IRQParam EUSCIB0_irqParam = { EUSCI_B0_BASE, NULL, STATE_IDLE,
+		EUSCIB0_rxBuffer, &EUSCIB0_rxBufferIndex, &EUSCIB0_rxBufferSize,
+		EUSCIB0_txBuffer, &EUSCIB0_txBufferIndex, &EUSCIB0_txBufferSize };
 #endif
 
 #ifdef USING_EUSCI_B1
@@ -56,6 +67,10 @@ uint8_t EUSCIB1_txBufferSize = 0;
 uint8_t EUSCIB1_rxBuffer[RX_BUFFER_SIZE];
 uint8_t EUSCIB1_rxBufferIndex = 0;
 uint8_t EUSCIB1_rxBufferSize = 0;
+
+IRQParam EUSCIB1_irqParam = { EUSCI_B1_BASE, NULL, STATE_IDLE,
+		EUSCIB1_rxBuffer, &EUSCIB1_rxBufferIndex, &EUSCIB1_rxBufferSize,
+		EUSCIB1_txBuffer, &EUSCIB1_txBufferIndex, &EUSCIB1_txBufferSize };
 #endif
 
 #ifdef USING_EUSCI_B2
@@ -67,6 +82,10 @@ uint8_t EUSCIB2_txBufferSize = 0;
 uint8_t EUSCIB2_rxBuffer[RX_BUFFER_SIZE];
 uint8_t EUSCIB2_rxBufferIndex = 0;
 uint8_t EUSCIB2_rxBufferSize = 0;
+
+IRQParam EUSCIB2_irqParam = { EUSCI_B2_BASE, NULL, STATE_IDLE,
+		EUSCIB2_rxBuffer, &EUSCIB2_rxBufferIndex, &EUSCIB2_rxBufferSize,
+		EUSCIB2_txBuffer, &EUSCIB2_txBufferIndex, &EUSCIB2_txBufferSize };
 #endif
 
 #ifdef USING_EUSCI_B3
@@ -78,7 +97,105 @@ uint8_t EUSCIB3_txBufferSize = 0;
 uint8_t EUSCIB3_rxBuffer[RX_BUFFER_SIZE];
 uint8_t EUSCIB3_rxBufferIndex = 0;
 uint8_t EUSCIB3_rxBufferSize = 0;
+
+IRQParam EUSCIB3_irqParam = { EUSCI_B3_BASE, NULL, STATE_IDLE,
+		EUSCIB3_rxBuffer, &EUSCIB3_rxBufferIndex, &EUSCIB3_rxBufferSize,
+		EUSCIB3_txBuffer, &EUSCIB3_txBufferIndex, &EUSCIB3_txBufferSize };
+#endif
+
+#ifdef DWIRE_DEFERRED
+/**
+ * The callbacks the ISRs leave to DWire::poll()
+ */
+enum {
+	DEFERRED_COMPLETE = 0,  // An asynchronous transfer has finished
+	DEFERRED_RECEIVE,       // A slave has received a message
+	DEFERRED_REQUEST,       // A master waits for a slave's response
+	DEFERRED_PULL,          // A streamed response needs more data
+	DEFERRED_NONE           // Dropped, as its instance was destroyed
+};
+
+/**
+ * A queued callback. The value is the NAK flag, the message length or the
+ * half of the tx buffer to refill
+ */
+typedef struct {
+	DWire * instance;
+	DWireCallback callback;
+	void * context;
+	uint8_t type;
+	uint8_t value;
+} DWireEvent;
+
+// Filled by the ISRs of all modules, emptied by poll()
+DWireEvent deferredQueue[DWIRE_EVENT_QUEUE];
+volatile uint8_t deferredHead = 0;
+volatile uint8_t deferredTail = 0;
+bool deferredPendSV = false;
+
+static void deferredPendSVHandler(void) {
+	DWire::poll();
+}
+#endif
+
+// The modules served by the retry timer
+IRQParam * const retryModules[] = {
+#ifdef USING_EUSCI_B0
+	&EUSCIB0_irqParam,
+#endif
+#ifdef USING_EUSCI_B1
+	&EUSCIB1_irqParam,
+#endif
+#ifdef USING_EUSCI_B2
+	&EUSCIB2_irqParam,
 #endif
+#ifdef USING_EUSCI_B3
+	&EUSCIB3_irqParam,
+#endif
+};
+
+#define RETRY_MODULES (sizeof(retryModules) / sizeof(retryModules[0]))
+
+// Ticks the retry timer was last loaded with, 0 while it is stopped
+uint32_t retryLoaded = 0;
+bool retryTimerReady = false;
+
+/**
+ * Take the time the retry timer has run off the waiting modules, hand the
+ * restarts that are due to the ISRs of their modules and load the timer
+ * with the next one. Must be called with interrupts disabled
+ */
+static void retryUpdate(void) {
+	uint32_t elapsed = 0;
+	if (retryLoaded)
+		elapsed = retryLoaded - MAP_Timer32_getValue(DWIRE_RETRY_TIMER);
+
+	uint32_t next = 0;
+	for (unsigned int i = 0; i < RETRY_MODULES; i++) {
+		IRQParam * param = retryModules[i];
+		if (!param->retryTicks)
+			continue;
+
+		if (param->retryTicks <= elapsed) {
+			param->retryTicks = 0;
+			param->retryDue = true;
+			MAP_Interrupt_pendInterrupt(param->interrupt);
+			continue;
+		}
+
+		param->retryTicks -= elapsed;
+		if (!next || param->retryTicks < next)
+			next = param->retryTicks;
+	}
+
+	MAP_Timer32_haltTimer(DWIRE_RETRY_TIMER);
+	MAP_Timer32_clearInterruptFlag(DWIRE_RETRY_TIMER);
+	retryLoaded = next;
+	if (next) {
+		MAP_Timer32_setCount(DWIRE_RETRY_TIMER, next);
+		MAP_Timer32_startTimer(DWIRE_RETRY_TIMER, true);
+	}
+}
 
 // The default eUSCI settings
 const eUSCI_I2C_MasterConfig i2cConfig = {
@@ -92,9 +209,35 @@ EUSCI_B_I2C_CLOCKSOURCE_SMCLK,                   // SMCLK Clock Source
 /**** CONSTRUCTORS ****/
 
 DWire::DWire( void ) {
+	user_onPull = 0;
+	pIrqParam = NULL;
 }
 
 DWire::~DWire() {
+	// Stop the ISR from serving this instance once it is gone
+	if (pIrqParam && pIrqParam->instance == this) {
+		MAP_I2C_disableInterrupt(module,
+				EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT
+						+ EUSCI_B_I2C_RECEIVE_INTERRUPT0
+						+ EUSCI_B_I2C_STOP_INTERRUPT
+						+ EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT);
+		MAP_Interrupt_disableInterrupt(intModule);
+		pIrqParam->instance = NULL;
+	}
+
+#ifdef DWIRE_DEFERRED
+	// Drop the queued handler calls of this instance
+	bool wasDisabled = MAP_Interrupt_disableMaster();
+	for (uint8_t i = deferredTail; i != deferredHead;
+			i = (i + 1) % DWIRE_EVENT_QUEUE) {
+		if (deferredQueue[i].instance == this
+				&& deferredQueue[i].type != DEFERRED_COMPLETE)
+			deferredQueue[i].type = DEFERRED_NONE;
+	}
+	if (!wasDisabled)
+		MAP_Interrupt_enableMaster();
+#endif
+
 	// Deregister from the moduleMap
 	unregisterModule(this);
 }
@@ -107,7 +250,9 @@ void DWire::begin(uint_fast32_t module) {
 	// Initialising the given module as a master
 	busRole = BUS_ROLE_MASTER;
 	slaveAddress = 0;
-	_initMain();
+	masterConfig = &i2cConfig;
+	if (!_initMain())
+		return;
 
 	_initMaster(&i2cConfig);
 }
@@ -119,7 +264,8 @@ void DWire::begin(uint_fast32_t module, uint8_t address) {
 	busRole = BUS_ROLE_SLAVE;
 	slaveAddress = address;
 
-	_initMain();
+	if (!_initMain())
+		return;
 
 	_initSlave();
 }
@@ -132,9 +278,12 @@ void DWire::beginTransmission(uint_fast8_t slaveAddress) {
 	if (busRole != BUS_ROLE_MASTER)
 		return;
 
+	// Hold the bus until the transmission (or the read following it) ends
+	_lockTransmission();
+
 	// Wait in case a previous message is still being sent
-	while ( MAP_I2C_masterIsStopSent(module) == EUSCI_B_I2C_SENDING_STOP)
-		;
+	while (isBusy())
+		_waitEvent();
 
 	if (slaveAddress != this->slaveAddress)
 		_setSlaveAddress(slaveAddress);
@@ -146,7 +295,7 @@ void DWire::beginTransmission(uint_fast8_t slaveAddress) {
 void DWire::write(uint8_t dataByte) {
 	// Add data to the tx buffer
 	pTxBuffer[*pTxBufferIndex] = dataByte;
-	(*pTxBufferIndex)++;
+	*pTxBufferIndex = *pTxBufferIndex + 1;
 }
 
 void DWire::endTransmission(void) {
@@ -157,6 +306,22 @@ void DWire::endTransmission(void) {
  * End the transmission and transmit the tx buffer's contents over the bus
  */
 void DWire::endTransmission(bool sendStop) {
+	_usePolicy(NULL);
+	_transmit(sendStop);
+
+#ifdef DWIRE_RTOS
+	// Block until the STOP, so that the bus can be handed to another task
+	if (sendStop) {
+		_waitWhile(STATE_MASTER_TX);
+		_unlockTransmission();
+	}
+#endif
+}
+
+/**
+ * Start sending the tx buffer's contents
+ */
+void DWire::_transmit(bool sendStop) {
 
 	if (!*pTxBufferIndex) {
 		return;
@@ -167,13 +332,13 @@ void DWire::endTransmission(bool sendStop) {
 	//    ;
 
 	this->sendStop = sendStop;
+	gotNAK = false;
+	_beginAttempts();
+	pIrqParam->state = STATE_MASTER_TX;
 
 	// Send the start condition and initial byte
 	(*pTxBufferSize) = *pTxBufferIndex;
-	(*pTxBufferIndex)--;
-
-	// Send the first byte, triggering the TX interrupt
-	MAP_I2C_masterSendMultiByteStart(module, pTxBuffer[0]);
+	_sendStart();
 }
 
 /**
@@ -184,42 +349,45 @@ uint8_t DWire::requestFrom(uint_fast8_t slaveAddress, uint_fast8_t numBytes) {
 	if (busRole != BUS_ROLE_MASTER)
 		return 0;
 
-	if (*pTxBufferIndex > 0) {
-		endTransmission(false);
-	}
-
-	while (!sendStop)
-		;
+	lock();
+	uint8_t length = _requestFrom(slaveAddress, numBytes);
+	unlock();
 
-	// Re-initialise the rx buffer
-	*pRxBufferSize = numBytes;
-	*pRxBufferIndex = 0;
+	// Also release the bus held since beginTransmission()
+	_unlockTransmission();
+	return length;
+}
 
-	// Configure the correct slave
-	MAP_I2C_setSlaveAddress(module, slaveAddress);
-	this->slaveAddress = slaveAddress;
+uint8_t DWire::_requestFrom(uint_fast8_t slaveAddress, uint_fast8_t numBytes) {
+	// Wait for any asynchronous transfer to finish
+	while (transferActive)
+		_waitEvent();
 
-	MAP_I2C_disableInterrupt(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+	_usePolicy(NULL);
+	bool writing = *pTxBufferIndex > 0;
+	if (writing) {
+		_transmit(false);
+	} else {
+		// The PEC covers only the read
+		pecBase = 0;
+	}
 
-	// Set the master into receive mode
-	MAP_I2C_setMode(module, EUSCI_B_I2C_RECEIVE_MODE);
+	// Wait for the write phase (if any) to finish
+	_waitWhile(STATE_MASTER_TX);
 
-	// Send the START
-	MAP_I2C_masterReceiveStart(module);
+	// A NAK of an earlier transfer does not concern this one
+	if (writing && gotNAK)
+		return 0;
 
-	// Send a stop early if we're only requesting one byte
-	// to prevent timing issues
-	if (numBytes == 1) {
-		MAP_I2C_masterReceiveMultiByteStop(module);
-	}
+	// Configure the correct slave
+	if (slaveAddress != this->slaveAddress)
+		_setSlaveAddress(slaveAddress);
 
-	// Initialize the flag showing the status of the request
-	requestDone = false;
-	gotNAK = false;
+	_beginAttempts();
+	_startReceive(numBytes, STATE_MASTER_RX);
 
 	// Wait until the request is done
-	while (!requestDone)
-		;
+	_waitWhile(STATE_MASTER_RX);
 
 	MAP_I2C_setMode(module, EUSCI_B_I2C_TRANSMIT_MODE);
 
@@ -237,6 +405,229 @@ uint8_t DWire::requestFrom(uint_fast8_t slaveAddress, uint_fast8_t numBytes) {
 	}
 }
 
+/**
+ * Perform an SMBus block read: the first byte received gives the number of
+ * bytes that follow (plus the PEC, if enabled). Like requestFrom(), a
+ * pending write is sent first with a repeated start. Returns the number of
+ * bytes available to read(), including the count byte
+ */
+uint8_t DWire::requestBlock(uint_fast8_t slaveAddress) {
+	pIrqParam->blockRead = true;
+	uint8_t length = requestFrom(slaveAddress, RX_BUFFER_SIZE);
+	pIrqParam->blockRead = false;
+	return length;
+}
+
+/**
+ * Returns true if the slave did not acknowledge the last transfer
+ */
+bool DWire::hasFailed(void) {
+	return gotNAK;
+}
+
+/**
+ * Enable or disable the SMBus packet error code for the next transaction,
+ * up to its STOP; it is switched off again when the transaction ends. When
+ * enabled, the ISR updates a CRC-8 with every byte on the bus (including
+ * the address bytes) and appends it to writes that end with a STOP. Reads
+ * must request one extra byte for the PEC sent by the slave
+ */
+void DWire::setPEC(bool enabled) {
+	pIrqParam->pecEnabled = enabled;
+}
+
+/**
+ * Returns true if the PEC received at the end of the last read matched
+ */
+bool DWire::isPECValid(void) {
+	return pIrqParam->pec == 0;
+}
+
+/**
+ * Start a transfer without waiting for it to finish. The contents of txData
+ * (if any) are written first, followed by a repeated start and a read of
+ * rxLength bytes into rxData. The callback is invoked from the ISR once the
+ * transfer has finished. Returns false if the bus is busy.
+ */
+bool DWire::startTransfer(uint_fast8_t slaveAddress, const uint8_t * txData,
+		uint8_t txLength, uint8_t * rxData, uint8_t rxLength,
+		DWireCallback callback, void * context) {
+	return startTransfer(slaveAddress, txData, txLength, rxData, rxLength,
+			callback, context, NULL);
+}
+
+/**
+ * As above, with the NAK retry policy of this transfer only. NULL selects
+ * the one set with setNAKRetry()
+ */
+bool DWire::startTransfer(uint_fast8_t slaveAddress, const uint8_t * txData,
+		uint8_t txLength, uint8_t * rxData, uint8_t rxLength,
+		DWireCallback callback, void * context, const DWireNAKPolicy * policy) {
+
+	if (busRole != BUS_ROLE_MASTER)
+		return false;
+
+	if (txLength > TX_BUFFER_SIZE || rxLength > RX_BUFFER_SIZE
+			|| (txLength == 0 && rxLength == 0))
+		return false;
+
+	if (!_claimBus())
+		return false;
+
+	_usePolicy(policy);
+	transferRxBuffer = rxData;
+	transferRxLength = rxLength;
+	streamLength = 0;
+	pecBase = 0;
+	transferCallback = callback;
+	transferContext = context;
+
+	if (slaveAddress != this->slaveAddress)
+		_setSlaveAddress(slaveAddress);
+
+	if (txLength) {
+		for (int i = 0; i < txLength; i++)
+			pTxBuffer[i] = txData[i];
+		*pTxBufferIndex = txLength;
+
+		// The ISR continues with the read (if any) after the last byte
+		_transmit(rxLength == 0);
+	} else {
+		_beginAttempts();
+		_startReceive(rxLength, STATE_MASTER_RX);
+	}
+	return true;
+}
+
+/**
+ * Start a read of any length without waiting for it to finish. The contents
+ * of txData (if any) are written first, followed by a repeated start. The
+ * received data is passed to sink from the ISR in chunks of up to
+ * RX_BUFFER_SIZE bytes while the transfer continues, so no buffer for the
+ * full length is needed. callback is invoked at the end
+ */
+bool DWire::startStreamRead(uint_fast8_t slaveAddress, const uint8_t * txData,
+		uint8_t txLength, uint32_t length, DWireSink sink,
+		DWireCallback callback, void * context) {
+	return startStreamRead(slaveAddress, txData, txLength, length, sink,
+			callback, context, NULL);
+}
+
+/**
+ * As above, with the NAK retry policy of this read only. NULL selects the
+ * one set with setNAKRetry()
+ */
+bool DWire::startStreamRead(uint_fast8_t slaveAddress, const uint8_t * txData,
+		uint8_t txLength, uint32_t length, DWireSink sink,
+		DWireCallback callback, void * context,
+		const DWireNAKPolicy * policy) {
+
+	if (busRole != BUS_ROLE_MASTER)
+		return false;
+
+	if (txLength > TX_BUFFER_SIZE || length == 0 || !sink)
+		return false;
+
+	if (!_claimBus())
+		return false;
+
+	_usePolicy(policy);
+	transferRxLength = 0;
+	transferCallback = callback;
+	transferContext = context;
+	streamLength = length;
+	streamSink = sink;
+	pecBase = 0;
+
+	if (slaveAddress != this->slaveAddress)
+		_setSlaveAddress(slaveAddress);
+
+	if (txLength) {
+		for (int i = 0; i < txLength; i++)
+			pTxBuffer[i] = txData[i];
+		*pTxBufferIndex = txLength;
+
+		// The ISR starts the stream after the last byte
+		_transmit(false);
+	} else {
+		_beginAttempts();
+		_startStream();
+	}
+	return true;
+}
+
+/**
+ * Returns true while an asynchronous transfer or a STOP is still pending
+ */
+bool DWire::isBusy(void) {
+	if (transferActive)
+		return true;
+	if (pIrqParam->state != STATE_IDLE)
+		return true;
+	return MAP_I2C_masterIsStopSent(module) == EUSCI_B_I2C_SENDING_STOP;
+}
+
+/**
+ * Start probing every address between SCAN_FIRST_ADDRESS and
+ * SCAN_LAST_ADDRESS without waiting. Each address is probed with an
+ * address-only frame from the ISR; the result is written to bitmap, which
+ * must be SCAN_BITMAP_SIZE bytes. Returns false if the bus is busy.
+ */
+bool DWire::startScan(uint8_t * bitmap) {
+	if (busRole != BUS_ROLE_MASTER)
+		return false;
+
+	if (!_claimBus())
+		return false;
+
+	for (int i = 0; i < SCAN_BITMAP_SIZE; i++)
+		bitmap[i] = 0;
+
+	scanBitmap = bitmap;
+	scanAddress = SCAN_FIRST_ADDRESS;
+	_usePolicy(NULL);
+	_beginAttempts();
+	pIrqParam->state = STATE_SCAN;
+
+	// The STOP interrupt moves the scan on to the next address
+	MAP_I2C_clearInterruptFlag(module, EUSCI_B_I2C_STOP_INTERRUPT);
+	MAP_I2C_enableInterrupt(module, EUSCI_B_I2C_STOP_INTERRUPT);
+
+	_probe();
+	return true;
+}
+
+/**
+ * Scan the bus and wait for the result
+ */
+bool DWire::scan(uint8_t * bitmap) {
+	if (!startScan(bitmap))
+		return false;
+
+	_waitWhile(STATE_SCAN);
+
+	return true;
+}
+
+/**
+ * Scan several buses in parallel and wait until all of them are done
+ */
+void DWire::scanAll(DWire ** buses, uint_fast8_t count,
+		uint8_t (*bitmaps)[SCAN_BITMAP_SIZE]) {
+	for (int i = 0; i < count; i++)
+		buses[i]->startScan(bitmaps[i]);
+
+	for (int i = 0; i < count; i++)
+		buses[i]->_waitWhile(STATE_SCAN);
+}
+
+/**
+ * Returns true if address was marked as present in a scan bitmap
+ */
+bool DWire::isPresent(const uint8_t * bitmap, uint_fast8_t address) {
+	return (bitmap[address >> 3] >> (address & 0x07)) & 0x01;
+}
+
 /**
  * Reads a single byte from the rx buffer
  */
@@ -244,10 +635,10 @@ uint8_t DWire::read(void) {
 
 	// Wait if there is nothing to read
 	while (rxReadIndex == 0 && rxReadLength == 0)
-		;
+		_waitEvent();
 
 	uint8_t byte = rxLocalBuffer[rxReadIndex];
-	rxReadIndex++;
+	rxReadIndex = rxReadIndex + 1;
 
 	// Check whether this was the last byte. If so, reset.
 	if (rxReadIndex == rxReadLength) {
@@ -272,6 +663,103 @@ void DWire::onReceive(void (*islHandle)(uint8_t)) {
 	user_onReceive = islHandle;
 }
 
+/**
+ * Stream every response from source instead of calling the onRequest
+ * handler. The tx buffer is split in two halves: while the master reads
+ * one, source refills the other, so a response can be of any length.
+ * Once source returns fewer bytes than asked for, 0xFF is sent. Data that
+ * was fetched but not read before the STOP is dropped
+ */
+void DWire::onPull(DWireSource source, void * context) {
+	pullContext = context;
+	user_onPull = source;
+}
+
+#ifdef DWIRE_DEFERRED
+/**
+ * Run the callbacks queued by the ISRs: transfer completions and the
+ * onReceive/onRequest handlers. Call it from the main loop, or let PendSV
+ * call it with usePendSV(). A slave holds SCL low until its onRequest
+ * handler has run, so poll often enough for the master
+ */
+void DWire::poll(void) {
+	while (deferredTail != deferredHead) {
+		// Dequeue first: a callback may wait for a transfer, polling again
+		DWireEvent event = deferredQueue[deferredTail];
+		deferredTail = (deferredTail + 1) % DWIRE_EVENT_QUEUE;
+
+		switch (event.type) {
+		case DEFERRED_COMPLETE:
+			event.callback(event.context, event.value);
+			break;
+		case DEFERRED_RECEIVE:
+			event.instance->user_onReceive(event.value);
+			event.instance->receivePending = false;
+			break;
+		case DEFERRED_REQUEST:
+			event.instance->_respond();
+			break;
+		case DEFERRED_PULL:
+			event.instance->_refill(event.value);
+			break;
+		}
+	}
+}
+
+/**
+ * Run the queued callbacks from PendSV, at the lowest interrupt priority,
+ * instead of from poll(). PendSV must not be used otherwise, as an RTOS
+ * usually does
+ */
+void DWire::usePendSV(void) {
+	MAP_Interrupt_registerInterrupt(FAULT_PENDSV, deferredPendSVHandler);
+	MAP_Interrupt_setPriority(FAULT_PENDSV, 0xE0);
+	deferredPendSV = true;
+}
+#endif
+
+/**
+ * Sleep as a slave. The CPU stays in the low-power mode DWIRE_SLAVE_LPM
+ * and only runs the ISR: the own address wakes it up, the transaction is
+ * served (including the onReceive/onRequest handlers) and it goes back to
+ * sleep on the ISR exit. Returns once a handler has called wake(). With
+ * DWIRE_DEFERRED and without usePendSV(), the ISR wakes the CPU for each
+ * queued event and sleep() runs poll()
+ */
+void DWire::sleep(void) {
+	if (busRole != BUS_ROLE_SLAVE)
+		return;
+
+	// Interrupts are held off between the check and going to sleep; a
+	// pending interrupt still ends the sleep
+	MAP_Interrupt_disableMaster();
+	wakeRequested = false;
+	while (!wakeRequested) {
+#ifdef DWIRE_DEFERRED
+		if (!deferredPendSV && deferredTail != deferredHead) {
+			MAP_Interrupt_enableMaster();
+			poll();
+			MAP_Interrupt_disableMaster();
+			continue;
+		}
+#endif
+		MAP_Interrupt_enableSleepOnIsrExit();
+		DWIRE_SLAVE_SLEEP();
+		MAP_Interrupt_enableMaster();
+		MAP_Interrupt_disableMaster();
+	}
+	MAP_Interrupt_enableMaster();
+}
+
+/**
+ * Make sleep() return after the current interrupt. Call it from an
+ * interrupt handler, e.g. onReceive
+ */
+void DWire::wake(void) {
+	wakeRequested = true;
+	MAP_Interrupt_disableSleepOnIsrExit();
+}
+
 /**
  * Returns true if the module is configured as a master
  */
@@ -283,53 +771,185 @@ bool DWire::isMaster(void) {
 	}
 }
 
-/**** PRIVATE METHODS ****/
+/**
+ * Configure how often a transfer is retried after losing arbitration, and
+ * the maximum random delay in microseconds before each retry
+ */
+void DWire::setArbitrationRetry(uint8_t retries, uint16_t backoff) {
+	maxRetries = retries;
+	maxBackoff = backoff;
+}
 
 /**
- * The main initialisation method to setup pins and interrupts
+ * Configure how many times a transfer is attempted while the slave does not
+ * acknowledge, e.g. to poll an EEPROM until its write cycle has finished.
+ * With an interval of 0 the START is repeated immediately; otherwise a STOP
+ * is sent and the retry timer waits interval microseconds before the next
+ * START. Applies to the transfers started afterwards, unless they bring
+ * their own policy (see startTransfer()). One attempt disables retries
  */
-void DWire::_initMain( void ) {
+void DWire::setNAKRetry(uint16_t attempts, uint16_t interval) {
+	nakDefault.attempts = attempts ? attempts : 1;
+	nakDefault.interval = interval;
+}
 
-	// Initialise the receiver buffer and related variables
-	rxReadIndex = 0;
-	rxReadLength = 0;
+/**
+ * Change the SCL frequency (in Hz, e.g. EUSCI_B_I2C_SET_DATA_RATE_100KBPS).
+ * The module is only re-initialised if the rate differs from the current
+ * one. Returns false if the bus is busy
+ */
+bool DWire::setSpeed(uint32_t dataRate) {
+	if (busRole != BUS_ROLE_MASTER)
+		return false;
 
-	requestDone = false;
-	sendStop = true;
+	if (masterConfig->dataRate == dataRate)
+		return true;
 
-	switch (module) {
-#ifdef USING_EUSCI_B0
-	case EUSCI_B0_BASE:
-		pTxBuffer = EUSCIB0_txBuffer;
-		pTxBufferIndex = &EUSCIB0_txBufferIndex;
-		pTxBufferSize = &EUSCIB0_txBufferSize;
+	if (!_claimBus())
+		return false;
 
-		pRxBuffer = EUSCIB0_rxBuffer;
-		pRxBufferIndex = &EUSCIB0_rxBufferIndex;
-		pRxBufferSize = &EUSCIB0_rxBufferSize;
+	speedConfig = *masterConfig;
+	speedConfig.dataRate = dataRate;
+	masterConfig = &speedConfig;
+	_resetMaster();
 
-		modulePort = EUSCI_B0_PORT;
-		modulePins = EUSCI_B0_PINS;
+	transferActive = false;
+	return true;
+}
 
-		intModule = INT_EUSCIB0;
+/**
+ * Returns the current SCL frequency in Hz, or 0 for a slave, as the master
+ * sets the clock
+ */
+uint32_t DWire::getSpeed(void) {
+	if (busRole != BUS_ROLE_MASTER)
+		return 0;
+	return masterConfig->dataRate;
+}
 
-		MAP_I2C_registerInterrupt(module, EUSCIB0_IRQHandler);
-		break;
+/**
+ * Take the bus for a sequence of transfers by the calling task. Only needed
+ * with an RTOS, and only around asynchronous transfers or sequences that
+ * must not be interleaved; the blocking calls lock the bus themselves.
+ * Calls may be nested. Without an RTOS this does nothing
+ */
+void DWire::lock(void) {
+#ifdef DWIRE_RTOS
+	rtosMutexLock(&busMutex);
 #endif
-#ifdef USING_EUSCI_B1
-	case EUSCI_B1_BASE:
-		pTxBuffer = EUSCIB1_txBuffer;
-		pTxBufferIndex = &EUSCIB1_txBufferIndex;
-		pTxBufferSize = &EUSCIB1_txBufferSize;
+}
 
-		pRxBuffer = EUSCIB1_rxBuffer;
-		pRxBufferIndex = &EUSCIB1_rxBufferIndex;
-		pRxBufferSize = &EUSCIB1_rxBufferSize;
+/**
+ * Release the bus taken with lock()
+ */
+void DWire::unlock(void) {
+#ifdef DWIRE_RTOS
+	rtosMutexUnlock(&busMutex);
+#endif
+}
+
+/**
+ * Returns the counters of this module
+ */
+const DWireStats * DWire::getStats(void) {
+	return &stats;
+}
+
+#ifdef DWIRE_PROFILE
+/**
+ * Returns the number of CPU cycles spent in the ISR since the last reset
+ */
+uint32_t DWire::getIrqCycles(void) {
+	return pIrqParam->irqCycles;
+}
+
+/**
+ * Returns the number of interrupt events (bytes, NAKs, STOPs) handled
+ * since the last reset
+ */
+uint32_t DWire::getIrqEvents(void) {
+	return pIrqParam->irqEvents;
+}
+
+void DWire::resetProfile(void) {
+	pIrqParam->irqCycles = 0;
+	pIrqParam->irqEvents = 0;
+}
+#endif
+
+/**** PRIVATE METHODS ****/
+
+/**
+ * The main initialisation method to setup pins and interrupts. Returns
+ * false if the module is not enabled in this build
+ */
+bool DWire::_initMain( void ) {
+
+	// Initialise the receiver buffer and related variables
+	rxReadIndex = 0;
+	rxReadLength = 0;
+
+	sendStop = true;
+	gotNAK = false;
+
+	transferActive = false;
+	transferCallback = 0;
+	streamLength = 0;
+	readAfterWrite = false;
+	rewriting = false;
+#ifdef DWIRE_DEFERRED
+	receivePending = false;
+#endif
+	pullPending = 0;
+	pullStalled = false;
+
+	maxRetries = ARBITRATION_RETRIES;
+	maxBackoff = ARBITRATION_BACKOFF;
+	nakDefault.attempts = 1;
+	nakDefault.interval = 0;
+	nakPolicy = nakDefault;
+	backoffSeed = module;
+	cyclesPerUs = MAP_CS_getMCLK() / 1000000;
+	stats.arbitrationLost = 0;
+	stats.arbitrationRetries = 0;
+	stats.nakRetries = 0;
+	stats.eventOverflows = 0;
+
+	switch (module) {
+#ifdef USING_EUSCI_B0
+	case EUSCI_B0_BASE:
+		pTxBuffer = EUSCIB0_txBuffer;
+		pTxBufferIndex = &EUSCIB0_txBufferIndex;
+		pTxBufferSize = &EUSCIB0_txBufferSize;
+
+		pRxBuffer = EUSCIB0_rxBuffer;
+		pRxBufferIndex = &EUSCIB0_rxBufferIndex;
+		pRxBufferSize = &EUSCIB0_rxBufferSize;
+
+		modulePort = EUSCI_B0_PORT;
+		modulePins = EUSCI_B0_PINS;
+
+		intModule = INT_EUSCIB0;
+		pIrqParam = &EUSCIB0_irqParam;
+
+		MAP_I2C_registerInterrupt(module, EUSCIB0_IRQHandler);
+		break;
+#endif
+#ifdef USING_EUSCI_B1
+	case EUSCI_B1_BASE:
+		pTxBuffer = EUSCIB1_txBuffer;
+		pTxBufferIndex = &EUSCIB1_txBufferIndex;
+		pTxBufferSize = &EUSCIB1_txBufferSize;
+
+		pRxBuffer = EUSCIB1_rxBuffer;
+		pRxBufferIndex = &EUSCIB1_rxBufferIndex;
+		pRxBufferSize = &EUSCIB1_rxBufferSize;
 
 		modulePort = EUSCI_B1_PORT;
 		modulePins = EUSCI_B1_PINS;
 
 		intModule = INT_EUSCIB1;
+		pIrqParam = &EUSCIB1_irqParam;
 
 		MAP_I2C_registerInterrupt(module, EUSCIB1_IRQHandler);
 		break;
@@ -348,6 +968,7 @@ void DWire::_initMain( void ) {
 		modulePins = EUSCI_B2_PINS;
 
 		intModule = INT_EUSCIB2;
+		pIrqParam = &EUSCIB2_irqParam;
 
 		MAP_I2C_registerInterrupt(module, EUSCIB2_IRQHandler);
 		break;
@@ -366,16 +987,34 @@ void DWire::_initMain( void ) {
 		modulePins = EUSCI_B3_PINS;
 
 		intModule = INT_EUSCIB3;
+		pIrqParam = &EUSCIB3_irqParam;
 
 		MAP_I2C_registerInterrupt(module, EUSCIB3_IRQHandler);
 		break;
 #endif
 	default:
-		return;
+		return false;
 	}
 
 	// Register this instance in the 'moduleMap'
 	registerModule(this);
+
+#ifdef DWIRE_PROFILE
+	// Enable the cycle counter
+	DWIRE_CYCLES_ENABLE();
+#endif
+
+#ifdef DWIRE_RTOS
+	rtosMutexInit(&busMutex);
+	rtosSemInit(&pIrqParam->stateChanged);
+	txLocked = false;
+#endif
+
+	// The ISR only serves the instance that registered first
+	pIrqParam->instance = getInstance(module);
+	pIrqParam->interrupt = intModule;
+	pIrqParam->state = isMaster() ? STATE_IDLE : STATE_SLAVE_IDLE;
+	return true;
 }
 
 
@@ -388,8 +1027,31 @@ void DWire::_initMaster(const eUSCI_I2C_MasterConfig * i2cConfig) {
 	MAP_GPIO_setAsPeripheralModuleFunctionInputPin(modulePort, modulePins,
 	GPIO_PRIMARY_MODULE_FUNCTION);
 
+	_resetMaster();
+
+	// The retry timer is shared by all modules
+	if (!retryTimerReady) {
+		MAP_Timer32_initModule(DWIRE_RETRY_TIMER, TIMER32_PRESCALER_1,
+				TIMER32_32BIT, TIMER32_PERIODIC_MODE);
+		MAP_Timer32_registerInterrupt(DWIRE_RETRY_INTERRUPT,
+				DWIRE_RETRY_HANDLER);
+		MAP_Timer32_enableInterrupt(DWIRE_RETRY_TIMER);
+		retryTimerReady = true;
+	}
+
+	// Register the interrupts on the correct module
+	MAP_Interrupt_enableInterrupt(intModule);
+	MAP_Interrupt_enableMaster();
+}
+
+/**
+ * (Re-)initialise the eUSCI module as a master. Also used to take back the
+ * master role after losing arbitration
+ */
+void DWire::_resetMaster(void) {
+
 	// Initializing I2C Master to SMCLK at 400kbs with no autostop
-	MAP_I2C_initMaster(module, i2cConfig);
+	MAP_I2C_initMaster(module, masterConfig);
 
 	// Specify slave address
 	MAP_I2C_setSlaveAddress(module, slaveAddress);
@@ -403,16 +1065,14 @@ void DWire::_initMaster(const eUSCI_I2C_MasterConfig * i2cConfig) {
 	// Enable and clear the interrupt flag
 	MAP_I2C_clearInterruptFlag(module,
 			EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT
-					+ EUSCI_B_I2C_RECEIVE_INTERRUPT0);
+					+ EUSCI_B_I2C_RECEIVE_INTERRUPT0
+					+ EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT);
 
 	// Enable master interrupts
 	MAP_I2C_enableInterrupt(module,
 			EUSCI_B_I2C_TRANSMIT_INTERRUPT0 + EUSCI_B_I2C_NAK_INTERRUPT
-					+ EUSCI_B_I2C_RECEIVE_INTERRUPT0);
-
-	// Register the interrupts on the correct module
-	MAP_Interrupt_enableInterrupt(intModule);
-	MAP_Interrupt_enableMaster();
+					+ EUSCI_B_I2C_RECEIVE_INTERRUPT0
+					+ EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT);
 }
 
 void DWire::_initSlave(void) {
@@ -435,7 +1095,10 @@ void DWire::_initSlave(void) {
 	MAP_I2C_enableInterrupt(module,
 			EUSCI_B_I2C_RECEIVE_INTERRUPT0 | EUSCI_B_I2C_STOP_INTERRUPT
 					| EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
-	//MAP_Interrupt_enableSleepOnIsrExit();
+#ifdef DWIRE_WAKE_PORT
+	MAP_GPIO_setOutputLowOnPin(DWIRE_WAKE_PORT, DWIRE_WAKE_PIN);
+	MAP_GPIO_setAsOutputPin(DWIRE_WAKE_PORT, DWIRE_WAKE_PIN);
+#endif
 	MAP_Interrupt_enableInterrupt(intModule);
 	MAP_Interrupt_enableMaster();
 }
@@ -448,16 +1111,190 @@ void DWire::_setSlaveAddress(uint_fast8_t newAddress) {
 	MAP_I2C_setSlaveAddress(module, newAddress);
 }
 
+/**
+ * Wait until the module leaves the given state, including any retries
+ * after a lost arbitration and a write resent before retrying a read
+ */
+void DWire::_waitWhile(uint8_t state) {
+	uint8_t current;
+	while ((current = pIrqParam->state) == state
+			|| ((current == STATE_ARBITRATION || current == STATE_NAK_RETRY
+					|| current == STATE_RETRY_WAIT || rewriting)
+					&& resumeState == state))
+		_waitEvent();
+}
+
+/**
+ * Wait for the ISR to make progress. With an RTOS the calling task blocks
+ * until the state changes (or for about a millisecond); otherwise this
+ * returns immediately and the caller spins
+ */
+void DWire::_waitEvent(void) {
+#ifdef DWIRE_RTOS
+	rtosSemWait(&pIrqParam->stateChanged);
+#elif defined(DWIRE_DEFERRED)
+	// The awaited completion may be one of the queued callbacks
+	if (!deferredPendSV)
+		poll();
+#endif
+}
+
+/**
+ * Take the bus mutex for a beginTransmission() sequence, unless the
+ * calling task holds it for one already
+ */
+void DWire::_lockTransmission(void) {
+#ifdef DWIRE_RTOS
+	rtosMutexLock(&busMutex);
+	if (txLocked)
+		rtosMutexUnlock(&busMutex);
+	else
+		txLocked = true;
+#endif
+}
+
+/**
+ * Release the bus mutex taken by _lockTransmission(), if any
+ */
+void DWire::_unlockTransmission(void) {
+#ifdef DWIRE_RTOS
+	if (txLocked) {
+		txLocked = false;
+		rtosMutexUnlock(&busMutex);
+	}
+#endif
+}
+
+/**
+ * Take the NAK retry policy of a new transfer, or the default if NULL. It
+ * holds until the transfer ends, whatever setNAKRetry() is called with
+ */
+void DWire::_usePolicy(const DWireNAKPolicy * policy) {
+	nakPolicy = policy ? *policy : nakDefault;
+	if (!nakPolicy.attempts)
+		nakPolicy.attempts = 1;
+}
+
+/**
+ * Reset the retry budgets at the start of a transfer phase
+ */
+void DWire::_beginAttempts(void) {
+	retriesLeft = maxRetries;
+	nakAttemptsLeft = nakPolicy.attempts;
+}
+
+/**
+ * Mark the bus as taken by an asynchronous operation. This is done
+ * atomically, as transfers may be started from other ISRs
+ */
+bool DWire::_claimBus(void) {
+	bool wasDisabled = MAP_Interrupt_disableMaster();
+	bool busy = transferActive || pIrqParam->state != STATE_IDLE
+			|| *pTxBufferIndex;
+	if (!busy)
+		transferActive = true;
+	if (!wasDisabled)
+		MAP_Interrupt_enableMaster();
+
+	if (busy)
+		return false;
+
+	// The STOP of the previous transfer may still be on its way. This only
+	// takes a bit time, and lets completion callbacks chain the next transfer
+	while (MAP_I2C_masterIsStopSent(module) == EUSCI_B_I2C_SENDING_STOP)
+		;
+
+	return true;
+}
+
+/**
+ * Send an address-only frame to the current scan address
+ */
+void DWire::_probe(void) {
+	_setSlaveAddress(scanAddress);
+	scanNAK = false;
+	MAP_I2C_masterSendStart(module);
+}
+
+/**
+ * Set the module in receive mode and send a (repeated) START. The given
+ * state decides how the ISR handles the received bytes
+ */
+void DWire::_startReceive(uint8_t numBytes, uint8_t state) {
+	// Re-initialise the rx buffer
+	*pRxBufferSize = numBytes;
+	*pRxBufferIndex = 0;
+
+	// Initialize the flag showing the status of the request
+	gotNAK = false;
+	pIrqParam->state = state;
+
+	// The read address continues the PEC of the write phase, if any
+	if (pIrqParam->pecEnabled)
+		pIrqParam->pec = crc8Table[pecBase ^ ((slaveAddress << 1) | 0x01)];
+
+	MAP_I2C_disableInterrupt(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+
+	// Set the master into receive mode
+	MAP_I2C_setMode(module, EUSCI_B_I2C_RECEIVE_MODE);
+
+	// Send the START
+	MAP_I2C_masterReceiveStart(module);
+
+	// Send a stop early if we're only requesting one byte
+	// to prevent timing issues
+	if (numBytes == 1) {
+		MAP_I2C_masterReceiveMultiByteStop(module);
+	}
+}
+
+/**
+ * Send the START and the first byte of the tx buffer. The ISR sends the rest
+ */
+void DWire::_sendStart(void) {
+	*pTxBufferIndex = *pTxBufferSize - 1;
+
+	if (pIrqParam->pecEnabled) {
+		pecSent = false;
+		pIrqParam->pec = crc8Table[crc8Table[slaveAddress << 1] ^ pTxBuffer[0]];
+	}
+
+	// Send the first byte, triggering the TX interrupt
+	MAP_I2C_masterSendMultiByteStart(module, pTxBuffer[0]);
+}
+
+/**
+ * Start the read phase of a streaming read. The rx buffer holds one chunk
+ */
+void DWire::_startStream(void) {
+	streamRemaining = streamLength;
+	_startReceive(streamLength == 1 ? 1 : RX_BUFFER_SIZE, STATE_MASTER_STREAM);
+	*pRxBufferSize = RX_BUFFER_SIZE;
+}
+
 /**
  * Handle a request ISL as a slave
  */
-void DWire::_handleRequestSlave(void) {
+DWIRE_RAMFUNC void DWire::_handleRequestSlave(void) {
+	if (user_onPull) {
+		_pullNext();
+		return;
+	}
+
 	// Check whether a user interrupt has been set
 	if (!user_onRequest)
 		return;
 
 	// If no message has been set, then call the user interrupt to set
 	if (!(*pTxBufferIndex)) {
+#ifdef DWIRE_DEFERRED
+		// Hold SCL low until poll() has the response; _respond() sends
+		// the first byte and re-enables the interrupt
+		MAP_I2C_disableInterrupt(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+		if (_queueEvent(DEFERRED_REQUEST, 0))
+			return;
+		MAP_I2C_enableInterrupt(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+#endif
 		user_onRequest();
 
 		*pTxBufferSize = *pTxBufferIndex;
@@ -470,9 +1307,97 @@ void DWire::_handleRequestSlave(void) {
 		*pTxBufferSize = 0;
 	} else {
 		// Transmit a byte
-		MAP_I2C_slavePutData(module, pTxBuffer[*pTxBufferIndex]);
-		(*pTxBufferIndex)++;
+		ISR_SLAVE_PUT(module, pTxBuffer[*pTxBufferIndex]);
+		*pTxBufferIndex = *pTxBufferIndex + 1;
+	}
+}
+
+/**
+ * Send the next byte of a streamed response. A new request first fills
+ * both halves of the tx buffer; each time the master has read a half, it
+ * is refilled while the master reads the other
+ */
+DWIRE_RAMFUNC void DWire::_pullNext(void) {
+	if (!*pTxBufferSize) {
+		*pTxBufferSize = 1;
+		*pTxBufferIndex = 0;
+		pullEnded = false;
+		pullPending = 0x03;
+		_requestRefill(PULL_BOTH);
+	}
+
+	uint8_t index = *pTxBufferIndex;
+	uint8_t half = index / PULL_HALF;
+
+#ifdef DWIRE_DEFERRED
+	// Hold SCL low until poll() has filled this half
+	if (pullPending & (1 << half)) {
+		pullStalled = true;
+		MAP_I2C_disableInterrupt(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+		return;
+	}
+#endif
+
+	if (index % PULL_HALF < pullLength[half])
+		ISR_SLAVE_PUT(module, pTxBuffer[index]);
+	else
+		ISR_SLAVE_PUT(module, 0xFF);
+
+	index++;
+	if (index == 2 * PULL_HALF)
+		index = 0;
+	*pTxBufferIndex = index;
+
+	if (index % PULL_HALF == 0) {
+		pullPending = pullPending | (1 << half);
+		_requestRefill(half);
+	}
+}
+
+/**
+ * Have the source refill a half of the tx buffer, or both
+ */
+void DWire::_requestRefill(uint8_t half) {
+#ifdef DWIRE_DEFERRED
+	if (_queueEvent(DEFERRED_PULL, half))
+		return;
+#endif
+	_refill(half);
+}
+
+void DWire::_refill(uint8_t half) {
+	if (half == PULL_BOTH) {
+		_refill(0);
+		_refill(1);
+		return;
 	}
+
+	if (pullEnded) {
+		pullLength[half] = 0;
+	} else {
+		pullLength[half] = user_onPull(pullContext,
+				&pTxBuffer[half * PULL_HALF], PULL_HALF);
+		pullEnded = pullLength[half] < PULL_HALF;
+	}
+#ifdef DWIRE_DEFERRED
+	// This runs outside the ISR, which sets the other bits of pullPending
+	// and stalls on them, so update and check them atomically
+	bool wasDisabled = MAP_Interrupt_disableMaster();
+	pullPending = pullPending & ~(1 << half);
+
+	// Release SCL if the ISR waits for this half. After a STOP only the
+	// interrupt needs to be re-enabled
+	if (pullStalled && !(pullPending & (1 << (*pTxBufferIndex / PULL_HALF)))) {
+		pullStalled = false;
+		if (*pTxBufferSize)
+			_pullNext();
+		MAP_I2C_enableInterrupt(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+	}
+	if (!wasDisabled)
+		MAP_Interrupt_enableMaster();
+#else
+	pullPending = pullPending & ~(1 << half);
+#endif
 }
 
 /**
@@ -488,6 +1413,21 @@ void DWire::_handleReceive(uint8_t * rxBuffer) {
 	if (rxReadIndex != 0 && rxReadLength != 0)
 		return;
 
+#ifdef DWIRE_DEFERRED
+	// The previous message has not been handed to onReceive yet; it would
+	// be overwritten, so this one is dropped
+	if (receivePending) {
+		stats.eventOverflows++;
+		(*pRxBufferIndex) = 0;
+		return;
+	}
+#endif
+
+#ifdef DWIRE_CAPTURE
+	captureRecord(module, CAPTURE_SLAVE | CAPTURE_STOP, slaveAddress,
+			rxBuffer, *pRxBufferIndex);
+#endif
+
 	// Copy the main buffer into a local buffer
 	rxReadLength = *pRxBufferIndex;
 	rxReadIndex = 0;
@@ -498,153 +1438,699 @@ void DWire::_handleReceive(uint8_t * rxBuffer) {
 	// Reset the main buffer
 	(*pRxBufferIndex) = 0;
 
+#ifdef DWIRE_DEFERRED
+	if (_queueEvent(DEFERRED_RECEIVE, rxReadLength)) {
+		receivePending = true;
+		return;
+	}
+#endif
 	user_onReceive(rxReadLength);
 }
 
+#ifdef DWIRE_DEFERRED
+/**
+ * Queue a callback for poll(). Returns false if the queue is full, in
+ * which case the caller runs the callback itself
+ */
+bool DWire::_queueEvent(uint8_t type, uint8_t value) {
+	bool wasDisabled = MAP_Interrupt_disableMaster();
+
+	uint8_t head = deferredHead;
+	uint8_t next = (head + 1) % DWIRE_EVENT_QUEUE;
+	if (next == deferredTail) {
+		stats.eventOverflows++;
+		if (!wasDisabled)
+			MAP_Interrupt_enableMaster();
+		return false;
+	}
+
+	// Copied now, as a new transfer may be started before poll() runs
+	deferredQueue[head].instance = this;
+	deferredQueue[head].callback = transferCallback;
+	deferredQueue[head].context = transferContext;
+	deferredQueue[head].type = type;
+	deferredQueue[head].value = value;
+	deferredHead = next;
+
+	if (!wasDisabled)
+		MAP_Interrupt_enableMaster();
+
+	// A sleeping slave has to return to sleep() to poll
+	if (deferredPendSV)
+		MAP_Interrupt_pendInterrupt(FAULT_PENDSV);
+	else
+		MAP_Interrupt_disableSleepOnIsrExit();
+	return true;
+}
+
+/**
+ * Ask the onRequest handler for the response to a deferred request and
+ * release the clock by sending its first byte
+ */
+void DWire::_respond(void) {
+	user_onRequest();
+
+	*pTxBufferSize = *pTxBufferIndex;
+	MAP_I2C_slavePutData(module, pTxBuffer[0]);
+	*pTxBufferIndex = 1;
+	MAP_I2C_enableInterrupt(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+}
+#endif
+
 void DWire::_finishRequest(void) {
-	for (int i = 0; i <= *pRxBufferSize; i++) {
+#ifdef DWIRE_CAPTURE
+	captureRecord(module, CAPTURE_READ | CAPTURE_STOP, slaveAddress,
+			pRxBuffer, *pRxBufferSize);
+#endif
+
+	if (transferActive) {
+		for (int i = 0; i < transferRxLength; i++)
+			transferRxBuffer[i] = pRxBuffer[i];
+		_finishRequest(false);
+		return;
+	}
+
+	for (int i = 0; i < *pRxBufferSize; i++) {
 		this->rxLocalBuffer[i] = pRxBuffer[i];
 	}
 	rxReadIndex = 0;
 	rxReadLength = *pRxBufferSize;
-	requestDone = true;
+	readAfterWrite = false;
+	pIrqParam->pecEnabled = false;
+	pIrqParam->state = STATE_IDLE;
 }
 
 void DWire::_finishRequest(bool NAK) {
 	gotNAK = NAK;
-	requestDone = true;
+	readAfterWrite = false;
+	rewriting = false;
+	pIrqParam->pecEnabled = false;
+
+	// Set before the callback, which may start the next transfer
+	pIrqParam->state = STATE_IDLE;
+
+	// Release the bus, as the transfer ends here
+	if (NAK)
+		MAP_I2C_masterSendMultiByteStop(module);
+
+	// A NAKed write leaves bytes in the tx buffer, which would be sent with
+	// the next transmission and keep asynchronous transfers from starting
+	*pTxBufferIndex = 0;
+	sendStop = true;
+
+	if (!transferActive)
+		return;
+
+	if (*pRxBufferSize) {
+		MAP_I2C_setMode(module, EUSCI_B_I2C_TRANSMIT_MODE);
+		MAP_I2C_enableInterrupt(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+		MAP_I2C_clearInterruptFlag(module, EUSCI_B_I2C_TRANSMIT_INTERRUPT0);
+		(*pRxBufferIndex) = 0;
+		(*pRxBufferSize) = 0;
+	}
+
+	transferActive = false;
+	if (transferCallback) {
+#ifdef DWIRE_DEFERRED
+		if (!_queueEvent(DEFERRED_COMPLETE, NAK))
+#endif
+		transferCallback(transferContext, NAK);
+	}
+
+#ifdef DWIRE_RTOS
+	// The callback may have chained a transfer, leaving the state unchanged
+	rtosSemGiveFromISR(&pIrqParam->stateChanged);
+#endif
+}
+
+/**
+ * Called when the last byte of the tx buffer has been sent. Sends a STOP or
+ * continues with the read phase of an asynchronous transfer. Returns the
+ * next state of the module
+ */
+uint8_t DWire::_finishTransmit(void) {
+	if (sendStop) {
+		// Append the PEC as the last byte
+		if (pIrqParam->pecEnabled && !pecSent) {
+			pecSent = true;
+			MAP_I2C_masterSendMultiByteNext(module, pIrqParam->pec);
+			return STATE_MASTER_TX;
+		}
+
+#ifdef DWIRE_CAPTURE
+		captureRecord(module, CAPTURE_STOP, slaveAddress, pTxBuffer,
+				*pTxBufferSize);
+#endif
+
+		MAP_I2C_masterSendMultiByteStop(module);
+		_finishRequest(false);
+		return pIrqParam->state;
+	}
+
+	// The next transfer decides whether to send a STOP
+	sendStop = true;
+	pecBase = pIrqParam->pec;
+	readAfterWrite = true;
+
+#ifdef DWIRE_CAPTURE
+	captureRecord(module, 0, slaveAddress, pTxBuffer, *pTxBufferSize);
+#endif
+
+	if (transferActive || rewriting) {
+		// A resent write keeps the budgets of the read it precedes
+		if (rewriting)
+			rewriting = false;
+		else
+			_beginAttempts();
+
+		if (streamLength)
+			_startStream();
+		else
+			_startReceive(transferActive ? transferRxLength : *pRxBufferSize,
+					STATE_MASTER_RX);
+		return pIrqParam->state;
+	}
+
+	// Keep the bus; requestFrom() continues with a repeated start
+	return STATE_IDLE;
 }
 
-bool DWire::_isSendStop(bool resetAfterwards) {
-	if (!sendStop) {
-		if (resetAfterwards)
-			sendStop = true;
+/**
+ * Receive a byte of a streaming read, passing on each full chunk.
+ * Returns the next state of the module
+ */
+DWIRE_RAMFUNC uint8_t DWire::_handleStream(void) {
+	// Send the STOP while the last byte is being received, as in
+	// requestFrom()
+	if (streamRemaining == 1 && streamRemaining != streamLength)
+		MAP_I2C_masterReceiveMultiByteStop(module);
+
+	pRxBuffer[*pRxBufferIndex] = ISR_MASTER_RECEIVE(module);
+	(*pRxBufferIndex)++;
+	streamRemaining--;
+
+	if (*pRxBufferIndex == RX_BUFFER_SIZE || !streamRemaining) {
+		streamSink(transferContext, pRxBuffer, *pRxBufferIndex);
+		*pRxBufferIndex = 0;
+	}
+
+	if (streamRemaining)
+		return STATE_MASTER_STREAM;
+
+	streamLength = 0;
+	_finishRequest(false);
+	return pIrqParam->state;
+}
+
+/**
+ * Mark the current scan address as absent
+ */
+void DWire::_scanNAK(void) {
+	scanNAK = true;
+	MAP_I2C_masterSendMultiByteStop(module);
+}
+
+/**
+ * Record the result of the current probe and start the next one. Returns
+ * false once the last address has been probed
+ */
+bool DWire::_scanNext(void) {
+	if (!scanNAK)
+		scanBitmap[scanAddress >> 3] |= 1 << (scanAddress & 0x07);
+
+	if (scanAddress == SCAN_LAST_ADDRESS) {
+		MAP_I2C_disableInterrupt(module, EUSCI_B_I2C_STOP_INTERRUPT);
+		transferActive = false;
 		return false;
-	} else {
-		return true;
 	}
+
+	scanAddress++;
+	_probe();
+	return true;
 }
 
-/**** ISR/IRQ Handles ****/
+/**
+ * Called when arbitration was lost in the given state. The module has
+ * dropped to slave mode; wait for the winner's STOP before retrying.
+ * Returns the next state of the module
+ */
+uint8_t DWire::_arbitrationLost(uint8_t state) {
+	stats.arbitrationLost++;
+
+	if (!retriesLeft) {
+		// Give up and report the transfer as failed
+		_resetMaster();
+		if (state == STATE_SCAN) {
+			transferActive = false;
+			return STATE_IDLE;
+		}
+		_finishRequest(true);
+		return pIrqParam->state;
+	}
+	retriesLeft--;
+
+	// A resent write is retried for the read it precedes
+	if (!rewriting)
+		resumeState = state;
+	MAP_I2C_clearInterruptFlag(module, EUSCI_B_I2C_STOP_INTERRUPT);
+	MAP_I2C_enableInterrupt(module, EUSCI_B_I2C_STOP_INTERRUPT);
+	return STATE_ARBITRATION;
+}
 
 /**
- * The main (global) interrupt  handler
+ * The bus is free again: wait a random time, so that competing masters do
+ * not collide again, then restart the interrupted transfer from the start.
+ * Returns the next state of the module
  */
-void IRQHandler(IRQParam param) {
+uint8_t DWire::_retry(void) {
+	stats.arbitrationRetries++;
 
-	uint_fast16_t status;
+	_resetMaster();
 
-	status = MAP_I2C_getEnabledInterruptStatus(param.module);
-	MAP_I2C_clearInterruptFlag(param.module, status);
+	backoffSeed = backoffSeed * 1103515245 + 12345;
+	return _scheduleRestart((backoffSeed >> 16) % (maxBackoff + 1));
+}
 
-	/* RXIFG */
-	// Triggered when data has been received
-	if (status & EUSCI_B_I2C_RECEIVE_INTERRUPT0) {
+/**
+ * Restart the interrupted transfer after the given number of microseconds.
+ * The retry timer times the delay, so the ISR returns in the meantime.
+ * Returns the next state of the module
+ */
+uint8_t DWire::_scheduleRestart(uint32_t us) {
+	if (!us)
+		return _resume();
+
+	bool wasDisabled = MAP_Interrupt_disableMaster();
+	retryUpdate();
+	pIrqParam->retryTicks = us * cyclesPerUs;
+	retryUpdate();
+	if (!wasDisabled)
+		MAP_Interrupt_enableMaster();
+
+	return STATE_RETRY_WAIT;
+}
 
-		// If the rxBufferSize > 0, then we're a master performing a request
-		if (*param.rxBufferSize > 0) {
-			param.rxBuffer[*param.rxBufferIndex] =
-			MAP_I2C_masterReceiveMultiByteNext(param.module);
-			(*param.rxBufferIndex)++;
+/**
+ * Restart the interrupted transfer once the bus has been released. A read
+ * that followed a write is restarted from the write, as another master may
+ * have moved the register pointer of the device in the meantime.
+ * Returns the next state of the module
+ */
+uint8_t DWire::_resume(void) {
+	if (readAfterWrite && (resumeState == STATE_MASTER_RX
+			|| resumeState == STATE_MASTER_STREAM)) {
+		rewriting = true;
+		sendStop = false;
+		_sendStart();
+		return STATE_MASTER_TX;
+	}
+	return _restart(resumeState);
+}
 
-			if (*param.rxBufferIndex == *param.rxBufferSize) {
-				DWire * instance = getInstance(param.module);
-				if (instance) {
-					instance->_finishRequest();
-				}
-			}
+/**
+ * Send a new START for the given state's transfer. The tx buffer is
+ * rewound; the rx buffer is refilled from the first byte.
+ * Returns the next state of the module
+ */
+uint8_t DWire::_restart(uint8_t state) {
+	switch (state) {
+	case STATE_MASTER_TX:
+		_sendStart();
+		return STATE_MASTER_TX;
+	case STATE_MASTER_RX:
+		_startReceive(*pRxBufferSize, STATE_MASTER_RX);
+		return STATE_MASTER_RX;
+	case STATE_MASTER_STREAM:
+		// Only the address can be NAKed, so no chunk has been delivered yet
+		_startStream();
+		return STATE_MASTER_STREAM;
+	case STATE_SCAN:
+		MAP_I2C_enableInterrupt(module, EUSCI_B_I2C_STOP_INTERRUPT);
+		_probe();
+		return STATE_SCAN;
+	default:
+		return STATE_IDLE;
+	}
+}
 
-			// Otherwise we're a slave receiving data
-		} else {
-			param.rxBuffer[*param.rxBufferIndex] = MAP_I2C_slaveGetData(
-					param.module);
-			(*param.rxBufferIndex)++;
-		}
+/**
+ * Called when the slave did not acknowledge in the given state. Retries
+ * according to the NAK policy, or fails the transfer.
+ * Returns the next state of the module
+ */
+uint8_t DWire::_handleNAK(uint8_t state) {
+#ifdef DWIRE_CAPTURE
+	captureRecord(module, CAPTURE_NAK | (state == STATE_MASTER_TX ? 0 : CAPTURE_READ),
+			slaveAddress, NULL, 0);
+#endif
+
+	if (nakAttemptsLeft <= 1) {
+		_finishRequest(true);
+		return pIrqParam->state;
 	}
+	nakAttemptsLeft--;
+	stats.nakRetries++;
+
+	// A repeated START keeps the bus
+	if (!nakPolicy.interval)
+		return _restart(state);
+
+	if (!rewriting)
+		resumeState = state;
+	MAP_I2C_clearInterruptFlag(module, EUSCI_B_I2C_STOP_INTERRUPT);
+	MAP_I2C_enableInterrupt(module, EUSCI_B_I2C_STOP_INTERRUPT);
+	MAP_I2C_masterSendMultiByteStop(module);
+	return STATE_NAK_RETRY;
+}
 
-	// As master: triggered when a byte has been transmitted
-	// As slave: triggered on request */
-	if (status & EUSCI_B_I2C_TRANSMIT_INTERRUPT0) {
-		DWire * instance = getInstance(param.module);
-
-		if (instance) {
-
-			// If the module is setup as a master, then we're transmitting data
-			if (instance->isMaster()) {
-				// If we've transmitted the last byte from the buffer, then send a stop
-				if (!(*param.txBufferIndex)) {
-					if (instance->_isSendStop(false))
-						MAP_I2C_masterSendMultiByteStop(param.module);
-					instance->_isSendStop(true);
-
-				} else {
-					// If we still have data left in the buffer, then transmit that
-					MAP_I2C_masterSendMultiByteNext(param.module,
-							param.txBuffer[(*param.txBufferSize)
-									- (*param.txBufferIndex)]);
-					(*param.txBufferIndex)--;
-				}
-				// Otherwise we're a slave and a master is requesting data
-			} else {
-				instance->_handleRequestSlave();
-			}
-		}
+/**
+ * The STOP after a NAK has been sent: have the retry timer restart the
+ * transfer after the retry interval. Returns the next state of the module
+ */
+uint8_t DWire::_retryAfterNAK(void) {
+	MAP_I2C_disableInterrupt(module, EUSCI_B_I2C_STOP_INTERRUPT);
+	return _scheduleRestart(nakPolicy.interval);
+}
+
+/**** STATE MACHINE ****/
+
+/**
+ * Ignore an event that is not expected in the current state
+ */
+DWIRE_RAMFUNC static uint8_t stay(IRQParam * param) {
+	return param->state;
+}
+
+/**
+ * MASTER_TX: a byte has been moved to the shift register
+ */
+DWIRE_RAMFUNC static uint8_t masterTransmit(IRQParam * param) {
+	// If we've transmitted the last byte from the buffer, then finish up
+	if (!(*param->txBufferIndex))
+		return param->instance->_finishTransmit();
+
+	// If we still have data left in the buffer, then transmit that
+	uint8_t data = param->txBuffer[(*param->txBufferSize)
+			- (*param->txBufferIndex)];
+	ISR_MASTER_SEND(param->module, data);
+	(*param->txBufferIndex)--;
+
+	if (param->pecEnabled)
+		param->pec = crc8Table[param->pec ^ data];
+	return STATE_MASTER_TX;
+}
+
+/**
+ * MASTER_RX: a byte has been received
+ */
+DWIRE_RAMFUNC static uint8_t masterReceive(IRQParam * param) {
+	// Send a STOP if we're done in request mode. This is done before
+	// reading the byte, as the next byte is clocked in immediately
+	if ((*param->rxBufferIndex == *param->rxBufferSize - 1)
+			&& *param->rxBufferIndex != 0) {
+		MAP_I2C_masterReceiveMultiByteStop(param->module);
 	}
 
-	// Handle a NAK
-	if (status & EUSCI_B_I2C_NAK_INTERRUPT) {
-		//MAP_I2C_masterSendStart(param.module);
-		DWire * instance = getInstance(param.module);
-		//*param.txBufferIndex = 0;
-		if (instance)
-			if (*param.rxBufferSize > 0) {
-			}
-		instance->_finishRequest(true);
-	}
-
-	/* STPIFG
-	 * Called when a STOP is received
-	 */
-	if (status & EUSCI_B_I2C_STOP_INTERRUPT) {
-		DWire * instance = getInstance(param.module);
-		if (instance) {
-			if (*param.txBufferIndex != 0 && !instance->isMaster()) {
-				MAP_I2C_slavePutData(instance->module, 0);
-				*param.rxBufferIndex = 0;
-				*param.rxBufferSize = 0;
-			} else if (*param.rxBufferIndex != 0) {
-				instance->_handleReceive(param.rxBuffer);
-			}
-		}
+	uint8_t data = ISR_MASTER_RECEIVE(param->module);
+	param->rxBuffer[*param->rxBufferIndex] = data;
+	(*param->rxBufferIndex)++;
+
+	if (param->pecEnabled)
+		param->pec = crc8Table[param->pec ^ data];
+
+	// In an SMBus block read the first byte gives the remaining length
+	if (param->blockRead && *param->rxBufferIndex == 1) {
+		uint_fast16_t size = 1 + data + (param->pecEnabled ? 1 : 0);
+		if (size > RX_BUFFER_SIZE)
+			size = RX_BUFFER_SIZE;
+		*param->rxBufferSize = size;
+
+		// Nothing follows the count byte, so stop right away
+		if (size == 1)
+			MAP_I2C_masterReceiveMultiByteStop(param->module);
+	}
+
+	if (*param->rxBufferIndex == *param->rxBufferSize) {
+		param->instance->_finishRequest();
+		return param->state;
 	}
+	return STATE_MASTER_RX;
 }
 
-#ifdef USING_EUSCI_B0
-/*
- * Handle everything on EUSCI_B0
+/**
+ * MASTER_STREAM: a byte has been received
  */
-extern "C" {
-void EUSCIB0_IRQHandler(void) {
+DWIRE_RAMFUNC static uint8_t masterStream(IRQParam * param) {
+	return param->instance->_handleStream();
+}
+
+/**
+ * MASTER_TX/MASTER_RX: the slave did not acknowledge
+ */
+static uint8_t masterNAK(IRQParam * param) {
+	return param->instance->_handleNAK(param->state);
+}
+
+/**
+ * NAK_RETRY: the STOP after a NAK has been sent
+ */
+static uint8_t nakRetryStop(IRQParam * param) {
+	return param->instance->_retryAfterNAK();
+}
+
+/**
+ * SCAN: the START has been sent; request the STOP so no data follows
+ */
+static uint8_t scanStart(IRQParam * param) {
+	MAP_I2C_masterSendMultiByteStop(param->module);
+	return STATE_SCAN;
+}
+
+static uint8_t scanNAK(IRQParam * param) {
+	param->instance->_scanNAK();
+	return STATE_SCAN;
+}
+
+static uint8_t scanStop(IRQParam * param) {
+	return param->instance->_scanNext() ? STATE_SCAN : STATE_IDLE;
+}
+
+/**
+ * MASTER_TX/MASTER_RX/SCAN: another master won the bus
+ */
+static uint8_t arbitrationLost(IRQParam * param) {
+	return param->instance->_arbitrationLost(param->state);
+}
+
+/**
+ * ARBITRATION: the other master has released the bus
+ */
+static uint8_t arbitrationStop(IRQParam * param) {
+	return param->instance->_retry();
+}
+
+/**
+ * RETRY_WAIT: the delay before the retry has passed
+ */
+static uint8_t retryTimer(IRQParam * param) {
+	return param->instance->_resume();
+}
+
+/**
+ * SLAVE: a byte has been received from the master
+ */
+DWIRE_RAMFUNC static uint8_t slaveReceive(IRQParam * param) {
+	param->rxBuffer[*param->rxBufferIndex] = ISR_SLAVE_GET(param->module);
+	(*param->rxBufferIndex)++;
+	return STATE_SLAVE_RX;
+}
+
+/**
+ * SLAVE: the master requests data
+ */
+DWIRE_RAMFUNC static uint8_t slaveTransmit(IRQParam * param) {
+	param->instance->_handleRequestSlave();
+	return STATE_SLAVE_TX;
+}
+
+/**
+ * SLAVE_RX: a repeated start turned the write into a read. Deliver the
+ * received bytes before asking for the response
+ */
+static uint8_t slaveReceiveThenTransmit(IRQParam * param) {
+	if (*param->rxBufferIndex != 0)
+		param->instance->_handleReceive(param->rxBuffer);
+	return slaveTransmit(param);
+}
+
+/**
+ * SLAVE_IDLE/SLAVE_RX: the master has finished writing
+ */
+static uint8_t slaveReceiveStop(IRQParam * param) {
+	if (*param->rxBufferIndex != 0)
+		param->instance->_handleReceive(param->rxBuffer);
+	return STATE_SLAVE_IDLE;
+}
+
+/**
+ * SLAVE_TX: the master has finished reading
+ */
+static uint8_t slaveTransmitStop(IRQParam * param) {
+	if (*param->txBufferIndex != 0) {
+		MAP_I2C_slavePutData(param->module, 0);
+		*param->rxBufferIndex = 0;
+		*param->rxBufferSize = 0;
+	}
+
+	// The next request asks the user for a new response
+	*param->txBufferIndex = 0;
+	*param->txBufferSize = 0;
+	return STATE_SLAVE_IDLE;
+}
+
+/**
+ * The transition table, indexed by [state][event]
+ */
+DWIRE_RAMDATA const IRQTransition irqTransitions[STATE_COUNT][EVENT_COUNT] = {
+	/*                   EVENT_RX        EVENT_TX                  EVENT_NAK  EVENT_STOP         EVENT_ARBITRATION EVENT_TIMER */
+	/* IDLE        */ { stay,          stay,                     stay,      stay,              stay,            stay },
+	/* MASTER_TX   */ { stay,          masterTransmit,           masterNAK, stay,              arbitrationLost, stay },
+	/* MASTER_RX   */ { masterReceive, stay,                     masterNAK, stay,              arbitrationLost, stay },
+	/* STREAM      */ { masterStream,  stay,                     masterNAK, stay,              arbitrationLost, stay },
+	/* SCAN        */ { stay,          scanStart,                scanNAK,   scanStop,          arbitrationLost, stay },
+	/* SLAVE_IDLE  */ { slaveReceive,  slaveTransmit,            stay,      slaveReceiveStop,  stay,            stay },
+	/* SLAVE_RX    */ { slaveReceive,  slaveReceiveThenTransmit, stay,      slaveReceiveStop,  stay,            stay },
+	/* SLAVE_TX    */ { slaveReceive,  slaveTransmit,            stay,      slaveTransmitStop, stay,            stay },
+	/* ARBITRATION */ { stay,          stay,                     stay,      arbitrationStop,   stay,            stay },
+	/* NAK_RETRY   */ { stay,          stay,                     stay,      nakRetryStop,      stay,            stay },
+	/* RETRY_WAIT  */ { stay,          stay,                     stay,      stay,              stay,            retryTimer },
+};
+
+/**
+ * CRC-8 with polynomial x^8 + x^2 + x + 1, as used for the SMBus PEC
+ */
+DWIRE_RAMDATA const uint8_t crc8Table[256] = {
+	0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+	0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+	0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65,
+	0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+	0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5,
+	0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+	0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85,
+	0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+	0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2,
+	0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+	0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2,
+	0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+	0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32,
+	0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+	0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42,
+	0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+	0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C,
+	0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+	0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC,
+	0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+	0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C,
+	0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+	0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C,
+	0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+	0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B,
+	0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+	0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B,
+	0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+	0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB,
+	0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+	0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB,
+	0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3
+};
+
+/**
+ * The event corresponding to each UCBxIV value, indexed by value / 2
+ */
+DWIRE_RAMDATA const uint8_t irqVectorEvents[IV_COUNT >> 1] = {
+	EVENT_NONE,     // 0x00: no interrupt pending
+	EVENT_ARBITRATION, // 0x02: ALIFG
+	EVENT_NAK,      // 0x04: NACKIFG
+	EVENT_NONE,     // 0x06: STTIFG
+	EVENT_STOP,     // 0x08: STPIFG
+	EVENT_NONE,     // 0x0A: RXIFG3
+	EVENT_NONE,     // 0x0C: TXIFG3
+	EVENT_NONE,     // 0x0E: RXIFG2
+	EVENT_NONE,     // 0x10: TXIFG2
+	EVENT_NONE,     // 0x12: RXIFG1
+	EVENT_NONE,     // 0x14: TXIFG1
+	EVENT_RX,       // 0x16: RXIFG0
+	EVENT_TX,       // 0x18: TXIFG0
+	EVENT_NONE,     // 0x1A: BCNTIFG
+	EVENT_NONE,     // 0x1C: clock low timeout
+	EVENT_NONE      // 0x1E: 9th bit
+};
+
+/**** ISR/IRQ Handles ****/
+
+/**
+ * The main (global) interrupt  handler
+ * UCBxIV is read directly rather than through driverlib: a single read
+ * returns the highest-priority pending source and clears its flag. Pending
+ * sources are served in the same invocation until the register reads zero.
+ */
+DWIRE_RAMFUNC void IRQHandler(IRQParam * param) {
 
-	// Send a STOP if we're done in request mode
-	// This is done here as triggering the interrupt takes too long
-	if ( MAP_I2C_getInterruptStatus(EUSCI_B0_BASE,
-	EUSCI_B_I2C_RECEIVE_INTERRUPT0)
-			&& (EUSCIB0_rxBufferIndex == EUSCIB0_rxBufferSize - 1)
-			&& EUSCIB0_rxBufferIndex != 0) {
-		MAP_I2C_masterReceiveMultiByteStop(EUSCI_B0_BASE);
+#ifdef DWIRE_WAKE_PORT
+	MAP_GPIO_setOutputHighOnPin(DWIRE_WAKE_PORT, DWIRE_WAKE_PIN);
+#endif
+
+#ifdef DWIRE_PROFILE
+	uint32_t start = DWIRE_CYCLES();
+#endif
+
+	uint_fast16_t vector;
+#ifdef DWIRE_RTOS
+	uint8_t entryState = param->state;
+#endif
+
+	// The retry timer has pended this interrupt
+	if (param->retryDue) {
+		param->retryDue = false;
+		if (param->instance)
+			param->state = irqTransitions[param->state][EVENT_TIMER](param);
 	}
 
-	IRQParam param;
-	param.module = EUSCI_B0_BASE;
-	param.rxBuffer = EUSCIB0_rxBuffer;
-	param.rxBufferIndex = &EUSCIB0_rxBufferIndex;
-	param.rxBufferSize = &EUSCIB0_rxBufferSize;
-	param.txBuffer = EUSCIB0_txBuffer;
-	param.txBufferIndex = &EUSCIB0_txBufferIndex;
-	param.txBufferSize = &EUSCIB0_txBufferSize;
+	while ((vector = DWIRE_READ_IV(param->module)) != IV_NONE) {
+		uint_fast8_t event = irqVectorEvents[(vector & (IV_COUNT - 1)) >> 1];
+
+		// Nothing to drive if no instance has claimed this module
+		if (event == EVENT_NONE || !param->instance)
+			continue;
+
+		param->state = irqTransitions[param->state][event](param);
+#ifdef DWIRE_PROFILE
+		param->irqEvents++;
+#endif
+	}
+
+#ifdef DWIRE_RTOS
+	// Wake up the task waiting for this module
+	if (param->state != entryState)
+		rtosSemGiveFromISR(&param->stateChanged);
+#endif
+
+#ifdef DWIRE_PROFILE
+	param->irqCycles += DWIRE_CYCLES() - start;
+#endif
+
+#ifdef DWIRE_WAKE_PORT
+	MAP_GPIO_setOutputLowOnPin(DWIRE_WAKE_PORT, DWIRE_WAKE_PIN);
+#endif
+}
 
-	IRQHandler(param);
+#ifdef USING_EUSCI_B0
+/*
+ * Handle everything on EUSCI_B0
+ */
+extern "C" {
+DWIRE_RAMFUNC void EUSCIB0_IRQHandler(void) {
+	IRQHandler(&EUSCIB0_irqParam);
 }
 }
 
@@ -656,27 +2142,8 @@ void EUSCIB0_IRQHandler(void) {
  * Handle everything on EUSCI_B1
  */
 extern "C" {
-void EUSCIB1_IRQHandler(void) {
-
-	// Send a STOP if we're done in request mode
-	// This is done here as triggering the interrupt takes too long
-	if ( MAP_I2C_getInterruptStatus(EUSCI_B1_BASE,
-	EUSCI_B_I2C_RECEIVE_INTERRUPT0)
-			&& (EUSCIB1_rxBufferIndex == EUSCIB1_rxBufferSize - 1) ) {
-			//&& EUSCIB1_rxBufferIndex != 0) {
-		MAP_I2C_masterReceiveMultiByteStop(EUSCI_B1_BASE);
-	}
-
-	IRQParam param;
-	param.module = EUSCI_B1_BASE;
-	param.rxBuffer = EUSCIB1_rxBuffer;
-	param.rxBufferIndex = &EUSCIB1_rxBufferIndex;
-	param.rxBufferSize = &EUSCIB1_rxBufferSize;
-	param.txBuffer = EUSCIB1_txBuffer;
-	param.txBufferIndex = &EUSCIB1_txBufferIndex;
-	param.txBufferSize = &EUSCIB1_txBufferSize;
-
-	IRQHandler(param);
+DWIRE_RAMFUNC void EUSCIB1_IRQHandler(void) {
+	IRQHandler(&EUSCIB1_irqParam);
 }
 }
 
@@ -688,27 +2155,8 @@ void EUSCIB1_IRQHandler(void) {
  * Handle everything on EUSCI_B2
  */
 extern "C" {
-void EUSCIB2_IRQHandler(void) {
-
-	// Send a STOP if we're done in request mode
-	// This is done here as triggering the interrupt takes too long
-	if ( MAP_I2C_getInterruptStatus(EUSCI_B2_BASE,
-	EUSCI_B_I2C_RECEIVE_INTERRUPT0)
-			&& (EUSCIB2_rxBufferIndex == EUSCIB2_rxBufferSize - 1)
-			&& EUSCIB2_rxBufferIndex != 0) {
-		MAP_I2C_masterReceiveMultiByteStop(EUSCI_B2_BASE);
-	}
-
-	IRQParam param;
-	param.module = EUSCI_B2_BASE;
-	param.rxBuffer = EUSCIB2_rxBuffer;
-	param.rxBufferIndex = &EUSCIB2_rxBufferIndex;
-	param.rxBufferSize = &EUSCIB2_rxBufferSize;
-	param.txBuffer = EUSCIB2_txBuffer;
-	param.txBufferIndex = &EUSCIB2_txBufferIndex;
-	param.txBufferSize = &EUSCIB2_txBufferSize;
-
-	IRQHandler(param);
+DWIRE_RAMFUNC void EUSCIB2_IRQHandler(void) {
+	IRQHandler(&EUSCIB2_irqParam);
 }
 }
 
@@ -720,29 +2168,22 @@ void EUSCIB2_IRQHandler(void) {
  * Handle everything on EUSCI_B3
  */
 extern "C" {
-void EUSCIB3_IRQHandler(void) {
-
-	// Send a STOP if we're done in request mode
-	// This is done here as triggering the interrupt takes too long
-	if ( MAP_I2C_getInterruptStatus(EUSCI_B3_BASE,
-	EUSCI_B_I2C_RECEIVE_INTERRUPT0)
-			&& (EUSCIB3_rxBufferIndex == EUSCIB3_rxBufferSize - 1)
-			&& EUSCIB3_rxBufferIndex != 0) {
-		MAP_I2C_masterReceiveMultiByteStop(EUSCI_B3_BASE);
-	}
-
-	IRQParam param;
-	param.module = EUSCI_B3_BASE;
-	param.rxBuffer = EUSCIB3_rxBuffer;
-	param.rxBufferIndex = &EUSCIB3_rxBufferIndex;
-	param.rxBufferSize = &EUSCIB3_rxBufferSize;
-	param.txBuffer = EUSCIB3_txBuffer;
-	param.txBufferIndex = &EUSCIB3_txBufferIndex;
-	param.txBufferSize = &EUSCIB3_txBufferSize;
-
-	IRQHandler(param);
+DWIRE_RAMFUNC void EUSCIB3_IRQHandler(void) {
+	IRQHandler(&EUSCIB3_irqParam);
 }
 }
 
 /* USING_EUSCI_B3 */
 #endif
+
+/*
+ * The retry timer has expired
+ */
+extern "C" {
+void DWIRE_RETRY_HANDLER(void) {
+	bool wasDisabled = MAP_Interrupt_disableMaster();
+	retryUpdate();
+	if (!wasDisabled)
+		MAP_Interrupt_enableMaster();
+}
+}
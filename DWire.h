@@ -15,20 +15,63 @@
 #ifndef DWIRE_DWIRE_H_
 #define DWIRE_DWIRE_H_
 
+/*
+ * Module selection. Only the enabled eUSCI_B modules get buffers and an
+ * interrupt handler. Enable them with -DUSING_EUSCI_Bx, or list them in a
+ * project-specific dwire_config.h and build with -DDWIRE_CONFIG. Without
+ * either, all four modules are enabled.
+ */
+#ifdef DWIRE_CONFIG
+#include "dwire_config.h"
+#endif
 
+#if !defined(USING_EUSCI_B0) && !defined(USING_EUSCI_B1) \
+        && !defined(USING_EUSCI_B2) && !defined(USING_EUSCI_B3)
 #define USING_EUSCI_B0
 #define USING_EUSCI_B1
 #define USING_EUSCI_B2
 #define USING_EUSCI_B3
-
+#endif
 
 // Similar for the roles
 #define BUS_ROLE_MASTER 0
 #define BUS_ROLE_SLAVE 1
 
-// Default buffer size in bytes
+// Default buffer size in bytes, per enabled module. The rx buffer holds an
+// SMBus block read of 32 bytes with its count byte and PEC
+#ifndef TX_BUFFER_SIZE
 #define TX_BUFFER_SIZE 32
-#define RX_BUFFER_SIZE 32
+#endif
+#ifndef RX_BUFFER_SIZE
+#define RX_BUFFER_SIZE 34
+#endif
+
+// Low-power mode of a sleeping slave (see sleep()): 0, 3 or 4
+#ifndef DWIRE_SLAVE_LPM
+#define DWIRE_SLAVE_LPM 3
+#endif
+
+// Deferred callbacks (-DDWIRE_DEFERRED): capacity of the event queue
+#ifndef DWIRE_EVENT_QUEUE
+#define DWIRE_EVENT_QUEUE 8
+#endif
+
+// Arbitration loss: default number of retries and maximum backoff in us
+#define ARBITRATION_RETRIES 3
+#define ARBITRATION_BACKOFF 50
+
+// Timer32 module that times the delays before retries, so that the ISR
+// does not wait for them. DScheduler uses the other one
+#ifndef DWIRE_RETRY_TIMER
+#define DWIRE_RETRY_TIMER TIMER32_1_BASE
+#define DWIRE_RETRY_INTERRUPT TIMER32_1_INTERRUPT
+#define DWIRE_RETRY_HANDLER T32_INT2_IRQHandler
+#endif
+
+// Bus scan: one bit per 7-bit address, reserved addresses are not probed
+#define SCAN_BITMAP_SIZE 16
+#define SCAN_FIRST_ADDRESS 0x08
+#define SCAN_LAST_ADDRESS 0x77
 
 /* Driverlib */
 #ifdef ENERGIA
@@ -39,6 +82,38 @@
 
 /* Device specific includes */
 #include "inc/dwire_pins.h"
+#include "inc/dwire_rtos.h"
+#include "inc/dwire_irq.h"
+
+#ifdef DWIRE_LINUX
+#include "inc/dwire_linux.h"
+#endif
+
+/* Completion handler for asynchronous transfers. The second argument
+ * is true if the slave did not acknowledge */
+typedef void (*DWireCallback)( void *, bool );
+
+/* Receiver of streamed data: called with each chunk as it arrives */
+typedef void (*DWireSink)( void *, const uint8_t *, uint8_t );
+
+/* Producer of a streamed slave response: fills up to the given number of
+ * bytes and returns how many it wrote. Fewer ends the response */
+typedef uint8_t (*DWireSource)( void *, uint8_t *, uint8_t );
+
+/* Acknowledge polling: how often a transfer is attempted while the slave
+ * does not acknowledge, and the microseconds between the attempts */
+typedef struct {
+    uint16_t attempts;
+    uint16_t interval;
+} DWireNAKPolicy;
+
+/* Per-module counters */
+typedef struct {
+    uint32_t arbitrationLost;
+    uint32_t arbitrationRetries;
+    uint32_t nakRetries;
+    uint32_t eventOverflows;
+} DWireStats;
 
 extern "C" {
 #ifdef USING_EUSCI_B0
@@ -56,6 +131,8 @@ extern void EUSCIB2_IRQHandler( void );
 #ifdef USING_EUSCI_B3
 extern void EUSCIB3_IRQHandler( void );
 #endif
+
+extern void DWIRE_RETRY_HANDLER( void );
 }
 
 
@@ -76,26 +153,137 @@ private:
     uint8_t * pRxBufferIndex;
     uint8_t * pRxBufferSize;
 
-    volatile bool requestDone;
     volatile bool sendStop;
     volatile bool gotNAK;
 
+    volatile bool wakeRequested;
+
+    /* Asynchronous transfer state */
+    volatile bool transferActive;
+    uint8_t * transferRxBuffer;
+    uint8_t transferRxLength;
+    DWireCallback transferCallback;
+    void * transferContext;
+
+    /* Streaming read state */
+    uint32_t streamLength;
+    uint32_t streamRemaining;
+    DWireSink streamSink;
+
+    /* SMBus packet error code */
+    uint8_t pecBase;
+    bool pecSent;
+
+    /* Bus scan state */
+    volatile bool scanNAK;
+    uint8_t scanAddress;
+    uint8_t * scanBitmap;
+
     uint8_t slaveAddress;
 
     uint8_t busRole;
 
     uint32_t intModule;
 
+    const eUSCI_I2C_MasterConfig * masterConfig;
+    eUSCI_I2C_MasterConfig speedConfig;
+
+    /* Arbitration loss handling */
+    uint8_t maxRetries;
+    uint8_t retriesLeft;
+    uint16_t maxBackoff;
+    uint32_t backoffSeed;
+    uint32_t cyclesPerUs;
+    uint8_t resumeState;
+
+    /* A read that followed a write, and is being restarted from the write */
+    bool readAfterWrite;
+    volatile bool rewriting;
+
+    /* NAK retry policy: the default, and that of the current transfer */
+    DWireNAKPolicy nakDefault;
+    DWireNAKPolicy nakPolicy;
+    uint16_t nakAttemptsLeft;
+
+    DWireStats stats;
+
+#ifdef DWIRE_RTOS
+    /* Held by a task for the duration of a blocking transfer */
+    RTOSMutex busMutex;
+    bool txLocked;
+#endif
+
+    IRQParam * pIrqParam;
+
+#ifdef DWIRE_LINUX
+    /* i2c-dev adapter, and the messages of the transaction being collected.
+     * The write being built by write() is messageData[messageCount] */
+    int fd;
+    unsigned long functions;
+    struct i2c_msg messages[DWIRE_LINUX_MESSAGES + 1];
+    uint8_t messageData[DWIRE_LINUX_MESSAGES + 1][TX_BUFFER_SIZE + 1];
+    uint8_t messageCount;
+    uint8_t txLength;
+    uint8_t blockBuffer[I2C_SMBUS_BLOCK_MAX + 2];
+    uint8_t streamBuffer[RX_BUFFER_SIZE];
+    bool blockRead;
+    bool pecEnabled;
+    uint8_t pec;
+
+    bool _queueWrite( void );
+    void _queueRead( uint8_t *, uint16_t, uint16_t );
+    bool _flush( void );
+    bool _transferI2C( void );
+    bool _transferSMBus( void );
+    bool _retryAfter( int );
+    void _delay( uint32_t );
+    uint8_t _pec( void );
+#endif
+
     uint_fast8_t modulePort;
     uint_fast16_t modulePins;
 
     void (*user_onRequest)( void );
     void (*user_onReceive)( uint8_t );
 
-    void _initMain( void );
+    /* Streamed slave response: the two halves of the tx buffer */
+    DWireSource user_onPull;
+    void * pullContext;
+    uint8_t pullLength[2];
+    bool pullEnded;
+    volatile uint8_t pullPending;
+    volatile bool pullStalled;
+
+#ifdef DWIRE_DEFERRED
+    /* A received message waits in rxLocalBuffer for its onReceive call */
+    volatile bool receivePending;
+
+    bool _queueEvent( uint8_t, uint8_t );
+    void _respond( void );
+#endif
+
+    bool _initMain( void );
     void _initMaster( const eUSCI_I2C_MasterConfig * );
     void _initSlave( void );
+    void _resetMaster( void );
+    void _waitWhile( uint8_t );
+    void _lockTransmission( void );
+    void _unlockTransmission( void );
+    void _transmit( bool );
+    uint8_t _requestFrom( uint_fast8_t, uint_fast8_t );
+    void _usePolicy( const DWireNAKPolicy * );
+    void _beginAttempts( void );
+    uint8_t _scheduleRestart( uint32_t );
+    uint8_t _restart( uint8_t );
     void _setSlaveAddress( uint_fast8_t );
+    void _startReceive( uint8_t, uint8_t );
+    void _startStream( void );
+    void _sendStart( void );
+    bool _claimBus( void );
+    void _probe( void );
+    void _pullNext( void );
+    void _requestRefill( uint8_t );
+    void _refill( uint8_t );
 
 public:
 
@@ -114,6 +302,28 @@ public:
     void endTransmission( bool );
 
     uint8_t requestFrom( uint_fast8_t, uint_fast8_t );
+    uint8_t requestBlock( uint_fast8_t );
+
+    bool hasFailed( void );
+
+    void setPEC( bool );
+    bool isPECValid( void );
+
+    bool startTransfer( uint_fast8_t, const uint8_t *, uint8_t, uint8_t *,
+            uint8_t, DWireCallback, void * );
+    bool startTransfer( uint_fast8_t, const uint8_t *, uint8_t, uint8_t *,
+            uint8_t, DWireCallback, void *, const DWireNAKPolicy * );
+    bool isBusy( void );
+
+    bool startStreamRead( uint_fast8_t, const uint8_t *, uint8_t, uint32_t,
+            DWireSink, DWireCallback, void * );
+    bool startStreamRead( uint_fast8_t, const uint8_t *, uint8_t, uint32_t,
+            DWireSink, DWireCallback, void *, const DWireNAKPolicy * );
+
+    bool startScan( uint8_t * );
+    bool scan( uint8_t * );
+    static void scanAll( DWire **, uint_fast8_t, uint8_t (*)[SCAN_BITMAP_SIZE] );
+    bool isPresent( const uint8_t *, uint_fast8_t );
 
     /* SLAVE specific */
     void begin( uint_fast32_t, uint8_t );
@@ -122,16 +332,52 @@ public:
 
     void onRequest( void (*)( void ) );
     void onReceive( void (*)( uint8_t ) );
+    void onPull( DWireSource, void * );
+
+    void sleep( void );
+    void wake( void );
 
     /* Miscellaneous */
     bool isMaster( void );
 
+    void setArbitrationRetry( uint8_t, uint16_t );
+    void setNAKRetry( uint16_t, uint16_t );
+    const DWireStats * getStats( void );
+
+    bool setSpeed( uint32_t );
+    uint32_t getSpeed( void );
+
+    void lock( void );
+    void unlock( void );
+
+#ifdef DWIRE_DEFERRED
+    /* Deferred callbacks */
+    static void poll( void );
+    static void usePendSV( void );
+#endif
+
+#ifdef DWIRE_PROFILE
+    /* Profiling */
+    uint32_t getIrqCycles( void );
+    uint32_t getIrqEvents( void );
+    void resetProfile( void );
+#endif
+
     /* Internal */
+    void _waitEvent( void );
     void _handleReceive( uint8_t * );
     void _handleRequestSlave( void );
     void _finishRequest( void );
     void _finishRequest( bool );
-    bool _isSendStop( bool );
+    uint8_t _finishTransmit( void );
+    uint8_t _handleStream( void );
+    void _scanNAK( void );
+    bool _scanNext( void );
+    uint8_t _arbitrationLost( uint8_t );
+    uint8_t _retry( void );
+    uint8_t _resume( void );
+    uint8_t _handleNAK( uint8_t );
+    uint8_t _retryAfterNAK( void );
 };
 
 
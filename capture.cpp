@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DWire: a library to provide full hardware-driven I2C functionality
+ * to the TI MSP432 family of microcontrollers. It is possible to use
+ * this library in Energia (the Arduino port for MSP microcontrollers)
+ * or in other toolchains.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include "capture.h"
+
+uint8_t captureBuffer[CAPTURE_BUFFER_SIZE];
+
+// Written by the ISR only
+volatile uint16_t captureHead = 0;
+// Written by the reader only
+volatile uint16_t captureTail = 0;
+
+volatile uint32_t captureDropCount = 0;
+
+/**
+ * Enable the cycle counter and clear the buffer
+ */
+void captureBegin( void ) {
+    DWIRE_CYCLES_ENABLE();
+
+    captureTail = captureHead;
+    captureDropCount = 0;
+}
+
+/**
+ * Append a record to the ring buffer, or drop it if there is no room
+ */
+void captureRecord( uint32_t module, uint8_t flags, uint8_t address,
+        const uint8_t * data, uint8_t length ) {
+    uint32_t timestamp = DWIRE_CYCLES();
+    uint16_t head = captureHead;
+    uint16_t used = (head + CAPTURE_BUFFER_SIZE - captureTail)
+            % CAPTURE_BUFFER_SIZE;
+
+    // Keep one byte free to tell a full buffer from an empty one
+    if ( used + CAPTURE_HEADER_SIZE + length >= CAPTURE_BUFFER_SIZE ) {
+        captureDropCount = captureDropCount + 1;
+        return;
+    }
+
+    uint8_t header[CAPTURE_HEADER_SIZE] = {
+        (uint8_t) (flags | CAPTURE_MODULE((module - EUSCI_B0_BASE) >> 10)),
+        address, length, (uint8_t) timestamp, (uint8_t) (timestamp >> 8),
+        (uint8_t) (timestamp >> 16), (uint8_t) (timestamp >> 24) };
+
+    for ( int i = 0; i < CAPTURE_HEADER_SIZE; i++ ) {
+        captureBuffer[head] = header[i];
+        head = (head + 1) % CAPTURE_BUFFER_SIZE;
+    }
+    for ( int i = 0; i < length; i++ ) {
+        captureBuffer[head] = data[i];
+        head = (head + 1) % CAPTURE_BUFFER_SIZE;
+    }
+
+    // Publish the record only once it is complete
+    captureHead = head;
+}
+
+/**
+ * Move complete records to the given buffer, as far as they fit
+ */
+uint16_t captureRead( uint8_t * buffer, uint16_t size ) {
+    uint16_t copied = 0;
+    uint16_t tail = captureTail;
+
+    while ( tail != captureHead ) {
+        uint8_t length = captureBuffer[(tail + 2) % CAPTURE_BUFFER_SIZE];
+        uint16_t recordSize = CAPTURE_HEADER_SIZE + length;
+        if ( copied + recordSize > size )
+            break;
+
+        for ( int i = 0; i < recordSize; i++ ) {
+            buffer[copied++] = captureBuffer[tail];
+            tail = (tail + 1) % CAPTURE_BUFFER_SIZE;
+        }
+    }
+
+    captureTail = tail;
+    return copied;
+}
+
+/**
+ * Get the number of records dropped because the buffer was full
+ */
+uint32_t captureDropped( void ) {
+    return captureDropCount;
+}
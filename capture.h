@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DWire: a library to provide full hardware-driven I2C functionality
+ * to the TI MSP432 family of microcontrollers. It is possible to use
+ * this library in Energia (the Arduino port for MSP microcontrollers)
+ * or in other toolchains.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef INCLUDE_CAPTURE_H_
+#define INCLUDE_CAPTURE_H_
+
+#include "DWire.h"
+
+/*
+ * Bus traffic capture. When DWire is built with DWIRE_CAPTURE, the ISR
+ * appends a record for every transfer phase to a RAM ring buffer:
+ *
+ *   byte 0     flags (see below)
+ *   byte 1     7-bit slave address
+ *   byte 2     number of data bytes (n)
+ *   bytes 3-6  timestamp in CPU cycles, little endian
+ *   bytes 7-   n data bytes
+ *
+ * Records that do not fit are dropped whole. The buffer is drained with
+ * captureRead(), e.g. to send it to a host for replay.
+ */
+
+// Size of the ring buffer in bytes
+#ifndef CAPTURE_BUFFER_SIZE
+#define CAPTURE_BUFFER_SIZE 1024
+#endif
+
+#define CAPTURE_HEADER_SIZE 7
+
+// Record flags
+#define CAPTURE_READ        0x01    // Read phase; otherwise write phase
+#define CAPTURE_NAK         0x02    // The address or a byte was NAKed
+#define CAPTURE_STOP        0x04    // Ended with a STOP; otherwise restart
+#define CAPTURE_SLAVE       0x08    // Recorded while acting as slave
+#define CAPTURE_MODULE(x)   (((x) & 0x03) << 4)
+#define CAPTURE_GET_MODULE(flags) (((flags) >> 4) & 0x03)
+
+/**
+ * Enable the cycle counter and clear the buffer
+ */
+void captureBegin( void );
+
+/**
+ * Append a record (called from the ISR)
+ */
+void captureRecord( uint32_t, uint8_t, uint8_t, const uint8_t *, uint8_t );
+
+/**
+ * Move up to the given number of bytes of complete records to a buffer.
+ * Returns the number of bytes copied
+ */
+uint16_t captureRead( uint8_t *, uint16_t );
+
+/**
+ * Get the number of records dropped because the buffer was full
+ */
+uint32_t captureDropped( void );
+
+#endif /* INCLUDE_CAPTURE_H_ */
@@ -86,9 +86,9 @@ int main( void ) {
     wire->onRequest(handleRequest);
     serial->println("Ready as slave.");
 
-    // Loop, with interrupts running the different parts of the slave
+    // Sleep, with interrupts running the different parts of the slave
     while ( 1 )
-    ;
+        wire->sleep( );
 #endif
 }
 
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * ISR benchmark: measures the cycles the DWire ISR spends per byte, for
+ * comparing a flash-resident build with an SRAM-resident one. EUSCI_B0
+ * (P1.6/P1.7) is the master and EUSCI_B1 (P6.4/P6.5) the slave; connect
+ * SDA to SDA and SCL to SCL, with pull-ups. Build it twice:
+ *
+ *   -DDWIRE_PROFILE -DUSING_EUSCI_B0 -DUSING_EUSCI_B1
+ *   -DDWIRE_PROFILE -DUSING_EUSCI_B0 -DUSING_EUSCI_B1 -DDWIRE_SRAM_ISR
+ *
+ * and compare the cycles per byte it prints over the UART.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+/* Custom Includes */
+#include "DWire.h"
+#include "DSerial.h"
+
+#ifndef DWIRE_PROFILE
+#error "The benchmark needs DWIRE_PROFILE"
+#endif
+
+#define SLAVE_ADDRESS 0x42
+#define TRANSFERS 100
+#define MESSAGE_LENGTH 16
+
+DWire * master;
+DWire * slave;
+DSerial * serial;
+
+void handleRequest( void );
+void printResult( const char *, DWire * );
+
+int main( void ) {
+    /* Disabling the Watchdog */
+    MAP_WDT_A_holdTimer( );
+
+    serial = new DSerial( );
+    serial->begin( );
+
+    master = new DWire( );
+    slave = new DWire( );
+    master->begin(EUSCI_B0_BASE);
+    slave->begin(EUSCI_B1_BASE, SLAVE_ADDRESS);
+    slave->onRequest(handleRequest);
+
+#ifdef DWIRE_SRAM_ISR
+    serial->println("ISR in SRAM");
+#else
+    serial->println("ISR in flash");
+#endif
+
+    while ( 1 ) {
+        master->resetProfile( );
+        slave->resetProfile( );
+
+        // Writes: the master transmits, the slave receives
+        for ( int i = 0; i < TRANSFERS; i++ ) {
+            master->beginTransmission(SLAVE_ADDRESS);
+            for ( int j = 0; j < MESSAGE_LENGTH; j++ )
+                master->write(j);
+            master->endTransmission( );
+            while ( master->isBusy( ) )
+                ;
+        }
+        printResult("master tx: ", master);
+        printResult("slave rx:  ", slave);
+
+        master->resetProfile( );
+        slave->resetProfile( );
+
+        // Reads: the slave transmits, the master receives
+        for ( int i = 0; i < TRANSFERS; i++ )
+            master->requestFrom(SLAVE_ADDRESS, MESSAGE_LENGTH);
+        printResult("master rx: ", master);
+        printResult("slave tx:  ", slave);
+
+        serial->println( );
+        for ( int ii = 0; ii < 5000000; ii++ )
+            ;
+    }
+}
+
+/**
+ * Respond with a full message
+ */
+void handleRequest( void ) {
+    for ( int j = 0; j < MESSAGE_LENGTH; j++ )
+        slave->write(j);
+}
+
+/**
+ * Print the ISR cycles per event of a module. Apart from the START and
+ * STOP of each transfer, every event is a byte
+ */
+void printResult( const char * label, DWire * bus ) {
+    uint32_t events = bus->getIrqEvents( );
+
+    serial->print(label);
+    serial->print(events ? bus->getIrqCycles( ) / events : 0, DEC);
+    serial->println(" cycles per event");
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Interrupt decode benchmark: measures the cycles it takes the ISR to find
+ * out which event to handle, once per byte. It compares the driverlib
+ * sequence the ISR used before (MAP_I2C_getEnabledInterruptStatus and
+ * MAP_I2C_clearInterruptFlag) with the single UCBxIV read it uses now, and
+ * prints the difference, which is the saving per byte. Build it with
+ * -DDWIRE_PROFILE (for the cycle counter); only EUSCI_B0 is used and
+ * nothing needs to be connected. examples/ISR_BENCHMARK.cpp measures the
+ * complete ISR per byte.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+/* Custom Includes */
+#include "DWire.h"
+#include "DSerial.h"
+
+#ifndef DWIRE_PROFILE
+#error "The benchmark needs DWIRE_PROFILE"
+#endif
+
+#define ROUNDS 1000
+
+DWire * bus;
+DSerial * serial;
+
+uint32_t driverlibDecode( void );
+uint32_t vectorDecode( void );
+void printResult( const char *, uint32_t );
+
+int main( void ) {
+    /* Disabling the Watchdog */
+    MAP_WDT_A_holdTimer( );
+
+    serial = new DSerial( );
+    serial->begin( );
+
+    // An idle master: no flags are pending, as in the last read of every
+    // ISR invocation
+    bus = new DWire( );
+    bus->begin(EUSCI_B0_BASE);
+
+    // The ISR must not take the reads away from the benchmark
+    MAP_Interrupt_disableInterrupt(INT_EUSCIB0);
+
+    while ( 1 ) {
+        uint32_t before = driverlibDecode( );
+        uint32_t after = vectorDecode( );
+
+        printResult("driverlib: ", before);
+        printResult("UCBxIV:    ", after);
+        printResult("saved:     ", before - after);
+
+        serial->println( );
+        for ( int ii = 0; ii < 5000000; ii++ )
+            ;
+    }
+}
+
+/**
+ * Returns the cycles of ROUNDS decodes through driverlib
+ */
+uint32_t driverlibDecode( void ) {
+    volatile uint_fast16_t status;
+    uint32_t start = DWIRE_CYCLES( );
+
+    for ( int i = 0; i < ROUNDS; i++ ) {
+        status = MAP_I2C_getEnabledInterruptStatus(EUSCI_B0_BASE);
+        MAP_I2C_clearInterruptFlag(EUSCI_B0_BASE, status);
+    }
+    return DWIRE_CYCLES( ) - start;
+}
+
+/**
+ * Returns the cycles of ROUNDS decodes with a UCBxIV read and the event
+ * table lookup
+ */
+uint32_t vectorDecode( void ) {
+    volatile uint_fast8_t event;
+    uint32_t start = DWIRE_CYCLES( );
+
+    for ( int i = 0; i < ROUNDS; i++ ) {
+        uint_fast16_t vector = DWIRE_READ_IV(EUSCI_B0_BASE);
+        event = irqVectorEvents[(vector & (IV_COUNT - 1)) >> 1];
+    }
+    return DWIRE_CYCLES( ) - start;
+}
+
+void printResult( const char * label, uint32_t cycles ) {
+    serial->print(label);
+    serial->print(cycles / ROUNDS, DEC);
+    serial->println(" cycles per decode");
+}
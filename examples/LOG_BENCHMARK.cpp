@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Logging benchmark: compares reporting a temperature as a formatted line
+ * with DSerial::print() and as a binary record with DSerial::log(). For
+ * both it prints the cycles of the calls, which is the time the caller is
+ * busy, and the bytes they queue for the UART, which set how long the
+ * report occupies it. Each call is measured with the transmit buffer
+ * empty. The measured lines and records are sent as well, so in a
+ * terminal the results follow a burst of lines and unprintable bytes.
+ * Nothing needs to be connected.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+/* Custom Includes */
+#include "DWire.h"
+#include "DSerial.h"
+
+#define ROUNDS 10
+
+// The log site of the temperature record
+#define LOG_TEMPERATURE 2
+
+extern volatile uint16_t serialTxHead;
+extern volatile uint16_t serialTxTail;
+
+DSerial * serial;
+
+// In hundredths of a degree
+int32_t temperature = 2345;
+
+void printTemperature( void );
+void logTemperature( void );
+void measure( void (*)( void ), uint32_t *, uint32_t * );
+void printResult( const char *, uint32_t, uint32_t );
+void printRatio( const char *, uint32_t, uint32_t );
+
+int main( void ) {
+    /* Disabling the Watchdog */
+    MAP_WDT_A_holdTimer( );
+
+    serial = new DSerial( );
+    serial->begin( );
+
+    DWIRE_CYCLES_ENABLE();
+
+    while ( 1 ) {
+        uint32_t printCycles, printBytes, logCycles, logBytes;
+        measure(printTemperature, &printCycles, &printBytes);
+        measure(logTemperature, &logCycles, &logBytes);
+
+        printResult("print: ", printCycles, printBytes);
+        printResult("log:   ", logCycles, logBytes);
+        printRatio("cycles: ", printCycles, logCycles);
+        printRatio("bytes:  ", printBytes, logBytes);
+
+        serial->println( );
+        for ( int ii = 0; ii < 5000000; ii++ )
+            ;
+    }
+}
+
+/**
+ * The line a firmware would print without binary logging
+ */
+void printTemperature( void ) {
+    serial->print("temperature ");
+    serial->print(temperature / 100, DEC);
+    serial->print('.');
+    if ( temperature % 100 < 10 )
+        serial->print('0');
+    serial->print(temperature % 100, DEC);
+    serial->println(" C");
+}
+
+/**
+ * The same report as a record
+ */
+void logTemperature( void ) {
+    serial->log(LOG_TEMPERATURE, temperature / 100, temperature % 100);
+}
+
+/**
+ * Sum the cycles and queued bytes of ROUNDS reports, each started with
+ * the transmit buffer empty
+ */
+void measure( void (*report)( void ), uint32_t * cycles, uint32_t * bytes ) {
+    *cycles = 0;
+    *bytes = 0;
+
+    for ( int i = 0; i < ROUNDS; i++ ) {
+        while ( serialTxTail != serialTxHead )
+            ;
+
+        // The ISR may send some of the bytes already: count them at the
+        // head of the buffer
+        uint16_t head = serialTxHead;
+        uint32_t start = DWIRE_CYCLES( );
+        report( );
+        *cycles += DWIRE_CYCLES( ) - start;
+        *bytes += (serialTxHead + SERIAL_TX_BUFFER_SIZE - head)
+                % SERIAL_TX_BUFFER_SIZE;
+    }
+}
+
+void printResult( const char * label, uint32_t cycles, uint32_t bytes ) {
+    serial->print(label);
+    serial->print(cycles / ROUNDS, DEC);
+    serial->print(" cycles, ");
+    serial->print(bytes / ROUNDS, DEC);
+    serial->println(" bytes per report");
+}
+
+/**
+ * Print how many times larger the first value is, with one decimal
+ */
+void printRatio( const char * label, uint32_t text, uint32_t record ) {
+    uint32_t tenths = record ? text * 10 / record : 0;
+    serial->print(label);
+    serial->print(tenths / 10, DEC);
+    serial->print('.');
+    serial->print(tenths % 10, DEC);
+    serial->println(" times as many for print");
+}
@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Host stand-in for the parts of TI's driverlib used by DWire. The eUSCI_B
+ * functions operate on the simulated modules in sim_eusci.cpp, so that
+ * DWire, including its ISR, can be built and run on a PC. The uDMA and
+ * Timer_A functions play DSoftWire's waveforms on simulated ports. Put this
+ * directory in the include path instead of the real driverlib. The i2c-dev
+ * backend (dwire_linux.cpp) only needs the declarations.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef HOST_DRIVERLIB_H_
+#define HOST_DRIVERLIB_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef __MSP432P401R__
+#define __MSP432P401R__
+#endif
+
+/* Module base addresses (only used as identifiers) */
+#define EUSCI_A0_BASE 0x40001000
+#define EUSCI_B0_BASE 0x40002000
+#define EUSCI_B1_BASE 0x40002400
+#define EUSCI_B2_BASE 0x40002800
+#define EUSCI_B3_BASE 0x40002C00
+#define TIMER32_0_BASE 0x4000C000
+#define TIMER32_1_BASE 0x4000C020
+#define TIMER_A0_BASE 0x40000000
+#define TIMER_A1_BASE 0x40000400
+#define TIMER_A2_BASE 0x40000800
+#define TIMER_A3_BASE 0x40000C00
+
+/* Interrupt numbers */
+#define INT_PENDSV 14
+#define FAULT_PENDSV 14
+#define INT_EUSCIA0 32
+#define INT_EUSCIB0 36
+#define INT_EUSCIB1 37
+#define INT_EUSCIB2 38
+#define INT_EUSCIB3 39
+#define INT_T32_INT1 41
+#define INT_T32_INT2 42
+#define INT_DMA_INT0 50
+#define TIMER32_0_INTERRUPT INT_T32_INT1
+#define TIMER32_1_INTERRUPT INT_T32_INT2
+
+#define TIMER32_PRESCALER_1 0x00
+#define TIMER32_32BIT 0x02
+#define TIMER32_PERIODIC_MODE 0x40
+
+#define GPIO_PORT_P1 1
+#define GPIO_PORT_P2 2
+#define GPIO_PORT_P3 3
+#define GPIO_PORT_P4 4
+#define GPIO_PORT_P6 6
+#define GPIO_PIN0 0x0001
+#define GPIO_PIN1 0x0002
+#define GPIO_PIN2 0x0004
+#define GPIO_PIN3 0x0008
+#define GPIO_PIN4 0x0010
+#define GPIO_PIN5 0x0020
+#define GPIO_PIN6 0x0040
+#define GPIO_PIN7 0x0080
+#define GPIO_PRIMARY_MODULE_FUNCTION 0x01
+
+/* eUSCI_B I2C */
+#define EUSCI_B_I2C_CLOCKSOURCE_SMCLK 0x0080
+#define EUSCI_B_I2C_SET_DATA_RATE_1MBPS 1000000
+#define EUSCI_B_I2C_SET_DATA_RATE_400KBPS 400000
+#define EUSCI_B_I2C_SET_DATA_RATE_100KBPS 100000
+#define EUSCI_B_I2C_NO_AUTO_STOP 0x0000
+#define EUSCI_B_I2C_TRANSMIT_MODE 0x0010
+#define EUSCI_B_I2C_RECEIVE_MODE 0x0000
+#define EUSCI_B_I2C_SENDING_STOP 0x0004
+#define EUSCI_B_I2C_STOP_SEND_COMPLETE 0x0000
+#define EUSCI_B_I2C_BUS_BUSY 0x0010
+#define EUSCI_B_I2C_BUS_NOT_BUSY 0x0000
+#define EUSCI_B_I2C_OWN_ADDRESS_OFFSET0 0x00
+#define EUSCI_B_I2C_OWN_ADDRESS_ENABLE 0x0400
+
+#define EUSCI_B_I2C_RECEIVE_INTERRUPT0 0x0001
+#define EUSCI_B_I2C_TRANSMIT_INTERRUPT0 0x0002
+#define EUSCI_B_I2C_START_INTERRUPT 0x0004
+#define EUSCI_B_I2C_STOP_INTERRUPT 0x0008
+#define EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT 0x0010
+#define EUSCI_B_I2C_NAK_INTERRUPT 0x0020
+#define EUSCI_B_I2C_BYTE_COUNTER_INTERRUPT 0x0040
+
+/* eUSCI_A UART */
+#define EUSCI_A_UART_CLOCKSOURCE_SMCLK 0x80
+#define EUSCI_A_UART_NO_PARITY 0x00
+#define EUSCI_A_UART_LSB_FIRST 0x00
+#define EUSCI_A_UART_ONE_STOP_BIT 0x00
+#define EUSCI_A_UART_MODE 0x00
+#define EUSCI_A_UART_OVERSAMPLING_BAUDRATE_GENERATION 0x01
+#define EUSCI_A_UART_RECEIVE_INTERRUPT 0x01
+#define EUSCI_A_UART_TRANSMIT_INTERRUPT 0x02
+#define EUSCI_A_UART_RECEIVE_INTERRUPT_FLAG 0x01
+#define EUSCI_A_UART_TRANSMIT_INTERRUPT_FLAG 0x02
+
+#define CS_DCO_FREQUENCY_48 5
+
+/* uDMA. The channel number is in the low bits of a trigger */
+#define DMA_CH0_TIMERA0CCR0 0x06000000
+#define DMA_CH1_TIMERA0CCR2 0x06000001
+#define DMA_CH2_TIMERA1CCR0 0x06000002
+#define DMA_CH3_TIMERA1CCR2 0x06000003
+#define DMA_CH4_TIMERA2CCR0 0x06000004
+#define DMA_CH5_TIMERA2CCR2 0x06000005
+#define DMA_CH6_TIMERA3CCR0 0x06000006
+#define DMA_CH7_TIMERA3CCR2 0x06000007
+#define DMA_INT0 INT_DMA_INT0
+#define UDMA_PRI_SELECT 0x00000000
+#define UDMA_MODE_BASIC 0x00000001
+#define UDMA_SIZE_8 0x00000000
+#define UDMA_SRC_INC_8 0x00000000
+#define UDMA_SRC_INC_NONE 0x0C000000
+#define UDMA_DST_INC_8 0x00000000
+#define UDMA_DST_INC_NONE 0xC0000000
+#define UDMA_ARB_1 0x00000000
+
+/* Timer_A */
+#define TIMER_A_CLOCKSOURCE_SMCLK 0x0200
+#define TIMER_A_CLOCKSOURCE_DIVIDER_1 0x01
+#define TIMER_A_TAIE_INTERRUPT_DISABLE 0x00
+#define TIMER_A_CCIE_CCR0_INTERRUPT_DISABLE 0x00
+#define TIMER_A_DO_CLEAR 0x0004
+#define TIMER_A_CAPTURECOMPARE_REGISTER_2 0x06
+#define TIMER_A_CAPTURECOMPARE_INTERRUPT_DISABLE 0x00
+#define TIMER_A_OUTPUTMODE_OUTBITVALUE 0x00
+#define TIMER_A_UP_MODE 0x0010
+
+typedef struct {
+    uint_fast16_t clockSource;
+    uint_fast16_t clockSourceDivider;
+    uint_fast16_t timerPeriod;
+    uint_fast16_t timerInterruptEnable_TAIE;
+    uint_fast16_t captureCompareInterruptEnable_CCR0_CCIE;
+    uint_fast16_t timerClear;
+} Timer_A_UpModeConfig;
+
+typedef struct {
+    uint_fast16_t compareRegister;
+    uint_fast16_t compareInterruptEnable;
+    uint_fast16_t compareOutputMode;
+    uint_fast16_t compareValue;
+} Timer_A_CompareModeConfig;
+
+typedef struct {
+    uint_fast8_t selectClockSource;
+    uint32_t i2cClk;
+    uint32_t dataRate;
+    uint_fast8_t byteCounterThreshold;
+    uint_fast8_t autoSTOPGeneration;
+} eUSCI_I2C_MasterConfig;
+
+typedef struct {
+    uint_fast8_t selectClockSource;
+    uint_fast16_t clockPrescalar;
+    uint_fast8_t firstModReg;
+    uint_fast8_t secondModReg;
+    uint_fast8_t parity;
+    uint_fast16_t msborLsbFirst;
+    uint_fast16_t numberofStopBits;
+    uint_fast16_t uartMode;
+    uint_fast8_t overSampling;
+} eUSCI_UART_Config;
+
+void I2C_initMaster( uint32_t, const eUSCI_I2C_MasterConfig * );
+void I2C_initSlave( uint32_t, uint_fast16_t, uint_fast8_t, uint32_t );
+void I2C_enableModule( uint32_t );
+void I2C_disableModule( uint32_t );
+void I2C_setSlaveAddress( uint32_t, uint_fast16_t );
+void I2C_setMode( uint32_t, uint_fast8_t );
+uint8_t I2C_slaveGetData( uint32_t );
+void I2C_slavePutData( uint32_t, uint8_t );
+uint_fast16_t I2C_isBusBusy( uint32_t );
+uint8_t I2C_masterIsStopSent( uint32_t );
+void I2C_masterSendStart( uint32_t );
+void I2C_masterSendMultiByteStart( uint32_t, uint8_t );
+void I2C_masterSendMultiByteNext( uint32_t, uint8_t );
+void I2C_masterSendMultiByteStop( uint32_t );
+void I2C_masterReceiveStart( uint32_t );
+uint8_t I2C_masterReceiveMultiByteNext( uint32_t );
+void I2C_masterReceiveMultiByteStop( uint32_t );
+void I2C_enableInterrupt( uint32_t, uint_fast16_t );
+void I2C_disableInterrupt( uint32_t, uint_fast16_t );
+void I2C_clearInterruptFlag( uint32_t, uint_fast16_t );
+uint_fast16_t I2C_getInterruptStatus( uint32_t, uint16_t );
+uint_fast16_t I2C_getEnabledInterruptStatus( uint32_t );
+void I2C_registerInterrupt( uint32_t, void (*)( void ) );
+
+void GPIO_setAsPeripheralModuleFunctionInputPin( uint_fast8_t, uint_fast16_t,
+        uint_fast8_t );
+void GPIO_setOutputLowOnPin( uint_fast8_t, uint_fast16_t );
+void GPIO_setAsInputPin( uint_fast8_t, uint_fast16_t );
+
+void DMA_enableModule( void );
+void * DMA_getControlBase( void );
+void DMA_setControlBase( void * );
+void DMA_assignChannel( uint32_t );
+void DMA_setChannelControl( uint32_t, uint32_t );
+void DMA_setChannelTransfer( uint32_t, uint32_t, void *, void *, uint32_t );
+void DMA_enableChannel( uint32_t );
+void DMA_clearInterruptFlag( uint32_t );
+uint32_t DMA_getInterruptStatus( void );
+void DMA_registerInterrupt( uint32_t, void (*)( void ) );
+void DMA_enableInterrupt( uint32_t );
+
+void Timer_A_configureUpMode( uint32_t, const Timer_A_UpModeConfig * );
+void Timer_A_initCompare( uint32_t, const Timer_A_CompareModeConfig * );
+void Timer_A_startCounter( uint32_t, uint_fast16_t );
+void Timer_A_stopTimer( uint32_t );
+
+void Interrupt_enableInterrupt( uint32_t );
+void Interrupt_disableInterrupt( uint32_t );
+bool Interrupt_enableMaster( void );
+bool Interrupt_disableMaster( void );
+void Interrupt_registerInterrupt( uint32_t, void (*)( void ) );
+void Interrupt_pendInterrupt( uint32_t );
+void Interrupt_setPriority( uint32_t, uint8_t );
+void Interrupt_enableSleepOnIsrExit( void );
+void Interrupt_disableSleepOnIsrExit( void );
+
+bool UART_initModule( uint32_t, const eUSCI_UART_Config * );
+void UART_enableModule( uint32_t );
+void UART_transmitData( uint32_t, uint_fast8_t );
+uint8_t UART_receiveData( uint32_t );
+void UART_enableInterrupt( uint32_t, uint_fast8_t );
+void UART_disableInterrupt( uint32_t, uint_fast8_t );
+void UART_clearInterruptFlag( uint32_t, uint_fast8_t );
+uint_fast8_t UART_getInterruptStatus( uint32_t, uint_fast8_t );
+uint_fast8_t UART_getEnabledInterruptStatus( uint32_t );
+void UART_registerInterrupt( uint32_t, void (*)( void ) );
+
+uint32_t CS_getSMCLK( void );
+uint32_t CS_getMCLK( void );
+bool Timer32_initModule( uint32_t, uint32_t, uint32_t, uint32_t );
+void Timer32_setCount( uint32_t, uint32_t );
+uint32_t Timer32_getValue( uint32_t );
+void Timer32_startTimer( uint32_t, bool );
+void Timer32_haltTimer( uint32_t );
+void Timer32_enableInterrupt( uint32_t );
+void Timer32_disableInterrupt( uint32_t );
+void Timer32_clearInterruptFlag( uint32_t );
+void Timer32_registerInterrupt( uint32_t, void (*)( void ) );
+
+void CS_setDCOCenteredFrequency( uint32_t );
+void WDT_A_holdTimer( void );
+
+/* No ROM on the host: MAP_ calls go straight to the functions above */
+#define MAP_I2C_initMaster I2C_initMaster
+#define MAP_I2C_initSlave I2C_initSlave
+#define MAP_I2C_enableModule I2C_enableModule
+#define MAP_I2C_disableModule I2C_disableModule
+#define MAP_I2C_setSlaveAddress I2C_setSlaveAddress
+#define MAP_I2C_setMode I2C_setMode
+#define MAP_I2C_slaveGetData I2C_slaveGetData
+#define MAP_I2C_slavePutData I2C_slavePutData
+#define MAP_I2C_isBusBusy I2C_isBusBusy
+#define MAP_I2C_masterIsStopSent I2C_masterIsStopSent
+#define MAP_I2C_masterSendStart I2C_masterSendStart
+#define MAP_I2C_masterSendMultiByteStart I2C_masterSendMultiByteStart
+#define MAP_I2C_masterSendMultiByteNext I2C_masterSendMultiByteNext
+#define MAP_I2C_masterSendMultiByteStop I2C_masterSendMultiByteStop
+#define MAP_I2C_masterReceiveStart I2C_masterReceiveStart
+#define MAP_I2C_masterReceiveMultiByteNext I2C_masterReceiveMultiByteNext
+#define MAP_I2C_masterReceiveMultiByteStop I2C_masterReceiveMultiByteStop
+#define MAP_I2C_enableInterrupt I2C_enableInterrupt
+#define MAP_I2C_disableInterrupt I2C_disableInterrupt
+#define MAP_I2C_clearInterruptFlag I2C_clearInterruptFlag
+#define MAP_I2C_getInterruptStatus I2C_getInterruptStatus
+#define MAP_I2C_getEnabledInterruptStatus I2C_getEnabledInterruptStatus
+#define MAP_I2C_registerInterrupt I2C_registerInterrupt
+#define MAP_GPIO_setAsPeripheralModuleFunctionInputPin \
+        GPIO_setAsPeripheralModuleFunctionInputPin
+#define MAP_GPIO_setOutputLowOnPin GPIO_setOutputLowOnPin
+#define MAP_GPIO_setAsInputPin GPIO_setAsInputPin
+#define MAP_DMA_enableModule DMA_enableModule
+#define MAP_DMA_getControlBase DMA_getControlBase
+#define MAP_DMA_setControlBase DMA_setControlBase
+#define MAP_DMA_assignChannel DMA_assignChannel
+#define MAP_DMA_setChannelControl DMA_setChannelControl
+#define MAP_DMA_setChannelTransfer DMA_setChannelTransfer
+#define MAP_DMA_enableChannel DMA_enableChannel
+#define MAP_DMA_clearInterruptFlag DMA_clearInterruptFlag
+#define MAP_DMA_getInterruptStatus DMA_getInterruptStatus
+#define MAP_DMA_registerInterrupt DMA_registerInterrupt
+#define MAP_DMA_enableInterrupt DMA_enableInterrupt
+#define MAP_Timer_A_configureUpMode Timer_A_configureUpMode
+#define MAP_Timer_A_initCompare Timer_A_initCompare
+#define MAP_Timer_A_startCounter Timer_A_startCounter
+#define MAP_Timer_A_stopTimer Timer_A_stopTimer
+#define MAP_Interrupt_enableInterrupt Interrupt_enableInterrupt
+#define MAP_Interrupt_disableInterrupt Interrupt_disableInterrupt
+#define MAP_Interrupt_enableMaster Interrupt_enableMaster
+#define MAP_Interrupt_disableMaster Interrupt_disableMaster
+#define MAP_Interrupt_registerInterrupt Interrupt_registerInterrupt
+#define MAP_Interrupt_pendInterrupt Interrupt_pendInterrupt
+#define MAP_Interrupt_setPriority Interrupt_setPriority
+#define MAP_Interrupt_enableSleepOnIsrExit Interrupt_enableSleepOnIsrExit
+#define MAP_Interrupt_disableSleepOnIsrExit Interrupt_disableSleepOnIsrExit
+#define MAP_UART_initModule UART_initModule
+#define MAP_UART_enableModule UART_enableModule
+#define MAP_UART_transmitData UART_transmitData
+#define MAP_UART_receiveData UART_receiveData
+#define MAP_UART_enableInterrupt UART_enableInterrupt
+#define MAP_UART_disableInterrupt UART_disableInterrupt
+#define MAP_UART_clearInterruptFlag UART_clearInterruptFlag
+#define MAP_UART_getInterruptStatus UART_getInterruptStatus
+#define MAP_UART_getEnabledInterruptStatus UART_getEnabledInterruptStatus
+#define MAP_UART_registerInterrupt UART_registerInterrupt
+#define MAP_Timer32_initModule Timer32_initModule
+#define MAP_Timer32_setCount Timer32_setCount
+#define MAP_Timer32_getValue Timer32_getValue
+#define MAP_Timer32_startTimer Timer32_startTimer
+#define MAP_Timer32_haltTimer Timer32_haltTimer
+#define MAP_Timer32_enableInterrupt Timer32_enableInterrupt
+#define MAP_Timer32_disableInterrupt Timer32_disableInterrupt
+#define MAP_Timer32_clearInterruptFlag Timer32_clearInterruptFlag
+#define MAP_Timer32_registerInterrupt Timer32_registerInterrupt
+#define MAP_CS_getSMCLK CS_getSMCLK
+#define MAP_CS_getMCLK CS_getMCLK
+#define MAP_WDT_A_holdTimer WDT_A_holdTimer
+
+/* Register accesses of the DWire ISR */
+uint_fast16_t simReadIV( uint32_t );
+uint32_t simCycles( void );
+
+#define DWIRE_READ_IV(module) simReadIV(module)
+#ifdef DWIRE_LINUX
+/* With the i2c-dev backend a cycle is a nanosecond of CLOCK_MONOTONIC */
+uint32_t linuxCycles( void );
+#define DWIRE_CYCLES() linuxCycles()
+#else
+#define DWIRE_CYCLES() simCycles()
+#endif
+
+/* Data registers, as seen by a master; slaves are not simulated */
+#define DWIRE_READ_RXBUF(module) I2C_masterReceiveMultiByteNext(module)
+#define DWIRE_WRITE_TXBUF(module, data) \
+        I2C_masterSendMultiByteNext(module, data)
+#define DWIRE_CYCLES_ENABLE() do { } while (0)
+
+/* Digital I/O registers of the simulated ports, laid out as on the device */
+uint8_t * simPortRegister( uint_fast8_t, uint32_t );
+#define DWIRE_PORT_REG(port, offset) ((uintptr_t) simPortRegister(port, offset))
+
+/* A sleeping slave delivers the pending interrupts instead */
+uint32_t simRun( void );
+#define DWIRE_SLAVE_SLEEP() simRun()
+
+#endif /* HOST_DRIVERLIB_H_ */
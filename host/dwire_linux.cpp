@@ -0,0 +1,848 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DWire on Linux: the master interface of DWire on top of the i2c-dev
+ * driver, so that drivers written against DWire (and DDevice, DRegmap,
+ * DSMBus, DMemory) run unchanged on a Linux board and can be profiled with
+ * the usual host tools. Build this file instead of DWire.cpp and
+ * modulemap.cpp, with -DDWIRE_LINUX and this directory in the include path.
+ *
+ * A transaction, from the first START to the STOP, is collected as a list
+ * of messages and sent with one I2C_RDWR ioctl: writes ended with
+ * endTransmission(false) are queued and go out with the next transfer that
+ * ends with a STOP, joined by repeated STARTs. Adapters that only speak
+ * SMBus (e.g. i2c-stub) get the equivalent I2C_SMBUS commands instead.
+ *
+ * Transfers complete before the call returns; completion callbacks run in
+ * the calling thread. There is no slave mode.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+
+#include "DWire.h"
+
+/**** PRIVATE FUNCTIONS ****/
+
+/**
+ * Update the SMBus PEC (CRC-8, polynomial x^8 + x^2 + x + 1) with a byte
+ */
+static uint8_t crc8( uint8_t crc, uint8_t data ) {
+    crc ^= data;
+    for ( int i = 0; i < 8; i++ )
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    return crc;
+}
+
+/**
+ * Returns the bus number of a module: EUSCI_Bx_BASE is bus x, so that
+ * unchanged firmware code runs; anything else is the bus number itself
+ */
+static unsigned int busNumber( uint_fast32_t module ) {
+    if ( module >= EUSCI_B0_BASE && module <= EUSCI_B3_BASE )
+        return (module - EUSCI_B0_BASE) >> 10;
+    return module;
+}
+
+/**** CONSTRUCTORS ****/
+
+DWire::DWire( void ) {
+    fd = -1;
+    functions = 0;
+    busRole = BUS_ROLE_MASTER;
+    user_onPull = 0;
+}
+
+DWire::~DWire( void ) {
+    if ( fd >= 0 )
+        DWIRE_LINUX_CLOSE(fd);
+}
+
+/**** PUBLIC METHODS ****/
+
+/**
+ * Open the adapter of the given bus (e.g. 1 for /dev/i2c-1). On failure
+ * hasFailed() returns true and errno tells why
+ */
+void DWire::begin( uint_fast32_t module ) {
+    this->module = module;
+
+    busRole = BUS_ROLE_MASTER;
+    slaveAddress = 0;
+    rxReadIndex = 0;
+    rxReadLength = 0;
+    messageCount = 0;
+    txLength = 0;
+    blockRead = false;
+    pecEnabled = false;
+    pec = 0;
+
+    maxRetries = ARBITRATION_RETRIES;
+    maxBackoff = ARBITRATION_BACKOFF;
+    nakDefault.attempts = 1;
+    nakDefault.interval = 0;
+    nakPolicy = nakDefault;
+    backoffSeed = module;
+    stats.arbitrationLost = 0;
+    stats.arbitrationRetries = 0;
+    stats.nakRetries = 0;
+    stats.eventOverflows = 0;
+
+    speedConfig.dataRate = EUSCI_B_I2C_SET_DATA_RATE_400KBPS;
+    masterConfig = &speedConfig;
+
+#ifdef DWIRE_RTOS
+    rtosMutexInit(&busMutex);
+    txLocked = false;
+#endif
+
+    char path[32];
+    snprintf(path, sizeof(path), DWIRE_LINUX_DEVICE, busNumber(module));
+    if ( fd >= 0 )
+        DWIRE_LINUX_CLOSE(fd);
+    fd = DWIRE_LINUX_OPEN(path, O_RDWR);
+
+    functions = 0;
+    gotNAK = fd < 0 || DWIRE_LINUX_IOCTL(fd, I2C_FUNCS, &functions) < 0;
+}
+
+/**
+ * i2c-dev cannot act as a slave: the bus stays unusable
+ */
+void DWire::begin( uint_fast32_t module, uint8_t address ) {
+    this->module = module;
+
+    busRole = BUS_ROLE_SLAVE;
+    slaveAddress = address;
+    gotNAK = true;
+}
+
+/**
+ * Begin a transmission as a master
+ */
+void DWire::beginTransmission( uint_fast8_t slaveAddress ) {
+    if ( busRole != BUS_ROLE_MASTER )
+        return;
+
+    // Hold the bus until the transmission (or the read following it) ends
+    _lockTransmission( );
+
+    this->slaveAddress = slaveAddress;
+    txLength = 0;
+}
+
+/**
+ * Write a single byte. Bytes beyond TX_BUFFER_SIZE are dropped
+ */
+void DWire::write( uint8_t dataByte ) {
+    if ( txLength < TX_BUFFER_SIZE )
+        messageData[messageCount][txLength++] = dataByte;
+}
+
+void DWire::endTransmission( void ) {
+    endTransmission(true);
+}
+
+/**
+ * End the transmission. With a STOP, the queued messages and this one are
+ * sent; without, this one is queued for the next transfer
+ */
+void DWire::endTransmission( bool sendStop ) {
+    if ( busRole != BUS_ROLE_MASTER )
+        return;
+
+    if ( txLength && !_queueWrite( ) )
+        sendStop = true;
+    else if ( sendStop && messageCount ) {
+        _usePolicy(NULL);
+        _beginAttempts( );
+        _flush( );
+    }
+
+    if ( sendStop )
+        _unlockTransmission( );
+}
+
+/**
+ * Request data from a slave, after any pending transmission. Returns the
+ * number of bytes available to read(), or 0 on a NAK
+ */
+uint8_t DWire::requestFrom( uint_fast8_t slaveAddress,
+        uint_fast8_t numBytes ) {
+    if ( busRole != BUS_ROLE_MASTER )
+        return 0;
+
+    if ( numBytes > RX_BUFFER_SIZE )
+        numBytes = RX_BUFFER_SIZE;
+
+    lock( );
+    rxReadIndex = 0;
+    rxReadLength = 0;
+
+    // A write without endTransmission() goes first, as in DWire
+    if ( !txLength || _queueWrite( ) ) {
+        this->slaveAddress = slaveAddress;
+
+        struct i2c_msg * message = &messages[messageCount];
+        if ( !blockRead )
+            _queueRead(rxLocalBuffer, numBytes, 0);
+        else if ( functions & I2C_FUNC_SMBUS_READ_BLOCK_DATA ) {
+            // The adapter stops after the length given by the first byte
+            blockBuffer[0] = pecEnabled ? 2 : 1;
+            _queueRead(blockBuffer, sizeof(blockBuffer), I2C_M_RECV_LEN);
+        } else
+            _queueRead(blockBuffer,
+                    1 + I2C_SMBUS_BLOCK_MAX + (pecEnabled ? 1 : 0), 0);
+
+        _usePolicy(NULL);
+        _beginAttempts( );
+        if ( _flush( ) ) {
+            if ( blockRead ) {
+                numBytes = message->len < RX_BUFFER_SIZE ?
+                        message->len : RX_BUFFER_SIZE;
+                memcpy(rxLocalBuffer, blockBuffer, numBytes);
+            }
+            rxReadLength = numBytes;
+        }
+    }
+    unlock( );
+
+    // Also release the bus held since beginTransmission()
+    _unlockTransmission( );
+    return rxReadLength;
+}
+
+/**
+ * Perform an SMBus block read: the first byte received gives the number of
+ * bytes that follow (plus the PEC, if enabled). Returns the number of bytes
+ * available to read(), including the count byte
+ */
+uint8_t DWire::requestBlock( uint_fast8_t slaveAddress ) {
+    blockRead = true;
+    uint8_t length = requestFrom(slaveAddress, RX_BUFFER_SIZE);
+    blockRead = false;
+    return length;
+}
+
+/**
+ * Returns true if the slave did not acknowledge the last transfer, or the
+ * kernel reported another error (see errno)
+ */
+bool DWire::hasFailed( void ) {
+    return gotNAK;
+}
+
+/**
+ * Enable or disable the SMBus packet error code for the next transaction,
+ * computed here rather than by the kernel; it is switched off again when
+ * the transaction has been sent. Writes that end with a STOP get the PEC
+ * appended; reads must request one extra byte for the PEC sent by the
+ * slave. Needs an adapter with plain I2C transfers
+ */
+void DWire::setPEC( bool enabled ) {
+    pecEnabled = enabled;
+}
+
+/**
+ * Returns true if the PEC received at the end of the last read matched
+ */
+bool DWire::isPECValid( void ) {
+    return pec == 0;
+}
+
+/**
+ * Write txLength bytes, then read rxLength bytes after a repeated start, in
+ * one transaction. The transfer has finished and the callback has run when
+ * this returns. Returns false if the arguments are invalid
+ */
+bool DWire::startTransfer( uint_fast8_t slaveAddress, const uint8_t * txData,
+        uint8_t txLength, uint8_t * rxData, uint8_t rxLength,
+        DWireCallback callback, void * context ) {
+    return startTransfer(slaveAddress, txData, txLength, rxData, rxLength,
+            callback, context, NULL);
+}
+
+/**
+ * As above, with the NAK retry policy of this transaction only. NULL
+ * selects the one set with setNAKRetry()
+ */
+bool DWire::startTransfer( uint_fast8_t slaveAddress, const uint8_t * txData,
+        uint8_t txLength, uint8_t * rxData, uint8_t rxLength,
+        DWireCallback callback, void * context,
+        const DWireNAKPolicy * policy ) {
+    if ( busRole != BUS_ROLE_MASTER )
+        return false;
+
+    if ( txLength > TX_BUFFER_SIZE || rxLength > RX_BUFFER_SIZE
+            || (txLength == 0 && rxLength == 0) )
+        return false;
+
+    lock( );
+    this->slaveAddress = slaveAddress;
+    if ( txLength )
+        memcpy(messageData[messageCount], txData, txLength);
+    this->txLength = txLength;
+
+    bool queued = !txLength || _queueWrite( );
+    if ( queued ) {
+        if ( rxLength )
+            _queueRead(rxData, rxLength, 0);
+        _usePolicy(policy);
+        _beginAttempts( );
+        _flush( );
+    }
+    unlock( );
+
+    if ( queued && callback )
+        callback(context, gotNAK);
+    return queued;
+}
+
+/**
+ * Read length bytes after writing txData. The data is read into
+ * streamBuffer and passed to sink in chunks of up to RX_BUFFER_SIZE bytes,
+ * followed by the callback, before this returns. The first chunk is read
+ * in the transaction of txData, each further one with an I2C_RDWR of its
+ * own (see inc/dwire_linux.h)
+ */
+bool DWire::startStreamRead( uint_fast8_t slaveAddress,
+        const uint8_t * txData, uint8_t txLength, uint32_t length,
+        DWireSink sink, DWireCallback callback, void * context ) {
+    return startStreamRead(slaveAddress, txData, txLength, length, sink,
+            callback, context, NULL);
+}
+
+/**
+ * As above, with the NAK retry policy of this read only. NULL selects the
+ * one set with setNAKRetry()
+ */
+bool DWire::startStreamRead( uint_fast8_t slaveAddress,
+        const uint8_t * txData, uint8_t txLength, uint32_t length,
+        DWireSink sink, DWireCallback callback, void * context,
+        const DWireNAKPolicy * policy ) {
+    if ( busRole != BUS_ROLE_MASTER )
+        return false;
+
+    if ( txLength > TX_BUFFER_SIZE || length == 0 || !sink )
+        return false;
+
+    lock( );
+    this->slaveAddress = slaveAddress;
+    if ( txLength )
+        memcpy(messageData[messageCount], txData, txLength);
+    this->txLength = txLength;
+
+    bool queued = !txLength || _queueWrite( );
+    if ( queued ) {
+        _usePolicy(policy);
+        for ( uint32_t i = 0; i < length; i += RX_BUFFER_SIZE ) {
+            uint16_t chunk = length - i < RX_BUFFER_SIZE ?
+                    length - i : RX_BUFFER_SIZE;
+            _queueRead(streamBuffer, chunk, 0);
+            _beginAttempts( );
+            if ( !_flush( ) )
+                break;
+            sink(context, streamBuffer, chunk);
+        }
+    }
+    unlock( );
+
+    if ( queued && callback )
+        callback(context, gotNAK);
+    return queued;
+}
+
+/**
+ * Transfers finish before the call that starts them returns
+ */
+bool DWire::isBusy( void ) {
+    return false;
+}
+
+/**
+ * Probe every address between SCAN_FIRST_ADDRESS and SCAN_LAST_ADDRESS
+ * with an address-only write (an SMBus quick write). The result is written
+ * to bitmap, which must be SCAN_BITMAP_SIZE bytes
+ */
+bool DWire::startScan( uint8_t * bitmap ) {
+    if ( busRole != BUS_ROLE_MASTER )
+        return false;
+
+    for ( int i = 0; i < SCAN_BITMAP_SIZE; i++ )
+        bitmap[i] = 0;
+
+    lock( );
+    for ( int address = SCAN_FIRST_ADDRESS; address <= SCAN_LAST_ADDRESS;
+            address++ ) {
+        slaveAddress = address;
+        txLength = 0;
+        _queueWrite( );
+
+        // A missing device is not retried
+        _usePolicy(NULL);
+        _beginAttempts( );
+        nakAttemptsLeft = 1;
+        if ( _flush( ) )
+            bitmap[address >> 3] |= 1 << (address & 0x07);
+    }
+    gotNAK = false;
+    unlock( );
+    return true;
+}
+
+bool DWire::scan( uint8_t * bitmap ) {
+    return startScan(bitmap);
+}
+
+/**
+ * Scan several buses, one after the other
+ */
+void DWire::scanAll( DWire ** buses, uint_fast8_t count,
+        uint8_t (*bitmaps)[SCAN_BITMAP_SIZE] ) {
+    for ( int i = 0; i < count; i++ )
+        buses[i]->scan(bitmaps[i]);
+}
+
+/**
+ * Returns true if address was marked as present in a scan bitmap
+ */
+bool DWire::isPresent( const uint8_t * bitmap, uint_fast8_t address ) {
+    return (bitmap[address >> 3] >> (address & 0x07)) & 0x01;
+}
+
+/**
+ * Reads a single byte received by requestFrom(). There is no ISR to wait
+ * for, so 0 is returned if nothing is left
+ */
+uint8_t DWire::read( void ) {
+    if ( rxReadIndex >= rxReadLength )
+        return 0;
+
+    uint8_t byte = rxLocalBuffer[rxReadIndex];
+    rxReadIndex = rxReadIndex + 1;
+
+    // Check whether this was the last byte. If so, reset.
+    if ( rxReadIndex == rxReadLength ) {
+        rxReadIndex = 0;
+        rxReadLength = 0;
+    }
+    return byte;
+}
+
+void DWire::onRequest( void (*islHandle)( void ) ) {
+    user_onRequest = islHandle;
+}
+
+void DWire::onReceive( void (*islHandle)( uint8_t ) ) {
+    user_onReceive = islHandle;
+}
+
+void DWire::onPull( DWireSource source, void * context ) {
+    pullContext = context;
+    user_onPull = source;
+}
+
+#ifdef DWIRE_DEFERRED
+/**
+ * Callbacks already run in the thread that started the transfer
+ */
+void DWire::poll( void ) {
+}
+
+void DWire::usePendSV( void ) {
+}
+#endif
+
+void DWire::sleep( void ) {
+}
+
+void DWire::wake( void ) {
+}
+
+bool DWire::isMaster( void ) {
+    return busRole == BUS_ROLE_MASTER;
+}
+
+/**
+ * Configure how often a transaction is repeated after losing arbitration
+ * (EAGAIN), and the maximum random delay in microseconds before each retry
+ */
+void DWire::setArbitrationRetry( uint8_t retries, uint16_t backoff ) {
+    maxRetries = retries;
+    maxBackoff = backoff;
+}
+
+/**
+ * Configure how many times a transaction is attempted while the slave does
+ * not acknowledge, waiting interval microseconds in between. One attempt
+ * disables retries
+ */
+void DWire::setNAKRetry( uint16_t attempts, uint16_t interval ) {
+    nakDefault.attempts = attempts ? attempts : 1;
+    nakDefault.interval = interval;
+}
+
+/**
+ * The SCL frequency of an adapter is fixed by its driver (e.g. the device
+ * tree's clock-frequency); the rate is only recorded, so that DDevice's
+ * per-device speeds work
+ */
+bool DWire::setSpeed( uint32_t dataRate ) {
+    if ( busRole != BUS_ROLE_MASTER )
+        return false;
+
+    speedConfig.dataRate = dataRate;
+    return true;
+}
+
+uint32_t DWire::getSpeed( void ) {
+    if ( busRole != BUS_ROLE_MASTER )
+        return 0;
+    return masterConfig->dataRate;
+}
+
+/**
+ * Take the bus for a sequence of transfers by the calling thread. Only
+ * needed with DWIRE_RTOS_POSIX; calls may be nested
+ */
+void DWire::lock( void ) {
+#ifdef DWIRE_RTOS
+    rtosMutexLock(&busMutex);
+#endif
+}
+
+void DWire::unlock( void ) {
+#ifdef DWIRE_RTOS
+    rtosMutexUnlock(&busMutex);
+#endif
+}
+
+const DWireStats * DWire::getStats( void ) {
+    return &stats;
+}
+
+#ifdef DWIRE_PROFILE
+/**
+ * There is no ISR to profile; use perf or similar on the host
+ */
+uint32_t DWire::getIrqCycles( void ) {
+    return 0;
+}
+
+uint32_t DWire::getIrqEvents( void ) {
+    return 0;
+}
+
+void DWire::resetProfile( void ) {
+}
+#endif
+
+/**
+ * Nothing to wait for: transfers are synchronous
+ */
+void DWire::_waitEvent( void ) {
+}
+
+/**** PRIVATE METHODS ****/
+
+void DWire::_lockTransmission( void ) {
+#ifdef DWIRE_RTOS
+    rtosMutexLock(&busMutex);
+    if ( txLocked )
+        rtosMutexUnlock(&busMutex);
+    else
+        txLocked = true;
+#endif
+}
+
+void DWire::_unlockTransmission( void ) {
+#ifdef DWIRE_RTOS
+    if ( txLocked ) {
+        txLocked = false;
+        rtosMutexUnlock(&busMutex);
+    }
+#endif
+}
+
+/**
+ * Take the NAK retry policy of a transaction, or the default if NULL
+ */
+void DWire::_usePolicy( const DWireNAKPolicy * policy ) {
+    nakPolicy = policy ? *policy : nakDefault;
+    if ( !nakPolicy.attempts )
+        nakPolicy.attempts = 1;
+}
+
+void DWire::_beginAttempts( void ) {
+    retriesLeft = maxRetries;
+    nakAttemptsLeft = nakPolicy.attempts;
+}
+
+void DWire::_delay( uint32_t us ) {
+    if ( us )
+        usleep(us);
+}
+
+/**
+ * Close the write built by write() as a message of the transaction.
+ * Returns false, dropping the transaction, if DWIRE_LINUX_MESSAGES writes
+ * are queued already
+ */
+bool DWire::_queueWrite( void ) {
+    if ( messageCount == DWIRE_LINUX_MESSAGES ) {
+        messageCount = 0;
+        txLength = 0;
+        gotNAK = true;
+        errno = ENOSPC;
+        return false;
+    }
+
+    struct i2c_msg * message = &messages[messageCount];
+    message->addr = slaveAddress;
+    message->flags = 0;
+    message->len = txLength;
+    message->buf = messageData[messageCount];
+
+    messageCount++;
+    txLength = 0;
+    return true;
+}
+
+/**
+ * Add a read into buffer as the last message of the transaction
+ */
+void DWire::_queueRead( uint8_t * buffer, uint16_t length, uint16_t flags ) {
+    struct i2c_msg * message = &messages[messageCount];
+    message->addr = slaveAddress;
+    message->flags = I2C_M_RD | flags;
+    message->len = length;
+    message->buf = buffer;
+
+    messageCount++;
+}
+
+/**
+ * Send the queued transaction and empty the queue. The length of a block
+ * read is set from its count byte. Returns false on a NAK or error
+ */
+bool DWire::_flush( void ) {
+    bool sent = (functions & I2C_FUNC_I2C) ? _transferI2C( ) :
+            _transferSMBus( );
+
+    struct i2c_msg * last = &messages[messageCount - 1];
+    if ( sent && blockRead ) {
+        uint16_t count = last->buf[0] < I2C_SMBUS_BLOCK_MAX ?
+                last->buf[0] : I2C_SMBUS_BLOCK_MAX;
+        last->len = 1 + count + (pecEnabled ? 1 : 0);
+    }
+
+    // The PEC over a transaction ending with a read, including the
+    // received PEC, is 0 if it matched
+    if ( sent && pecEnabled && (last->flags & I2C_M_RD) )
+        pec = _pec( );
+
+    messageCount = 0;
+    pecEnabled = false;
+    gotNAK = !sent;
+    return sent;
+}
+
+/**
+ * Send the transaction with a single I2C_RDWR, repeating it as the retry
+ * policy allows
+ */
+bool DWire::_transferI2C( void ) {
+    struct i2c_msg * last = &messages[messageCount - 1];
+
+    if ( pecEnabled && !(last->flags & I2C_M_RD) )
+        last->buf[last->len++] = _pec( );
+
+    struct i2c_rdwr_ioctl_data transaction;
+    transaction.msgs = messages;
+    transaction.nmsgs = messageCount;
+
+    while ( DWIRE_LINUX_IOCTL(fd, I2C_RDWR, &transaction) < 0 )
+        if ( !_retryAfter(errno) )
+            return false;
+    return true;
+}
+
+/**
+ * Send the transaction as the SMBus command with the same bytes on the
+ * bus, for adapters without plain I2C transfers. Transactions that have
+ * no such command fail with EOPNOTSUPP
+ */
+bool DWire::_transferSMBus( void ) {
+    struct i2c_msg * first = &messages[0];
+    struct i2c_msg * last = &messages[messageCount - 1];
+    bool isRead = last->flags & I2C_M_RD;
+
+    union i2c_smbus_data data;
+    struct i2c_smbus_ioctl_data command;
+    command.data = &data;
+    command.command = 0;
+
+    // I2C_SMBUS_QUICK is 0, so mark the transactions without a command
+    const uint32_t unsupported = ~0u;
+    command.size = unsupported;
+
+    if ( pecEnabled ) {
+        // Only the kernel's PEC works here, which DWire does not use
+    } else if ( messageCount == 1 && !isRead ) {
+        command.read_write = I2C_SMBUS_WRITE;
+        if ( last->len )
+            command.command = last->buf[0];
+
+        if ( last->len == 0 )
+            command.size = I2C_SMBUS_QUICK;
+        else if ( last->len == 1 )
+            command.size = I2C_SMBUS_BYTE;
+        else if ( last->len == 2 ) {
+            command.size = I2C_SMBUS_BYTE_DATA;
+            data.byte = last->buf[1];
+        } else if ( last->len == 3 ) {
+            command.size = I2C_SMBUS_WORD_DATA;
+            data.word = last->buf[1] | (last->buf[2] << 8);
+        } else if ( last->len <= I2C_SMBUS_BLOCK_MAX + 1 ) {
+            command.size = I2C_SMBUS_I2C_BLOCK_DATA;
+            data.block[0] = last->len - 1;
+            memcpy(&data.block[1], &last->buf[1], last->len - 1);
+        }
+    } else if ( messageCount == 1 ) {
+        command.read_write = I2C_SMBUS_READ;
+        if ( last->len == 1 )
+            command.size = I2C_SMBUS_BYTE;
+    } else if ( messageCount == 2 && isRead && first->len == 1
+            && first->addr == last->addr ) {
+        command.read_write = I2C_SMBUS_READ;
+        command.command = first->buf[0];
+
+        if ( blockRead )
+            command.size = I2C_SMBUS_BLOCK_DATA;
+        else if ( last->len == 1 )
+            command.size = I2C_SMBUS_BYTE_DATA;
+        else if ( last->len == 2 )
+            command.size = I2C_SMBUS_WORD_DATA;
+        else if ( last->len <= I2C_SMBUS_BLOCK_MAX ) {
+            command.size = I2C_SMBUS_I2C_BLOCK_DATA;
+            data.block[0] = last->len;
+        }
+    }
+
+    if ( command.size == unsupported ) {
+        errno = EOPNOTSUPP;
+        return false;
+    }
+
+    if ( DWIRE_LINUX_IOCTL(fd, I2C_SLAVE, last->addr) < 0 )
+        return false;
+
+    while ( DWIRE_LINUX_IOCTL(fd, I2C_SMBUS, &command) < 0 )
+        if ( !_retryAfter(errno) )
+            return false;
+
+    if ( command.read_write == I2C_SMBUS_WRITE )
+        return true;
+
+    switch ( command.size ) {
+    case I2C_SMBUS_BYTE:
+    case I2C_SMBUS_BYTE_DATA:
+        last->buf[0] = data.byte;
+        break;
+    case I2C_SMBUS_WORD_DATA:
+        last->buf[0] = data.word & 0xFF;
+        last->buf[1] = data.word >> 8;
+        break;
+    case I2C_SMBUS_I2C_BLOCK_DATA:
+        memcpy(last->buf, &data.block[1], last->len);
+        break;
+    case I2C_SMBUS_BLOCK_DATA:
+        // The count byte followed by the data, as in a plain block read
+        memcpy(last->buf, data.block, 1 + data.block[0]);
+        break;
+    }
+    return true;
+}
+
+/**
+ * Decide whether to repeat a transaction that failed with the given errno,
+ * and wait as the retry policy asks. Lost arbitration is reported as
+ * EAGAIN; a missing acknowledgement as ENXIO, EREMOTEIO or EIO, depending
+ * on the adapter driver
+ */
+bool DWire::_retryAfter( int error ) {
+    if ( error == EAGAIN ) {
+        stats.arbitrationLost++;
+        if ( !retriesLeft )
+            return false;
+        retriesLeft--;
+        stats.arbitrationRetries++;
+
+        backoffSeed = backoffSeed * 1103515245 + 12345;
+        _delay((backoffSeed >> 16) % (maxBackoff + 1));
+        return true;
+    }
+
+    if ( error == ENXIO || error == EREMOTEIO || error == EIO ) {
+        if ( nakAttemptsLeft <= 1 )
+            return false;
+        nakAttemptsLeft--;
+        stats.nakRetries++;
+
+        _delay(nakPolicy.interval);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Returns the PEC over the address bytes and data of the transaction
+ */
+uint8_t DWire::_pec( void ) {
+    uint8_t crc = 0;
+
+    for ( int i = 0; i < messageCount; i++ ) {
+        bool isRead = messages[i].flags & I2C_M_RD;
+        crc = crc8(crc, (messages[i].addr << 1) | (isRead ? 0x01 : 0x00));
+        for ( int j = 0; j < messages[i].len; j++ )
+            crc = crc8(crc, messages[i].buf[j]);
+    }
+    return crc;
+}
+
+/**** DRIVERLIB CALLS OF THE HELPER CLASSES ****/
+
+/**
+ * No interrupts: there is nothing to hold off
+ */
+bool Interrupt_enableMaster( void ) {
+    return false;
+}
+
+bool Interrupt_disableMaster( void ) {
+    return false;
+}
+
+/**
+ * DWIRE_CYCLES() counts nanoseconds
+ */
+uint32_t CS_getMCLK( void ) {
+    return 1000000000;
+}
+
+uint32_t linuxCycles( void ) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
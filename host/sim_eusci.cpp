@@ -0,0 +1,824 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Simulated eUSCI_B modules for running DWire on a host. Each module can
+ * have a simulated slave attached, which decides whether it acknowledges
+ * and which bytes it returns. Bus events are generated synchronously by
+ * the driverlib calls; simRun() then delivers the pending interrupts.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include "sim_eusci.h"
+
+#define SIM_MODULES 4
+
+// Ports P1 to P10, and the uDMA channels of the four Timer_A modules
+#define SIM_PORTS 10
+#define SIM_DMA_CHANNELS 8
+
+// Offsets of the port registers, as on the device
+#define SIM_PORT_IN 0x00
+#define SIM_PORT_OUT 0x02
+#define SIM_PORT_DIR 0x04
+
+// Upper bound on ISR invocations per simRun(), to catch livelocks
+#define SIM_MAX_INVOCATIONS 1000000
+
+/**
+ * The state of one simulated module
+ */
+typedef struct {
+    // Shared between the application and the interrupt context
+    std::atomic<uint16_t> ie;
+    std::atomic<uint16_t> ifg;
+    bool transmit;
+    bool active;
+    bool stopPending;
+    uint8_t slaveAddress;
+    uint8_t rxBuffer;
+    // The last byte put by a slave, -1 once it has been read
+    int16_t slaveData;
+    // Set by Interrupt_pendInterrupt()
+    bool pended;
+    const SimSlave * slave;
+    void (*handler)( void );
+} SimModule;
+
+SimModule simModules[SIM_MODULES];
+
+// The simulated eUSCI_A0 UART
+uint8_t simUartData;
+bool simUartReceived;
+uint8_t simUartEnabled;
+void (*simUartHandler)( void );
+
+/**
+ * A simulated Timer32 in one-shot mode. No time passes on the simulated
+ * bus, so a running timer expires as soon as nothing else is pending
+ */
+typedef struct {
+    uint32_t count;
+    bool running;
+    bool enabled;
+    void (*handler)( void );
+} SimTimer;
+
+SimTimer simTimers[2];
+
+/**
+ * A slave on two port pins, decoding the waveform bit by bit
+ */
+typedef struct {
+    uint_fast8_t port;
+    uint8_t scl;
+    uint8_t sda;
+    const SimSlave * slave;
+
+    bool active;
+    bool addressing;
+    bool transmit;
+    bool reading;
+    bool masterNAK;
+    bool pullsSDA;
+    uint8_t bit;
+    uint8_t shift;
+} SimPinSlave;
+
+SimPinSlave simPinSlave;
+
+// Digital I/O registers of the ports, at their offsets on the device
+uint8_t simPortRegisters[(SIM_PORTS / 2) * 0x20];
+
+// uDMA channels: the last transfer set up on each, and the done flags
+struct {
+    uint8_t * source;
+    uint8_t * destination;
+    uint32_t length;
+} simDmaChannels[SIM_DMA_CHANNELS];
+uint32_t simDmaStatus;
+bool simDmaPending;
+void (*simDmaHandler)( void );
+
+// PendSV, delivered after the module interrupts
+void (*simPendSVHandler)( void );
+bool simPendSVPending;
+
+// Held while interrupts are disabled or a handler runs, so that simRun()
+// may be called from a thread standing in for the interrupt context
+std::recursive_mutex simInterruptLock;
+thread_local bool simInterruptsDisabled = false;
+
+// Register accesses cannot be interleaved with the interrupt handler
+#define SIM_ATOMIC \
+    std::lock_guard<std::recursive_mutex> guard(simInterruptLock)
+
+/**** PRIVATE FUNCTIONS ****/
+
+static SimModule * getModule( uint32_t module ) {
+    return &simModules[((module - EUSCI_B0_BASE) >> 10) % SIM_MODULES];
+}
+
+static SimTimer * getTimer( uint32_t timer ) {
+    return &simTimers[timer == TIMER32_1_BASE];
+}
+
+/**
+ * Let the pin slave follow the lines after a tick. It changes SDA only
+ * while SCL is low, as a real slave does on the falling edge
+ */
+static void pinSlaveTick( SimPinSlave * pin, bool sclWas, bool sdaWas,
+        bool scl, bool sda ) {
+    const SimSlave * slave = pin->slave;
+
+    // START or repeated START: SDA falls while SCL is high
+    if ( sclWas && scl && sdaWas && !sda ) {
+        pin->active = true;
+        pin->addressing = true;
+        pin->transmit = false;
+        pin->pullsSDA = false;
+        pin->bit = 0;
+        pin->shift = 0;
+        return;
+    }
+
+    // STOP: SDA rises while SCL is high
+    if ( sclWas && scl && !sdaWas && sda ) {
+        if ( pin->active || pin->transmit )
+            slave->stop(slave->context);
+        pin->active = false;
+        pin->transmit = false;
+        pin->pullsSDA = false;
+        return;
+    }
+
+    if ( !pin->active )
+        return;
+
+    if ( !sclWas && scl ) {
+        // Rising edge: data bits are read, the ninth is the acknowledgement
+        if ( pin->bit < 8 ) {
+            if ( !pin->transmit )
+                pin->shift = (pin->shift << 1) | (sda ? 1 : 0);
+        } else if ( pin->transmit )
+            pin->masterNAK = sda;
+        pin->bit++;
+        return;
+    }
+
+    if ( !(sclWas && !scl) )
+        return;
+
+    // Falling edge: drive SDA for the next bit
+    if ( pin->bit == 8 ) {
+        if ( pin->transmit ) {
+            pin->pullsSDA = false;
+        } else if ( pin->addressing ) {
+            pin->reading = pin->shift & 0x01;
+            pin->pullsSDA = slave->address(slave->context, pin->shift >> 1,
+                    pin->reading);
+            if ( !pin->pullsSDA )
+                pin->active = false;
+        } else {
+            slave->write(slave->context, pin->shift);
+            pin->pullsSDA = true;
+        }
+    } else if ( pin->bit == 9 ) {
+        pin->bit = 0;
+        pin->pullsSDA = false;
+        if ( pin->addressing ) {
+            pin->addressing = false;
+            pin->transmit = pin->reading;
+            pin->masterNAK = false;
+        }
+        if ( pin->transmit ) {
+            if ( pin->masterNAK ) {
+                pin->active = false;
+                return;
+            }
+            pin->shift = slave->read(slave->context);
+            pin->pullsSDA = !(pin->shift & 0x80);
+        }
+    } else if ( pin->transmit ) {
+        pin->pullsSDA = !((pin->shift << pin->bit) & 0x80);
+    }
+}
+
+/**
+ * Send the address byte. Returns true if a slave acknowledged
+ */
+static bool sendAddress( SimModule * sim, bool read ) {
+    sim->active = true;
+    sim->stopPending = false;
+    if ( sim->slave
+            && sim->slave->address(sim->slave->context, sim->slaveAddress,
+                    read) )
+        return true;
+
+    sim->ifg |= EUSCI_B_I2C_NAK_INTERRUPT;
+    return false;
+}
+
+static void sendStop( SimModule * sim ) {
+    if ( !sim->active )
+        return;
+
+    sim->active = false;
+    sim->stopPending = false;
+    if ( sim->slave )
+        sim->slave->stop(sim->slave->context);
+    sim->ifg |= EUSCI_B_I2C_STOP_INTERRUPT;
+}
+
+static void receiveByte( SimModule * sim ) {
+    sim->rxBuffer = sim->slave->read(sim->slave->context);
+    sim->ifg |= EUSCI_B_I2C_RECEIVE_INTERRUPT0;
+}
+
+/**** SIMULATOR API ****/
+
+void simAttach( uint32_t module, const SimSlave * slave ) {
+    getModule(module)->slave = slave;
+}
+
+void simAttachPins( uint_fast8_t port, uint8_t scl, uint8_t sda,
+        const SimSlave * slave ) {
+    simPinSlave.port = port;
+    simPinSlave.scl = scl;
+    simPinSlave.sda = sda;
+    simPinSlave.slave = slave;
+    simPinSlave.active = false;
+    simPinSlave.transmit = false;
+    simPinSlave.pullsSDA = false;
+}
+
+uint32_t simRun( void ) {
+    uint32_t invocations = 0;
+    bool pending = true;
+
+    while ( pending && invocations < SIM_MAX_INVOCATIONS ) {
+        pending = false;
+        for ( int i = 0; i < SIM_MODULES; i++ ) {
+            SimModule * sim = &simModules[i];
+            std::lock_guard<std::recursive_mutex> guard(simInterruptLock);
+            if ( ((sim->ifg & sim->ie) || sim->pended) && sim->handler ) {
+                sim->pended = false;
+                sim->handler( );
+                invocations++;
+                pending = true;
+            }
+        }
+
+        std::lock_guard<std::recursive_mutex> guard(simInterruptLock);
+        if ( (simUartEnabled & EUSCI_A_UART_TRANSMIT_INTERRUPT)
+                && simUartHandler ) {
+            simUartHandler( );
+            invocations++;
+            pending = true;
+        }
+
+        if ( simDmaPending && simDmaHandler ) {
+            simDmaPending = false;
+            simDmaHandler( );
+            invocations++;
+            pending = true;
+        }
+
+        if ( !pending && simPendSVPending && simPendSVHandler ) {
+            simPendSVPending = false;
+            simPendSVHandler( );
+            invocations++;
+            pending = true;
+        }
+
+        for ( int i = 0; i < 2 && !pending; i++ ) {
+            SimTimer * timer = &simTimers[i];
+            if ( timer->running && timer->enabled && timer->handler ) {
+                timer->running = false;
+                timer->count = 0;
+                timer->handler( );
+                invocations++;
+                pending = true;
+            }
+        }
+    }
+    return invocations;
+}
+
+void simLoseArbitration( uint32_t module ) {
+    SimModule * sim = getModule(module);
+    sim->active = false;
+    sim->ifg |= EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT;
+}
+
+void simReleaseBus( uint32_t module ) {
+    getModule(module)->ifg |= EUSCI_B_I2C_STOP_INTERRUPT;
+}
+
+uint16_t simInterruptEnables( uint32_t module ) {
+    SIM_ATOMIC;
+    return getModule(module)->ie;
+}
+
+void simMasterWrite( uint32_t module, uint8_t data ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    sim->rxBuffer = data;
+    sim->ifg |= EUSCI_B_I2C_RECEIVE_INTERRUPT0;
+}
+
+int simMasterRead( uint32_t module ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    int data = sim->slaveData;
+    sim->slaveData = -1;
+    return data;
+}
+
+/**
+ * UCBxIV: return the highest-priority enabled flag and clear it
+ */
+uint_fast16_t simReadIV( uint32_t module ) {
+    static const struct {
+        uint16_t flag;
+        uint16_t vector;
+    } priorities[] = {
+        { EUSCI_B_I2C_ARBITRATIONLOST_INTERRUPT, 0x02 },
+        { EUSCI_B_I2C_NAK_INTERRUPT, 0x04 },
+        { EUSCI_B_I2C_START_INTERRUPT, 0x06 },
+        { EUSCI_B_I2C_STOP_INTERRUPT, 0x08 },
+        { EUSCI_B_I2C_RECEIVE_INTERRUPT0, 0x16 },
+        { EUSCI_B_I2C_TRANSMIT_INTERRUPT0, 0x18 },
+    };
+    SimModule * sim = getModule(module);
+
+    for ( unsigned i = 0; i < sizeof(priorities) / sizeof(priorities[0]);
+            i++ ) {
+        if ( sim->ifg & sim->ie & priorities[i].flag ) {
+            sim->ifg &= ~priorities[i].flag;
+            return priorities[i].vector;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Cycles of the MCLK reported by CS_getMCLK(), wrapping like the DWT
+ * cycle counter of the target
+ */
+uint32_t simCycles( void ) {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now( ).time_since_epoch( )).count( );
+    return (uint32_t) (ns * (CS_getMCLK( ) / 1000000) / 1000);
+}
+
+/**** DRIVERLIB: I2C ****/
+
+void I2C_initMaster( uint32_t module, const eUSCI_I2C_MasterConfig * config ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    sim->ifg = 0;
+    sim->active = false;
+    sim->stopPending = false;
+}
+
+void I2C_initSlave( uint32_t module, uint_fast16_t address,
+        uint_fast8_t offset, uint32_t enable ) {
+    SIM_ATOMIC;
+    getModule(module)->ifg = 0;
+    getModule(module)->slaveData = -1;
+}
+
+void I2C_enableModule( uint32_t module ) {
+    SIM_ATOMIC;
+}
+
+void I2C_disableModule( uint32_t module ) {
+    SIM_ATOMIC;
+}
+
+void I2C_setSlaveAddress( uint32_t module, uint_fast16_t address ) {
+    SIM_ATOMIC;
+    getModule(module)->slaveAddress = address;
+}
+
+void I2C_setMode( uint32_t module, uint_fast8_t mode ) {
+    SIM_ATOMIC;
+    getModule(module)->transmit = mode == EUSCI_B_I2C_TRANSMIT_MODE;
+}
+
+uint8_t I2C_slaveGetData( uint32_t module ) {
+    SIM_ATOMIC;
+    return getModule(module)->rxBuffer;
+}
+
+void I2C_slavePutData( uint32_t module, uint8_t data ) {
+    SIM_ATOMIC;
+    getModule(module)->slaveData = data;
+}
+
+uint_fast16_t I2C_isBusBusy( uint32_t module ) {
+    SIM_ATOMIC;
+    return getModule(module)->active ?
+            EUSCI_B_I2C_BUS_BUSY : EUSCI_B_I2C_BUS_NOT_BUSY;
+}
+
+uint8_t I2C_masterIsStopSent( uint32_t module ) {
+    SIM_ATOMIC;
+    // The STOP is generated as soon as it is requested
+    return EUSCI_B_I2C_STOP_SEND_COMPLETE;
+}
+
+void I2C_masterSendStart( uint32_t module ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    if ( sendAddress(sim, !sim->transmit) )
+        sim->ifg |= EUSCI_B_I2C_TRANSMIT_INTERRUPT0;
+}
+
+void I2C_masterSendMultiByteStart( uint32_t module, uint8_t data ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    sim->transmit = true;
+    if ( sendAddress(sim, false) ) {
+        sim->slave->write(sim->slave->context, data);
+        sim->ifg |= EUSCI_B_I2C_TRANSMIT_INTERRUPT0;
+    }
+}
+
+void I2C_masterSendMultiByteNext( uint32_t module, uint8_t data ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    sim->slave->write(sim->slave->context, data);
+    sim->ifg |= EUSCI_B_I2C_TRANSMIT_INTERRUPT0;
+}
+
+void I2C_masterSendMultiByteStop( uint32_t module ) {
+    SIM_ATOMIC;
+    sendStop(getModule(module));
+}
+
+void I2C_masterReceiveStart( uint32_t module ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    sim->transmit = false;
+    if ( sendAddress(sim, true) )
+        receiveByte(sim);
+}
+
+/**
+ * Read the received byte. A STOP requested while the byte was being
+ * received ends the transfer after it; otherwise the next byte follows
+ */
+uint8_t I2C_masterReceiveMultiByteNext( uint32_t module ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    uint8_t data = sim->rxBuffer;
+
+    if ( sim->stopPending )
+        sendStop(sim);
+    else if ( sim->active )
+        receiveByte(sim);
+    return data;
+}
+
+void I2C_masterReceiveMultiByteStop( uint32_t module ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    if ( sim->active )
+        sim->stopPending = true;
+}
+
+void I2C_enableInterrupt( uint32_t module, uint_fast16_t mask ) {
+    SIM_ATOMIC;
+    getModule(module)->ie |= mask;
+}
+
+void I2C_disableInterrupt( uint32_t module, uint_fast16_t mask ) {
+    SIM_ATOMIC;
+    getModule(module)->ie &= ~mask;
+}
+
+void I2C_clearInterruptFlag( uint32_t module, uint_fast16_t mask ) {
+    SIM_ATOMIC;
+    getModule(module)->ifg &= ~mask;
+}
+
+uint_fast16_t I2C_getInterruptStatus( uint32_t module, uint16_t mask ) {
+    SIM_ATOMIC;
+    return getModule(module)->ifg & mask;
+}
+
+uint_fast16_t I2C_getEnabledInterruptStatus( uint32_t module ) {
+    SIM_ATOMIC;
+    SimModule * sim = getModule(module);
+    return sim->ifg & sim->ie;
+}
+
+void I2C_registerInterrupt( uint32_t module, void (*handler)( void ) ) {
+    getModule(module)->handler = handler;
+}
+
+/**** DRIVERLIB: UART ****/
+
+void simUartReceive( uint8_t data ) {
+    SIM_ATOMIC;
+    simUartData = data;
+    simUartReceived = true;
+    if ( (simUartEnabled & EUSCI_A_UART_RECEIVE_INTERRUPT) && simUartHandler )
+        simUartHandler( );
+}
+
+bool UART_initModule( uint32_t module, const eUSCI_UART_Config * config ) {
+    return true;
+}
+
+void UART_enableModule( uint32_t module ) {
+}
+
+void UART_transmitData( uint32_t module, uint_fast8_t data ) {
+    putchar(data);
+    fflush(stdout);
+}
+
+uint8_t UART_receiveData( uint32_t module ) {
+    simUartReceived = false;
+    return simUartData;
+}
+
+void UART_enableInterrupt( uint32_t module, uint_fast8_t mask ) {
+    SIM_ATOMIC;
+    simUartEnabled |= mask;
+}
+
+void UART_disableInterrupt( uint32_t module, uint_fast8_t mask ) {
+    SIM_ATOMIC;
+    simUartEnabled &= ~mask;
+}
+
+void UART_clearInterruptFlag( uint32_t module, uint_fast8_t mask ) {
+}
+
+uint_fast8_t UART_getInterruptStatus( uint32_t module, uint_fast8_t mask ) {
+    // Bytes are sent instantly, so the transmit buffer is always empty
+    uint_fast8_t flags = EUSCI_A_UART_TRANSMIT_INTERRUPT_FLAG;
+    if ( simUartReceived )
+        flags |= EUSCI_A_UART_RECEIVE_INTERRUPT_FLAG;
+    return mask & flags;
+}
+
+uint_fast8_t UART_getEnabledInterruptStatus( uint32_t module ) {
+    return UART_getInterruptStatus(module, simUartEnabled);
+}
+
+void UART_registerInterrupt( uint32_t module, void (*handler)( void ) ) {
+    simUartHandler = handler;
+}
+
+/**** DRIVERLIB: MISCELLANEOUS ****/
+
+void GPIO_setAsPeripheralModuleFunctionInputPin( uint_fast8_t port,
+        uint_fast16_t pins, uint_fast8_t mode ) {
+}
+
+void GPIO_setOutputLowOnPin( uint_fast8_t port, uint_fast16_t pins ) {
+    *simPortRegister(port, SIM_PORT_OUT) &= ~pins;
+}
+
+void GPIO_setAsInputPin( uint_fast8_t port, uint_fast16_t pins ) {
+    *simPortRegister(port, SIM_PORT_DIR) &= ~pins;
+}
+
+/**
+ * The address of a port register. The lines are pulled up, so the input
+ * register reads high unless a pin or the pin slave pulls a line low
+ */
+uint8_t * simPortRegister( uint_fast8_t port, uint32_t offset ) {
+    return &simPortRegisters[((port - 1) >> 1) * 0x20 + ((port - 1) & 1)
+            + offset];
+}
+
+/**** DRIVERLIB: UDMA AND TIMER_A ****/
+
+void DMA_enableModule( void ) {
+}
+
+void * DMA_getControlBase( void ) {
+    return NULL;
+}
+
+void DMA_setControlBase( void * table ) {
+}
+
+void DMA_assignChannel( uint32_t trigger ) {
+}
+
+void DMA_setChannelControl( uint32_t channel, uint32_t control ) {
+}
+
+void DMA_setChannelTransfer( uint32_t channel, uint32_t mode, void * source,
+        void * destination, uint32_t length ) {
+    SIM_ATOMIC;
+    channel &= SIM_DMA_CHANNELS - 1;
+    simDmaChannels[channel].source = (uint8_t *) source;
+    simDmaChannels[channel].destination = (uint8_t *) destination;
+    simDmaChannels[channel].length = length;
+}
+
+void DMA_enableChannel( uint32_t channel ) {
+}
+
+void DMA_clearInterruptFlag( uint32_t channel ) {
+    SIM_ATOMIC;
+    simDmaStatus &= ~(1 << channel);
+}
+
+uint32_t DMA_getInterruptStatus( void ) {
+    SIM_ATOMIC;
+    return simDmaStatus;
+}
+
+void DMA_registerInterrupt( uint32_t interrupt, void (*handler)( void ) ) {
+    simDmaHandler = handler;
+}
+
+void DMA_enableInterrupt( uint32_t interrupt ) {
+}
+
+void Timer_A_configureUpMode( uint32_t timer,
+        const Timer_A_UpModeConfig * config ) {
+}
+
+void Timer_A_initCompare( uint32_t timer,
+        const Timer_A_CompareModeConfig * config ) {
+}
+
+/**
+ * Play the waveform of the timer's drive channel (TAxCCR0 triggers channel
+ * 2x) and fill its sample channel (TAxCCR2, channel 2x + 1), one sample
+ * before and one after each tick. Both channels are then done
+ */
+void Timer_A_startCounter( uint32_t timer, uint_fast16_t mode ) {
+    SIM_ATOMIC;
+    uint8_t index = ((timer - TIMER_A0_BASE) >> 10) % (SIM_DMA_CHANNELS / 2);
+    uint8_t driveChannel = 2 * index;
+    uint8_t sampleChannel = driveChannel + 1;
+    SimPinSlave * pin = &simPinSlave;
+
+    uint8_t * dir = simDmaChannels[driveChannel].destination;
+    uint8_t * in = dir - SIM_PORT_DIR + SIM_PORT_IN;
+    uint8_t * samples = simDmaChannels[sampleChannel].destination;
+    bool attached = pin->slave
+            && in == simPortRegister(pin->port, SIM_PORT_IN);
+
+    bool scl = true;
+    bool sda = true;
+    *in = 0xFF;
+    samples[0] = *in;
+    for ( uint32_t i = 0; i < simDmaChannels[driveChannel].length; i++ ) {
+        *dir = simDmaChannels[driveChannel].source[i];
+
+        // An output pin drives its line low
+        uint8_t lines = ~*dir;
+        if ( attached ) {
+            bool sclWas = scl;
+            bool sdaWas = sda;
+            scl = lines & pin->scl;
+            sda = (lines & pin->sda) && !pin->pullsSDA;
+            pinSlaveTick(pin, sclWas, sdaWas, scl, sda);
+            if ( pin->pullsSDA )
+                lines &= ~pin->sda;
+        }
+        *in = lines;
+        samples[i + 1] = *in;
+    }
+
+    simDmaStatus |= (1 << driveChannel) | (1 << sampleChannel);
+    simDmaPending = true;
+}
+
+void Timer_A_stopTimer( uint32_t timer ) {
+}
+
+void Interrupt_enableInterrupt( uint32_t interrupt ) {
+}
+
+void Interrupt_disableInterrupt( uint32_t interrupt ) {
+}
+
+/**
+ * Returns true if interrupts were disabled before the call
+ */
+bool Interrupt_enableMaster( void ) {
+    bool wasDisabled = simInterruptsDisabled;
+    if ( wasDisabled ) {
+        simInterruptsDisabled = false;
+        simInterruptLock.unlock( );
+    }
+    return wasDisabled;
+}
+
+bool Interrupt_disableMaster( void ) {
+    bool wasDisabled = simInterruptsDisabled;
+    if ( !wasDisabled ) {
+        simInterruptLock.lock( );
+        simInterruptsDisabled = true;
+    }
+    return wasDisabled;
+}
+
+void Interrupt_registerInterrupt( uint32_t interrupt,
+        void (*handler)( void ) ) {
+    if ( interrupt == FAULT_PENDSV )
+        simPendSVHandler = handler;
+}
+
+void Interrupt_pendInterrupt( uint32_t interrupt ) {
+    if ( interrupt == FAULT_PENDSV )
+        simPendSVPending = true;
+    else if ( interrupt >= INT_EUSCIB0 && interrupt <= INT_EUSCIB3 )
+        simModules[interrupt - INT_EUSCIB0].pended = true;
+}
+
+void Interrupt_setPriority( uint32_t interrupt, uint8_t priority ) {
+}
+
+void Interrupt_enableSleepOnIsrExit( void ) {
+}
+
+void Interrupt_disableSleepOnIsrExit( void ) {
+}
+
+/**** DRIVERLIB: TIMER32 ****/
+
+bool Timer32_initModule( uint32_t timer, uint32_t prescaler,
+        uint32_t resolution, uint32_t mode ) {
+    SIM_ATOMIC;
+    getTimer(timer)->running = false;
+    return true;
+}
+
+void Timer32_setCount( uint32_t timer, uint32_t count ) {
+    SIM_ATOMIC;
+    getTimer(timer)->count = count;
+}
+
+/**
+ * The count left, or 0 once the timer has expired
+ */
+uint32_t Timer32_getValue( uint32_t timer ) {
+    SIM_ATOMIC;
+    return getTimer(timer)->count;
+}
+
+void Timer32_startTimer( uint32_t timer, bool oneShot ) {
+    SIM_ATOMIC;
+    getTimer(timer)->running = true;
+}
+
+void Timer32_haltTimer( uint32_t timer ) {
+    SIM_ATOMIC;
+    getTimer(timer)->running = false;
+}
+
+void Timer32_enableInterrupt( uint32_t timer ) {
+    SIM_ATOMIC;
+    getTimer(timer)->enabled = true;
+}
+
+void Timer32_disableInterrupt( uint32_t timer ) {
+    SIM_ATOMIC;
+    getTimer(timer)->enabled = false;
+}
+
+void Timer32_clearInterruptFlag( uint32_t timer ) {
+}
+
+void Timer32_registerInterrupt( uint32_t interrupt,
+        void (*handler)( void ) ) {
+    simTimers[interrupt == TIMER32_1_INTERRUPT].handler = handler;
+}
+
+/**** DRIVERLIB: CLOCK SYSTEM ****/
+
+uint32_t CS_getSMCLK( void ) {
+    return 12000000;
+}
+
+uint32_t CS_getMCLK( void ) {
+    return 48000000;
+}
+
+void CS_setDCOCenteredFrequency( uint32_t frequency ) {
+}
+
+void WDT_A_holdTimer( void ) {
+}
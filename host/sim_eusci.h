@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Simulated eUSCI_B modules for running DWire on a host. Each module can
+ * have a simulated slave attached, which decides whether it acknowledges
+ * and which bytes it returns. Bus events are generated synchronously by
+ * the driverlib calls; simRun() then delivers the pending interrupts.
+ * Slaves can also be attached to port pins, to run DSoftWire.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef HOST_SIM_EUSCI_H_
+#define HOST_SIM_EUSCI_H_
+
+#include "driverlib.h"
+
+/**
+ * Behaviour of the slave(s) on a simulated bus
+ */
+typedef struct {
+    // Called for every address byte; return true to acknowledge
+    bool (*address)( void *, uint8_t, bool );
+    // Called with every byte written by the master
+    void (*write)( void *, uint8_t );
+    // Called for every byte read by the master
+    uint8_t (*read)( void * );
+    // Called on a STOP
+    void (*stop)( void * );
+    void * context;
+} SimSlave;
+
+/**
+ * Attach a slave to the given module
+ */
+void simAttach( uint32_t, const SimSlave * );
+
+/**
+ * Deliver pending interrupts until none are left. Returns the number of
+ * ISR invocations
+ */
+uint32_t simRun( void );
+
+/**
+ * Attach a slave to two pins of a simulated port, for DSoftWire. The slave
+ * decodes the waveform the uDMA plays on the port and drives SDA for its
+ * acknowledgements and read data
+ */
+void simAttachPins( uint_fast8_t, uint8_t, uint8_t, const SimSlave * );
+
+/**
+ * Raise an arbitration-lost interrupt on the given module
+ */
+void simLoseArbitration( uint32_t );
+
+/**
+ * Raise the STOP interrupt of the master that won the arbitration
+ */
+void simReleaseBus( uint32_t );
+
+/**
+ * The enabled interrupts of a module
+ */
+uint16_t simInterruptEnables( uint32_t );
+
+/**
+ * Act as a remote master towards a module in slave mode: write the byte
+ * it receives next, or take the byte it has put for the master (-1 if
+ * none)
+ */
+void simMasterWrite( uint32_t, uint8_t );
+int simMasterRead( uint32_t );
+
+/**
+ * Receive a byte on the simulated UART (eUSCI_A0). Transmitted bytes go to
+ * stdout
+ */
+void simUartReceive( uint8_t );
+
+#endif /* HOST_SIM_EUSCI_H_ */
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * A stand-in for an i2c-dev adapter. The transfers are turned into the
+ * bus events a slave sees (address bytes, data bytes and the STOP), with
+ * the checks and error codes of the kernel where the backend depends on
+ * them.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "sim_i2cdev.h"
+
+// Any valid file descriptor number
+#define SIM_I2CDEV_FD 3
+
+const SimSlave * simI2cdevSlave;
+unsigned long simI2cdevFunctions = I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+uint16_t simI2cdevAddress;
+
+SimI2cTransaction simI2cdevTransaction;
+uint32_t simI2cdevTransactions;
+
+/**** PRIVATE FUNCTIONS ****/
+
+/**
+ * Address the slave after a (repeated) START. Returns false on a NAK
+ */
+static bool simAddress( uint16_t address, bool read ) {
+    return simI2cdevSlave
+            && simI2cdevSlave->address(simI2cdevSlave->context, address, read);
+}
+
+static void simWrite( uint8_t data ) {
+    simI2cdevSlave->write(simI2cdevSlave->context, data);
+}
+
+static uint8_t simRead( void ) {
+    return simI2cdevSlave->read(simI2cdevSlave->context);
+}
+
+static void simStop( void ) {
+    if ( simI2cdevSlave )
+        simI2cdevSlave->stop(simI2cdevSlave->context);
+}
+
+/**
+ * Keep a copy of the messages as they were passed in
+ */
+static void simRecordMessages( const struct i2c_rdwr_ioctl_data * rdwr ) {
+    SimI2cTransaction * record = &simI2cdevTransaction;
+    memset(record, 0, sizeof(*record));
+    record->request = I2C_RDWR;
+    record->count = rdwr->nmsgs;
+
+    for ( uint32_t i = 0; i < rdwr->nmsgs && i < SIM_I2CDEV_MESSAGES; i++ ) {
+        const struct i2c_msg * message = &rdwr->msgs[i];
+        SimI2cMessage * copy = &record->messages[i];
+        copy->addr = message->addr;
+        copy->flags = message->flags;
+        copy->len = message->len;
+
+        uint16_t length = (message->flags & I2C_M_RD) ? 1 : message->len;
+        if ( length > SIM_I2CDEV_DATA )
+            length = SIM_I2CDEV_DATA;
+        if ( message->len )
+            memcpy(copy->data, message->buf, length);
+    }
+    simI2cdevTransactions++;
+}
+
+/**
+ * I2C_RDWR: the messages joined by repeated STARTs, and a STOP. A block
+ * read (I2C_M_RECV_LEN) comes with buf[0] set to the bytes to read after
+ * the count, 1 or 2 with the PEC, and a buffer for the longest block
+ */
+static int simTransfer( struct i2c_rdwr_ioctl_data * rdwr ) {
+    if ( !(simI2cdevFunctions & I2C_FUNC_I2C) ) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    if ( rdwr->nmsgs == 0 || rdwr->nmsgs > I2C_RDWR_IOCTL_MAX_MSGS ) {
+        errno = EINVAL;
+        return -1;
+    }
+    for ( uint32_t i = 0; i < rdwr->nmsgs; i++ ) {
+        struct i2c_msg * message = &rdwr->msgs[i];
+        if ( (message->flags & I2C_M_RECV_LEN)
+                && (!(message->flags & I2C_M_RD) || message->len < 1
+                        || message->buf[0] < 1
+                        || message->len
+                                < message->buf[0] + I2C_SMBUS_BLOCK_MAX) ) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    simRecordMessages(rdwr);
+
+    for ( uint32_t i = 0; i < rdwr->nmsgs; i++ ) {
+        struct i2c_msg * message = &rdwr->msgs[i];
+        bool read = message->flags & I2C_M_RD;
+        if ( !simAddress(message->addr, read) ) {
+            simStop( );
+            errno = ENXIO;
+            return -1;
+        }
+
+        if ( !read ) {
+            for ( uint16_t j = 0; j < message->len; j++ )
+                simWrite(message->buf[j]);
+            continue;
+        }
+
+        uint16_t length = message->len;
+        uint16_t j = 0;
+        if ( message->flags & I2C_M_RECV_LEN ) {
+            uint8_t extra = message->buf[0];
+            message->buf[j++] = simRead( );
+            if ( message->buf[0] > I2C_SMBUS_BLOCK_MAX ) {
+                simStop( );
+                errno = EPROTO;
+                return -1;
+            }
+            length = extra + message->buf[0];
+        }
+        for ( ; j < length; j++ )
+            message->buf[j] = simRead( );
+    }
+    simStop( );
+    return rdwr->nmsgs;
+}
+
+/**
+ * I2C_SMBUS: the command as the kernel puts it on the bus
+ */
+static int simCommand( struct i2c_smbus_ioctl_data * command ) {
+    SimI2cTransaction * record = &simI2cdevTransaction;
+    memset(record, 0, sizeof(*record));
+    record->request = I2C_SMBUS;
+    record->address = simI2cdevAddress;
+    record->readWrite = command->read_write;
+    record->command = command->command;
+    record->size = command->size;
+    simI2cdevTransactions++;
+
+    bool read = command->read_write == I2C_SMBUS_READ;
+    union i2c_smbus_data * data = command->data;
+
+    // Quick commands and single bytes have no command byte
+    if ( command->size == I2C_SMBUS_QUICK
+            || (command->size == I2C_SMBUS_BYTE && read) ) {
+        if ( !simAddress(simI2cdevAddress, read) ) {
+            simStop( );
+            errno = ENXIO;
+            return -1;
+        }
+        if ( command->size == I2C_SMBUS_BYTE )
+            data->byte = simRead( );
+        simStop( );
+        return 0;
+    }
+
+    if ( !simAddress(simI2cdevAddress, false) ) {
+        simStop( );
+        errno = ENXIO;
+        return -1;
+    }
+    simWrite(command->command);
+
+    if ( !read ) {
+        switch ( command->size ) {
+        case I2C_SMBUS_BYTE_DATA:
+            simWrite(data->byte);
+            break;
+        case I2C_SMBUS_WORD_DATA:
+            simWrite(data->word & 0xFF);
+            simWrite(data->word >> 8);
+            break;
+        case I2C_SMBUS_BLOCK_DATA:
+            simWrite(data->block[0]);
+            // Fall through
+        case I2C_SMBUS_I2C_BLOCK_DATA:
+            for ( uint8_t i = 0; i < data->block[0]; i++ )
+                simWrite(data->block[1 + i]);
+            break;
+        }
+        simStop( );
+        return 0;
+    }
+
+    if ( !simAddress(simI2cdevAddress, true) ) {
+        simStop( );
+        errno = ENXIO;
+        return -1;
+    }
+
+    uint8_t length = 0;
+    switch ( command->size ) {
+    case I2C_SMBUS_BYTE_DATA:
+        data->byte = simRead( );
+        break;
+    case I2C_SMBUS_WORD_DATA:
+        data->word = simRead( );
+        data->word |= simRead( ) << 8;
+        break;
+    case I2C_SMBUS_BLOCK_DATA:
+        data->block[0] = simRead( );
+        if ( data->block[0] > I2C_SMBUS_BLOCK_MAX ) {
+            simStop( );
+            errno = EPROTO;
+            return -1;
+        }
+        // Fall through
+    case I2C_SMBUS_I2C_BLOCK_DATA:
+        length = data->block[0];
+        for ( uint8_t i = 0; i < length; i++ )
+            data->block[1 + i] = simRead( );
+        break;
+    }
+    simStop( );
+    return 0;
+}
+
+/**** PUBLIC FUNCTIONS ****/
+
+void simI2cdevSetFunctions( unsigned long functions ) {
+    simI2cdevFunctions = functions;
+}
+
+void simI2cdevAttach( const SimSlave * slave ) {
+    simI2cdevSlave = slave;
+}
+
+uint32_t simI2cdevCount( void ) {
+    return simI2cdevTransactions;
+}
+
+const SimI2cTransaction * simI2cdevLast( void ) {
+    return &simI2cdevTransaction;
+}
+
+int simI2cdevOpen( const char * path, int flags ) {
+    return SIM_I2CDEV_FD;
+}
+
+int simI2cdevClose( int fd ) {
+    return 0;
+}
+
+int simI2cdevIoctl( int fd, unsigned long request, ... ) {
+    if ( fd != SIM_I2CDEV_FD ) {
+        errno = EBADF;
+        return -1;
+    }
+
+    va_list args;
+    va_start(args, request);
+    int result = 0;
+
+    switch ( request ) {
+    case I2C_FUNCS:
+        *va_arg(args, unsigned long *) = simI2cdevFunctions;
+        break;
+    case I2C_SLAVE:
+        simI2cdevAddress = va_arg(args, int);
+        break;
+    case I2C_RDWR:
+        result = simTransfer(va_arg(args, struct i2c_rdwr_ioctl_data *));
+        break;
+    case I2C_SMBUS:
+        result = simCommand(va_arg(args, struct i2c_smbus_ioctl_data *));
+        break;
+    default:
+        errno = ENOTTY;
+        result = -1;
+    }
+
+    va_end(args);
+    return result;
+}
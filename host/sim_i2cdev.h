@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * A stand-in for an i2c-dev adapter, to run the Linux backend without a
+ * kernel. Built with -DDWIRE_LINUX_SIM, the backend's open, close and
+ * ioctl calls come here: I2C_RDWR and I2C_SMBUS are played against a
+ * simulated slave, and each of them is recorded as the backend passed it,
+ * so that tests can check the layout of the transactions.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef HOST_SIM_I2CDEV_H_
+#define HOST_SIM_I2CDEV_H_
+
+#include "sim_eusci.h"
+
+// Recorded messages per transaction, and bytes per message
+#define SIM_I2CDEV_MESSAGES 16
+#define SIM_I2CDEV_DATA 40
+
+/**
+ * A message of an I2C_RDWR transaction, as it was passed in. data holds
+ * the bytes of a write, or the first byte of the buffer of a read
+ */
+typedef struct {
+    uint16_t addr;
+    uint16_t flags;
+    uint16_t len;
+    uint8_t data[SIM_I2CDEV_DATA];
+} SimI2cMessage;
+
+/**
+ * An I2C_RDWR or I2C_SMBUS ioctl that reached the adapter
+ */
+typedef struct {
+    unsigned long request;
+    uint8_t count;
+    SimI2cMessage messages[SIM_I2CDEV_MESSAGES];
+
+    // I2C_SMBUS: the address set with I2C_SLAVE, and the command
+    uint16_t address;
+    uint8_t readWrite;
+    uint8_t command;
+    uint32_t size;
+} SimI2cTransaction;
+
+/**
+ * Set the I2C_FUNCS of the adapter. Without I2C_FUNC_I2C, I2C_RDWR fails
+ */
+void simI2cdevSetFunctions( unsigned long );
+
+/**
+ * Attach the slave(s) on the bus of the adapter
+ */
+void simI2cdevAttach( const SimSlave * );
+
+/**
+ * The number of transactions so far, and the last one
+ */
+uint32_t simI2cdevCount( void );
+const SimI2cTransaction * simI2cdevLast( void );
+
+/**
+ * The calls replacing open, close and ioctl
+ */
+int simI2cdevOpen( const char *, int );
+int simI2cdevClose( int );
+int simI2cdevIoctl( int, unsigned long, ... );
+
+#endif /* HOST_SIM_I2CDEV_H_ */
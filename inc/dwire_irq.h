@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DWire: a library to provide full hardware-driven I2C functionality
+ * to the TI MSP432 family of microcontrollers. It is possible to use
+ * this library in Energia (the Arduino port for MSP microcontrollers)
+ * or in other toolchains.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef INCLUDE_DWIRE_IRQ_H_
+#define INCLUDE_DWIRE_IRQ_H_
+
+class DWire;
+
+/**
+ * The states of a module's transfer state machine
+ */
+enum {
+    STATE_IDLE = 0,     // Master, no transfer in progress
+    STATE_MASTER_TX,    // Master, sending the tx buffer
+    STATE_MASTER_RX,    // Master, receiving into the rx buffer
+    STATE_MASTER_STREAM, // Master, receiving chunks for a sink
+    STATE_SCAN,         // Master, probing addresses
+    STATE_SLAVE_IDLE,   // Slave, waiting to be addressed
+    STATE_SLAVE_RX,     // Slave, receiving from a master
+    STATE_SLAVE_TX,     // Slave, responding to a request
+    STATE_ARBITRATION,  // Lost arbitration, waiting for the bus to be free
+    STATE_NAK_RETRY,    // Got a NAK, waiting for the STOP before retrying
+    STATE_RETRY_WAIT,   // Waiting for the retry timer before restarting
+    STATE_COUNT
+};
+
+/**
+ * The interrupt sources driving the state machine
+ */
+enum {
+    EVENT_RX = 0,
+    EVENT_TX,
+    EVENT_NAK,
+    EVENT_STOP,
+    EVENT_ARBITRATION,
+    EVENT_TIMER,        // The retry timer has expired (not a UCBxIV source)
+    EVENT_COUNT,
+    EVENT_NONE = EVENT_COUNT
+};
+
+/**
+ * The values of UCBxIV in I2C mode. Reading the register returns the
+ * highest-priority pending source and clears its flag
+ */
+#define IV_NONE         0x00
+#define IV_ALIFG        0x02
+#define IV_NACKIFG      0x04
+#define IV_STTIFG       0x06
+#define IV_STPIFG       0x08
+#define IV_RXIFG0       0x16
+#define IV_TXIFG0       0x18
+#define IV_COUNT        0x20
+
+/**
+ * A data structure containing pointers to relevant buffers
+ * to be used by ISRs. There is one per module.
+ */
+typedef struct {
+    uint32_t module;
+    DWire * instance;
+    volatile uint8_t state;
+    uint8_t * rxBuffer;
+    uint8_t * rxBufferIndex;
+    uint8_t * rxBufferSize;
+    uint8_t * txBuffer;
+    uint8_t * txBufferIndex;
+    uint8_t * txBufferSize;
+
+    // SMBus: running packet error code and block read mode
+    bool pecEnabled;
+    bool blockRead;
+    uint8_t pec;
+
+    // Retry timer: ticks left until the restart, and set once it is due
+    uint32_t interrupt;
+    uint32_t retryTicks;
+    volatile bool retryDue;
+#ifdef DWIRE_PROFILE
+    uint32_t irqCycles;
+    uint32_t irqEvents;
+#endif
+#ifdef DWIRE_RTOS
+    // Given by the ISR whenever the state changes
+    RTOSSemaphore stateChanged;
+#endif
+} IRQParam;
+
+/**
+ * A transition performs the actions for an event and returns the next state
+ */
+typedef uint8_t (*IRQTransition)( IRQParam * );
+
+extern const IRQTransition irqTransitions[STATE_COUNT][EVENT_COUNT];
+extern const uint8_t irqVectorEvents[IV_COUNT >> 1];
+extern const uint8_t crc8Table[256];
+
+/**
+ * The parameters of the enabled modules. Host tests drive single
+ * transitions with them (see tools/dwire_transition_test.cpp)
+ */
+#ifdef USING_EUSCI_B0
+extern IRQParam EUSCIB0_irqParam;
+#endif
+#ifdef USING_EUSCI_B1
+extern IRQParam EUSCIB1_irqParam;
+#endif
+#ifdef USING_EUSCI_B2
+extern IRQParam EUSCIB2_irqParam;
+#endif
+#ifdef USING_EUSCI_B3
+extern IRQParam EUSCIB3_irqParam;
+#endif
+
+/**
+ * The main IRQ handling function
+ */
+void IRQHandler( IRQParam * );
+
+#endif /* INCLUDE_DWIRE_IRQ_H_ */
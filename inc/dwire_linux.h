@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DWire: a library to provide full hardware-driven I2C functionality
+ * to the TI MSP432 family of microcontrollers. It is possible to use
+ * this library in Energia (the Arduino port for MSP microcontrollers)
+ * or in other toolchains.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef INCLUDE_DWIRE_LINUX_H_
+#define INCLUDE_DWIRE_LINUX_H_
+
+/*
+ * Linux backend (-DDWIRE_LINUX, built from host/dwire_linux.cpp instead of
+ * DWire.cpp). A master talks to /dev/i2c-N through the i2c-dev driver: the
+ * messages of one transaction, from the first START to the STOP, are
+ * collected and handed to the kernel with a single I2C_RDWR ioctl.
+ */
+
+#include <linux/i2c.h>
+
+// Writes that endTransmission(false) can queue before the transaction is
+// sent. The kernel accepts at most I2C_RDWR_IOCTL_MAX_MSGS (42) messages
+#ifndef DWIRE_LINUX_MESSAGES
+#define DWIRE_LINUX_MESSAGES 8
+#endif
+
+// startStreamRead() cannot keep a read message open between ioctls, so it
+// reads RX_BUFFER_SIZE bytes per I2C_RDWR, with a STOP in between. The
+// first chunk follows the write of txData; the next ones are plain reads,
+// which a memory continues from where the previous one stopped (a current
+// address read). Devices that restart their data on a new transaction
+// cannot be streamed beyond RX_BUFFER_SIZE bytes
+
+// The adapter device of a bus number; EUSCI_Bx_BASE selects bus x
+#define DWIRE_LINUX_DEVICE "/dev/i2c-%u"
+
+// The calls that reach the adapter. A host test builds with
+// -DDWIRE_LINUX_SIM to use the stand-in adapter of host/sim_i2cdev.cpp
+#ifdef DWIRE_LINUX_SIM
+#include "sim_i2cdev.h"
+#define DWIRE_LINUX_OPEN simI2cdevOpen
+#define DWIRE_LINUX_CLOSE simI2cdevClose
+#define DWIRE_LINUX_IOCTL simI2cdevIoctl
+#else
+#define DWIRE_LINUX_OPEN open
+#define DWIRE_LINUX_CLOSE close
+#define DWIRE_LINUX_IOCTL ioctl
+#endif
+
+#endif /* INCLUDE_DWIRE_LINUX_H_ */
@@ -9,6 +9,80 @@
 #define INCLUDE_DWIRE_MSP432P401R_H_
 
 
+// Offset of the eUSCI_B interrupt vector register (UCBxIV)
+#define EUSCI_B_IV_OFFSET 0x002E
+
+// Offsets of the eUSCI_B data registers (UCBxRXBUF, UCBxTXBUF)
+#define EUSCI_B_RXBUF_OFFSET 0x000C
+#define EUSCI_B_TXBUF_OFFSET 0x000E
+
+// Offsets of the Cortex-M4 cycle counter registers
+#define DWT_CTRL_REG 0xE0001000
+#define DWT_CYCCNT_REG 0xE0001004
+#define DEMCR_REG 0xE000EDFC
+
+// Direct register accesses of the ISR. A host build (see host/) defines
+// these to use its simulated module instead
+#ifndef DWIRE_READ_IV
+#define DWIRE_READ_IV(module) HWREG16((module) + EUSCI_B_IV_OFFSET)
+#endif
+
+#ifndef DWIRE_READ_RXBUF
+#define DWIRE_READ_RXBUF(module) \
+        ((uint8_t) HWREG16((module) + EUSCI_B_RXBUF_OFFSET))
+#define DWIRE_WRITE_TXBUF(module, data) \
+        (HWREG16((module) + EUSCI_B_TXBUF_OFFSET) = (data))
+#endif
+
+// SRAM-resident ISR (-DDWIRE_SRAM_ISR): the hot path of the ISR goes into
+// the .TI.ramfunc (TI compiler) or .ramfunc (GCC) section, which the linker
+// script must copy to SRAM, and its tables into .data, so that they run
+// without flash wait states
+#ifdef DWIRE_SRAM_ISR
+#ifdef __TI_COMPILER_VERSION__
+#define DWIRE_RAMFUNC __attribute__((ramfunc))
+#else
+#define DWIRE_RAMFUNC __attribute__((section(".ramfunc"), noinline))
+#endif
+#define DWIRE_RAMDATA __attribute__((section(".data.ramdata")))
+#else
+#define DWIRE_RAMFUNC
+#define DWIRE_RAMDATA
+#endif
+
+#ifndef DWIRE_CYCLES
+#define DWIRE_CYCLES() HWREG32(DWT_CYCCNT_REG)
+#define DWIRE_CYCLES_ENABLE() do { \
+        HWREG32(DEMCR_REG) = HWREG32(DEMCR_REG) | 0x01000000; \
+        HWREG32(DWT_CTRL_REG) = HWREG32(DWT_CTRL_REG) | 0x00000001; \
+    } while (0)
+#endif
+
+// Low-power mode of a sleeping slave. LPM3 (default) and LPM4 keep the
+// eUSCI_B address matching alive, as a slave is clocked by the master's
+// SCL; LPM4 also stops the RTC and watchdog. LPM0 wakes up fastest
+#ifndef DWIRE_SLAVE_SLEEP
+#if DWIRE_SLAVE_LPM == 0
+#define DWIRE_SLAVE_SLEEP() MAP_PCM_gotoLPM0()
+#elif DWIRE_SLAVE_LPM == 4
+#define DWIRE_SLAVE_SLEEP() MAP_PCM_gotoLPM4()
+#else
+#define DWIRE_SLAVE_SLEEP() MAP_PCM_gotoLPM3()
+#endif
+#endif
+
+// Digital I/O registers of ports P1 to P10 (used by DSoftWire). Ports are
+// paired in 16-bit registers, with the odd port in the low byte. A host
+// build defines DWIRE_PORT_REG to use its simulated ports instead
+#define DWIRE_PORT_BASE 0x40004C00
+#define DWIRE_PORT_IN_OFFSET 0x0000
+#define DWIRE_PORT_OUT_OFFSET 0x0002
+#define DWIRE_PORT_DIR_OFFSET 0x0004
+#ifndef DWIRE_PORT_REG
+#define DWIRE_PORT_REG(port, offset) (DWIRE_PORT_BASE \
+        + (((port) - 1) >> 1) * 0x20 + (((port) - 1) & 1) + (offset))
+#endif
+
 #ifdef USING_EUSCI_B0
 #define EUSCI_B0_PORT GPIO_PORT_P1
 #define EUSCI_B0_PINS (GPIO_PIN6 + GPIO_PIN7)
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * DWire: a library to provide full hardware-driven I2C functionality
+ * to the TI MSP432 family of microcontrollers. It is possible to use
+ * this library in Energia (the Arduino port for MSP microcontrollers)
+ * or in other toolchains.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#ifndef INCLUDE_DWIRE_RTOS_H_
+#define INCLUDE_DWIRE_RTOS_H_
+
+/*
+ * RTOS adapter. Define one of the following to let waiting tasks block
+ * instead of spinning:
+ *
+ *   DWIRE_RTOS_FREERTOS  FreeRTOS, with configSUPPORT_STATIC_ALLOCATION
+ *   DWIRE_RTOS_POSIX     POSIX threads, e.g. TI-RTOS's POSIX layer or Linux
+ *
+ * Each bus gets a recursive mutex, held by a task for the duration of a
+ * blocking transfer, and a binary semaphore that the ISR gives whenever the
+ * state of the transfer changes. Waits time out after about a millisecond,
+ * so that conditions that do not raise an interrupt are noticed as well.
+ */
+
+#if defined(DWIRE_RTOS_FREERTOS)
+
+#define DWIRE_RTOS
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+
+typedef struct {
+    StaticSemaphore_t buffer;
+    SemaphoreHandle_t handle;
+} RTOSMutex;
+
+typedef RTOSMutex RTOSSemaphore;
+
+static inline bool rtosRunning( void ) {
+    return xTaskGetSchedulerState( ) != taskSCHEDULER_NOT_STARTED;
+}
+
+static inline void rtosMutexInit( RTOSMutex * mutex ) {
+    mutex->handle = xSemaphoreCreateRecursiveMutexStatic(&mutex->buffer);
+}
+
+static inline void rtosMutexLock( RTOSMutex * mutex ) {
+    if ( rtosRunning( ) )
+        xSemaphoreTakeRecursive(mutex->handle, portMAX_DELAY);
+}
+
+static inline void rtosMutexUnlock( RTOSMutex * mutex ) {
+    if ( rtosRunning( ) )
+        xSemaphoreGiveRecursive(mutex->handle);
+}
+
+static inline void rtosSemInit( RTOSSemaphore * semaphore ) {
+    semaphore->handle = xSemaphoreCreateBinaryStatic(&semaphore->buffer);
+}
+
+static inline void rtosSemWait( RTOSSemaphore * semaphore ) {
+    if ( rtosRunning( ) )
+        xSemaphoreTake(semaphore->handle,
+                pdMS_TO_TICKS(1) ? pdMS_TO_TICKS(1) : 1);
+}
+
+static inline void rtosSemGiveFromISR( RTOSSemaphore * semaphore ) {
+    BaseType_t woken = pdFALSE;
+    xSemaphoreGiveFromISR(semaphore->handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+#elif defined(DWIRE_RTOS_POSIX)
+
+#define DWIRE_RTOS
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+typedef pthread_mutex_t RTOSMutex;
+typedef sem_t RTOSSemaphore;
+
+static inline void rtosMutexInit( RTOSMutex * mutex ) {
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(mutex, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+static inline void rtosMutexLock( RTOSMutex * mutex ) {
+    pthread_mutex_lock(mutex);
+}
+
+static inline void rtosMutexUnlock( RTOSMutex * mutex ) {
+    pthread_mutex_unlock(mutex);
+}
+
+static inline void rtosSemInit( RTOSSemaphore * semaphore ) {
+    sem_init(semaphore, 0, 0);
+}
+
+static inline void rtosSemWait( RTOSSemaphore * semaphore ) {
+    struct timespec timeout;
+    clock_gettime(CLOCK_REALTIME, &timeout);
+    timeout.tv_nsec += 1000000;
+    if ( timeout.tv_nsec >= 1000000000 ) {
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
+    }
+    sem_timedwait(semaphore, &timeout);
+}
+
+/**
+ * Binary semaphore: do not count up beyond one
+ */
+static inline void rtosSemGiveFromISR( RTOSSemaphore * semaphore ) {
+    int value;
+    sem_getvalue(semaphore, &value);
+    if ( value <= 0 )
+        sem_post(semaphore);
+}
+
+#endif
+
+#endif /* INCLUDE_DWIRE_RTOS_H_ */
@@ -14,66 +14,57 @@
 
 #include "modulemap.h"
 
-ModuleNode * moduleMap = NULL;
+// Statically allocated, so no heap is needed
+ModuleNode moduleMap[MODULE_COUNT];
+
+/**
+ * Get the slot of the specified module, or NULL if it is not an eUSCI_B
+ * module
+ */
+static ModuleNode * getSlot( uint_fast32_t module ) {
+    uint_fast32_t index = (module - EUSCI_B0_BASE) >> 10;
+    if ( module < EUSCI_B0_BASE || index >= MODULE_COUNT
+            || module != EUSCI_B0_BASE + (index << 10) )
+        return NULL;
+
+    return &moduleMap[index];
+}
 
 /**
  * Register this module in the static moduleMap
  */
 void registerModule( DWire * instance ) {
+    ModuleNode * slot = getSlot(instance->module);
+
     // Check whether this module has already been registered
-    if ( getModuleNode(instance->module) != NULL ) {
+    if ( slot == NULL || slot->instance != NULL ) {
         return;
     }
 
-    ModuleNode ** head = &moduleMap;
-
-    ModuleNode * newModule = new ModuleNode( );
-    newModule->instance = instance;
-    newModule->module = instance->module;
-
-    if ( moduleMap == NULL ) {
-        newModule->next = NULL;
-        *head = newModule;
-    } else {
-        newModule->next = *head;
-        *head = newModule;
-    }
+    slot->module = instance->module;
+    slot->instance = instance;
 }
 
 /**
  * Unregister this module from the module map
  */
 void unregisterModule( DWire * instance ) {
+    ModuleNode * slot = getSlot(instance->module);
 
-    ModuleNode * current = moduleMap;
-
-    while ( current->next != NULL ) {
-        if ( (current->next)->instance == instance ) {
-            ModuleNode * newNext = (current->next)->next;
-            // Free memory
-            delete (current->next);
-            current->next = newNext;
-            return;
-        }
-    }
+    if ( slot != NULL && slot->instance == instance )
+        slot->instance = NULL;
 }
 
 /**
  * Get the specified module identifier's container object
  */
 ModuleNode * getModuleNode( uint_fast32_t module ) {
+    ModuleNode * slot = getSlot(module);
 
-    if ( moduleMap == NULL )
+    if ( slot == NULL || slot->instance == NULL )
         return NULL;
 
-    ModuleNode * current = moduleMap;
-    while ( current != NULL ) {
-        if ( current->module == module )
-            return current;
-
-        current = current->next;
-    }
-    return NULL;
+    return slot;
 }
 
 /**
@@ -82,5 +73,8 @@ ModuleNode * getModuleNode( uint_fast32_t module ) {
 DWire * getInstance( uint_fast32_t module ) {
 
     ModuleNode * node = getModuleNode(module);
+    if ( node == NULL )
+        return NULL;
+
     return node->instance;
 }
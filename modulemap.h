@@ -22,6 +22,9 @@
 #include  "DWire.h"
 
 
+// Number of eUSCI_B modules; the map has a fixed slot for each
+#define MODULE_COUNT 4
+
 /**
  * Define the main type
  */
@@ -29,7 +32,6 @@ class ModuleNode {
 public:
     uint32_t module;
     DWire * instance;
-    struct ModuleNode * next;
 };
 
 /**
@@ -52,6 +54,6 @@ ModuleNode * getModuleNode( uint_fast32_t );
  */
 DWire * getInstance( uint_fast32_t );
 
-extern ModuleNode * moduleMap;
+extern ModuleNode moduleMap[MODULE_COUNT];
 
 #endif /* INCLUDE_MODULEMAP_H_ */
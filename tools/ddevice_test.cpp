@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Runs DDevice write combining on the host simulation and checks that:
+ *
+ * - writes to consecutive registers go out as one burst, sent by a read;
+ * - startTransfer() refuses to overtake buffered writes;
+ * - a buffered write that has timed out stays buffered until poll(), and
+ *   poll() sends nothing before the timeout.
+ *
+ * Exits with 1 if any check fails.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -pthread -Ihost -I. tools/ddevice_test.cpp \
+ *       host/sim_eusci.cpp DWire.cpp DDevice.cpp modulemap.cpp \
+ *       -o ddevice_test
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+#include "sim_eusci.h"
+#include "DDevice.h"
+
+#define SLAVE_ADDRESS 0x10
+
+// The combining timeout, in microseconds
+#define TIMEOUT_US 20000
+
+/**
+ * A slave with registers behind an auto-incrementing pointer, counting
+ * the writes addressed to it
+ */
+typedef struct {
+    uint8_t registers[16];
+    uint8_t pointer;
+    bool first;
+    std::atomic<int> writes;
+} RegisterSlave;
+
+RegisterSlave slave;
+int failures = 0;
+
+#define CHECK(condition) do { \
+        if ( !(condition) ) { \
+            printf("FAIL line %d: %s\n", __LINE__, #condition); \
+            failures++; \
+        } \
+    } while ( 0 )
+
+bool slaveAddress( void * context, uint8_t address, bool read ) {
+    slave.first = !read;
+    if ( address == SLAVE_ADDRESS && !read )
+        slave.writes++;
+    return address == SLAVE_ADDRESS;
+}
+
+void slaveWrite( void * context, uint8_t data ) {
+    if ( slave.first ) {
+        slave.pointer = data;
+        slave.first = false;
+    } else
+        slave.registers[slave.pointer++ % 16] = data;
+}
+
+uint8_t slaveRead( void * context ) {
+    return slave.registers[slave.pointer++ % 16];
+}
+
+void slaveStop( void * context ) {
+}
+
+void transferDone( void * context, bool nak ) {
+}
+
+void testBurst( DDevice * device ) {
+    device->setWriteCombining(true, 0);
+
+    // Three consecutive registers are buffered, and sent by the read
+    int writes = slave.writes;
+    CHECK(device->writeRegister(2, 0x12));
+    CHECK(device->writeRegister(3, 0x13));
+    CHECK(device->writeRegister(4, 0x14));
+    CHECK(slave.writes == writes);
+
+    uint8_t data[3] = { 0, 0, 0 };
+    CHECK(device->readRegisters(2, data, 3));
+    CHECK(slave.writes == writes + 2);
+    CHECK(data[0] == 0x12 && data[1] == 0x13 && data[2] == 0x14);
+
+    // An asynchronous transfer must not overtake a buffered write
+    uint8_t tx[2] = { 5, 0x25 };
+    CHECK(device->writeRegister(5, 0x15));
+    CHECK(!device->startTransfer(tx, 2, NULL, 0, transferDone, NULL));
+    CHECK(device->flush( ));
+    CHECK(slave.registers[5] == 0x15);
+    CHECK(device->startTransfer(tx, 2, NULL, 0, transferDone, NULL));
+    while ( device->getBus( )->isBusy( ) )
+        ;
+    CHECK(slave.registers[5] == 0x25);
+
+    device->setWriteCombining(false, 0);
+}
+
+void testTimeout( DDevice * device ) {
+    device->setWriteCombining(true, TIMEOUT_US);
+
+    // poll() before the timeout keeps the write
+    int writes = slave.writes;
+    CHECK(device->writeRegister(8, 0x18));
+    CHECK(device->poll( ));
+    CHECK(slave.writes == writes);
+
+    // Past the timeout, nothing sends it without poll()
+    std::this_thread::sleep_for(std::chrono::microseconds(2 * TIMEOUT_US));
+    CHECK(slave.writes == writes);
+    CHECK(slave.registers[8] == 0);
+
+    CHECK(device->poll( ));
+    CHECK(slave.writes == writes + 1);
+    CHECK(slave.registers[8] == 0x18);
+
+    device->setWriteCombining(false, 0);
+}
+
+int main( void ) {
+    SimSlave sim = { slaveAddress, slaveWrite, slaveRead, slaveStop, NULL };
+    simAttach(EUSCI_B0_BASE, &sim);
+
+    std::atomic<bool> running(true);
+    std::thread interrupts([&] {
+        while ( running )
+            if ( !simRun( ) )
+                std::this_thread::yield( );
+    });
+
+    DWire bus;
+    bus.begin(EUSCI_B0_BASE);
+    DDevice device(&bus, SLAVE_ADDRESS, EUSCI_B_I2C_SET_DATA_RATE_400KBPS);
+
+    testBurst(&device);
+    testTimeout(&device);
+
+    running = false;
+    interrupts.join( );
+
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Decodes the binary output of DSerial: splits the stream into COBS
+ * frames, formats log records with the format string of their site and
+ * prints sensor samples. Gaps in the sequence numbers are reported, so
+ * dropped records are visible.
+ *
+ * The catalogue holds one site per line: its number, whitespace, then a
+ * printf format string with up to three integer conversions (%d, %u, %x,
+ * %c, ...). Lines starting with # are ignored. For example:
+ *   1 boot, reset cause %x
+ *   2 temperature %d.%02d C
+ *
+ * Build:
+ *   g++ -std=c++11 -O2 tools/dserial_decode.cpp -o dserial_decode
+ *
+ * Usage:
+ *   dserial_decode <catalogue> [stream file, default stdin]
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Must match DSerial.h
+#define SERIAL_RECORD_LOG 0x01
+#define SERIAL_RECORD_SAMPLE 0x02
+
+/**
+ * Read the site catalogue. Returns false if the file cannot be read
+ */
+static bool readCatalogue( const char * path,
+        std::map<uint32_t, std::string> & sites ) {
+    FILE * file = fopen(path, "r");
+    if ( !file )
+        return false;
+
+    char line[512];
+    while ( fgets(line, sizeof(line), file) ) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if ( line[0] == '#' || line[0] == '\0' )
+            continue;
+
+        char * format;
+        uint32_t site = strtoul(line, &format, 0);
+        if ( format == line )
+            continue;
+        sites[site] = format + strspn(format, " \t");
+    }
+    fclose(file);
+    return true;
+}
+
+/**
+ * Undo the COBS encoding in place. Returns false if the frame is invalid
+ */
+static bool decodeFrame( std::vector<uint8_t> & frame ) {
+    std::vector<uint8_t> data;
+    size_t i = 0;
+
+    while ( i < frame.size() ) {
+        uint8_t code = frame[i++];
+        if ( code == 0 || i + code - 1 > frame.size() )
+            return false;
+        data.insert(data.end(), frame.begin() + i, frame.begin() + i + code - 1);
+        i += code - 1;
+        if ( code < 0xFF && i < frame.size() )
+            data.push_back(0);
+    }
+    frame = data;
+    return true;
+}
+
+/**
+ * Read a zigzag varint. Returns false if the record ends early
+ */
+static bool getVarint( const std::vector<uint8_t> & record, size_t & index,
+        int32_t & value ) {
+    uint32_t zigzag = 0;
+
+    for ( int shift = 0; shift < 35; shift += 7 ) {
+        if ( index >= record.size() )
+            return false;
+        uint8_t byte = record[index++];
+        zigzag |= (uint32_t) (byte & 0x7F) << shift;
+        if ( !(byte & 0x80) ) {
+            value = (int32_t) (zigzag >> 1) ^ -(int32_t) (zigzag & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void printLog( const std::vector<uint8_t> & record,
+        const std::map<uint32_t, std::string> & sites ) {
+    size_t index = 2;
+    int32_t site;
+    int32_t args[3] = { 0, 0, 0 };
+    int count = 0;
+
+    if ( !getVarint(record, index, site) ) {
+        printf("! truncated log record\n");
+        return;
+    }
+    while ( index < record.size() && count < 3 )
+        if ( !getVarint(record, index, args[count++]) ) {
+            printf("! truncated log record\n");
+            return;
+        }
+
+    std::map<uint32_t, std::string>::const_iterator it = sites.find(site);
+    if ( it == sites.end() ) {
+        printf("site %d:", site);
+        for ( int i = 0; i < count; i++ )
+            printf(" %d", args[i]);
+        printf("\n");
+        return;
+    }
+    printf(it->second.c_str(), args[0], args[1], args[2]);
+    printf("\n");
+}
+
+static void printSample( const std::vector<uint8_t> & record ) {
+    if ( record.size() < 3 || (record.size() - 3) % 2 ) {
+        printf("! malformed sample record\n");
+        return;
+    }
+
+    printf("channel %u:", record[2]);
+    for ( size_t i = 3; i < record.size(); i += 2 )
+        printf(" %d", (int16_t) (record[i] | (record[i + 1] << 8)));
+    printf("\n");
+}
+
+int main( int argc, char ** argv ) {
+    std::map<uint32_t, std::string> sites;
+
+    if ( argc < 2 ) {
+        fprintf(stderr, "usage: %s <catalogue> [stream file]\n", argv[0]);
+        return 1;
+    }
+    if ( !readCatalogue(argv[1], sites) ) {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+
+    FILE * input = argc > 2 ? fopen(argv[2], "rb") : stdin;
+    if ( !input ) {
+        fprintf(stderr, "cannot read %s\n", argv[2]);
+        return 1;
+    }
+
+    std::vector<uint8_t> frame;
+    int expected = -1;
+    uint32_t records = 0, lost = 0, invalid = 0;
+    int c;
+
+    while ( (c = fgetc(input)) != EOF ) {
+        if ( c != 0 ) {
+            frame.push_back(c);
+            continue;
+        }
+
+        if ( frame.empty() )
+            continue;
+        if ( !decodeFrame(frame) || frame.size() < 2 ) {
+            printf("! invalid frame\n");
+            invalid++;
+            frame.clear();
+            continue;
+        }
+
+        // The sequence number wraps at 256
+        if ( expected >= 0 && frame[1] != expected ) {
+            uint8_t gap = frame[1] - expected;
+            printf("! %u records lost\n", gap);
+            lost += gap;
+        }
+        expected = (frame[1] + 1) & 0xFF;
+        records++;
+
+        if ( frame[0] == SERIAL_RECORD_LOG )
+            printLog(frame, sites);
+        else if ( frame[0] == SERIAL_RECORD_SAMPLE )
+            printSample(frame);
+        else
+            printf("! unknown record type %u\n", frame[0]);
+        frame.clear();
+    }
+
+    fprintf(stderr, "%u records, %u lost, %u invalid frames\n", records, lost,
+            invalid);
+    return 0;
+}
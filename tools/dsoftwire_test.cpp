@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Runs DSoftWire against the host simulation: the waveforms are played on
+ * a simulated port, where a register-based slave decodes them bit by bit
+ * and drives SDA for its acknowledgements and read data. Checks a write,
+ * a write-read with a repeated START, a probe of a missing slave and an
+ * asynchronous transfer. Exits with 1 if any check fails.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -Ihost -I. tools/dsoftwire_test.cpp host/sim_eusci.cpp \
+ *       DSoftWire.cpp -lpthread -o dsoftwire_test
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+
+#include "sim_eusci.h"
+#include "DSoftWire.h"
+
+#define SLAVE_ADDRESS 0x33
+#define SLAVE_REGISTERS 16
+
+/**
+ * A slave with a register pointer, set by the first byte of a write
+ */
+typedef struct {
+    uint8_t registers[SLAVE_REGISTERS];
+    uint8_t pointer;
+    bool first;
+    uint8_t starts;
+    uint8_t stops;
+} RegisterSlave;
+
+RegisterSlave slave;
+int failures = 0;
+
+#define CHECK(condition) do { \
+        if ( !(condition) ) { \
+            printf("FAIL line %d: %s\n", __LINE__, #condition); \
+            failures++; \
+        } \
+    } while ( 0 )
+
+bool slaveAddress( void * context, uint8_t address, bool read ) {
+    RegisterSlave * s = (RegisterSlave *) context;
+    if ( address != SLAVE_ADDRESS )
+        return false;
+    s->starts++;
+    s->first = !read;
+    return true;
+}
+
+void slaveWrite( void * context, uint8_t data ) {
+    RegisterSlave * s = (RegisterSlave *) context;
+    if ( s->first ) {
+        s->pointer = data;
+        s->first = false;
+    } else
+        s->registers[s->pointer++ % SLAVE_REGISTERS] = data;
+}
+
+uint8_t slaveRead( void * context ) {
+    RegisterSlave * s = (RegisterSlave *) context;
+    return s->registers[s->pointer++ % SLAVE_REGISTERS];
+}
+
+void slaveStop( void * context ) {
+    ((RegisterSlave *) context)->stops++;
+}
+
+void transferDone( void * context, bool nak ) {
+    *(std::atomic<int> *) context = nak ? 2 : 1;
+}
+
+int main( void ) {
+    SimSlave sim = { slaveAddress, slaveWrite, slaveRead, slaveStop, &slave };
+    simAttachPins(GPIO_PORT_P4, GPIO_PIN0, GPIO_PIN1, &sim);
+
+    // The uDMA interrupt is delivered from another thread, as the blocking
+    // calls wait for it
+    std::atomic<bool> running(true);
+    std::thread interrupts([&] {
+        while ( running )
+            simRun( );
+    });
+
+    {
+        DSoftWire soft(GPIO_PORT_P4, GPIO_PIN0, GPIO_PIN1, TIMER_A1_BASE);
+        soft.begin( );
+
+        // Write two registers
+        soft.beginTransmission(SLAVE_ADDRESS);
+        soft.write(0x02);
+        soft.write(0xA5);
+        soft.write(0x5A);
+        soft.endTransmission( );
+        CHECK(!soft.hasFailed( ));
+        CHECK(slave.registers[2] == 0xA5 && slave.registers[3] == 0x5A);
+        CHECK(slave.starts == 1 && slave.stops == 1);
+
+        // Read them back after a repeated START
+        soft.beginTransmission(SLAVE_ADDRESS);
+        soft.write(0x02);
+        soft.endTransmission(false);
+        CHECK(soft.requestFrom(SLAVE_ADDRESS, 2) == 2);
+        CHECK(soft.read( ) == 0xA5);
+        CHECK(soft.read( ) == 0x5A);
+        CHECK(slave.starts == 3 && slave.stops == 2);
+
+        // A missing slave does not acknowledge its address
+        soft.beginTransmission(0x44);
+        soft.endTransmission( );
+        CHECK(soft.hasFailed( ));
+        CHECK(soft.requestFrom(0x44, 1) == 0);
+
+        // Asynchronous write-read, completed from the uDMA interrupt
+        std::atomic<int> done(0);
+        uint8_t tx = 0x03;
+        uint8_t rx[2] = { 0, 0 };
+        slave.registers[4] = 0x77;
+        CHECK(soft.startTransfer(SLAVE_ADDRESS, &tx, 1, rx, 2, transferDone,
+                &done));
+        while ( !done )
+            ;
+        CHECK(done == 1);
+        CHECK(rx[0] == 0x5A && rx[1] == 0x77);
+    }
+
+    running = false;
+    interrupts.join( );
+
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Host demo of the coroutine interface: two sensor tasks share one
+ * simulated bus. Each initialises its sensor with a sequence of register
+ * writes and then reads samples, written as straight-line code; the loop
+ * interleaves the tasks while the simulated ISR handles the transfers.
+ * Finally the loop is filled with waiting tasks, to show that a transfer
+ * awaited by one more coroutine fails instead of being lost.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++20 -O2 -Ihost -I. tools/dwire_coroutine_demo.cpp \
+ *       DCoroutine.cpp host/sim_eusci.cpp DWire.cpp modulemap.cpp \
+ *       -o dwire_coroutine_demo
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+
+#include "sim_eusci.h"
+#include "DCoroutine.h"
+
+#define SENSOR_A 0x48
+#define SENSOR_B 0x76
+
+#define REG_ID 0x00
+#define REG_CONFIG 0x01
+#define REG_DATA 0x02
+
+/**
+ * Simulated register-based sensors: the first byte written selects the
+ * register, further bytes are stored; reads return successive registers.
+ * A conversion increments the data registers on every read of REG_DATA
+ */
+struct SimSensor {
+    uint8_t address;
+    uint8_t regs[8];
+};
+
+SimSensor sensors[] = { { SENSOR_A, { 0xA1 } }, { SENSOR_B, { 0xB2 } } };
+
+SimSensor * selected;
+uint8_t pointer;
+bool pointerWritten;
+
+static bool sensorAddress( void * context, uint8_t address, bool read ) {
+    for ( unsigned i = 0; i < sizeof(sensors) / sizeof(sensors[0]); i++ ) {
+        if ( sensors[i].address == address ) {
+            selected = &sensors[i];
+            pointerWritten = read;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void sensorWrite( void * context, uint8_t data ) {
+    if ( !pointerWritten ) {
+        pointer = data & 0x07;
+        pointerWritten = true;
+    } else {
+        selected->regs[pointer++ & 0x07] = data;
+    }
+}
+
+static uint8_t sensorRead( void * context ) {
+    if ( pointer == REG_DATA && selected->regs[REG_CONFIG] )
+        selected->regs[REG_DATA + 1]++;
+    return selected->regs[pointer++ & 0x07];
+}
+
+static void sensorStop( void * context ) {
+}
+
+static void idle( void ) {
+    simRun( );
+}
+
+/**
+ * Check the ID of a sensor and enable it
+ */
+DTask initSensor( DAsyncBus & bus, uint8_t address, uint8_t id, bool * ok ) {
+    uint8_t value;
+
+    *ok = false;
+    if ( !co_await bus.writeRead(address, REG_ID, &value, 1) || value != id )
+        co_return;
+
+    if ( !co_await bus.writeRegister(address, REG_CONFIG, 0x01) )
+        co_return;
+
+    *ok = co_await bus.writeRead(address, REG_CONFIG, &value, 1)
+            && value == 0x01;
+}
+
+DTask sensorTask( DAsyncBus & bus, uint8_t address, uint8_t id,
+        int samples ) {
+    bool ok;
+    co_await initSensor(bus, address, id, &ok);
+    if ( !ok ) {
+        printf("sensor 0x%02X: init failed\n", address);
+        co_return;
+    }
+
+    for ( int i = 0; i < samples; i++ ) {
+        uint8_t data[2];
+        if ( !co_await bus.writeRead(address, REG_DATA, data, 2) ) {
+            printf("sensor 0x%02X: read failed\n", address);
+            co_return;
+        }
+        printf("sensor 0x%02X: sample %d = %u\n", address, i,
+                (data[0] << 8) | data[1]);
+
+        // Let the other task have a go
+        co_await DYield( );
+    }
+}
+
+/**
+ * Read the ID of a sensor once. ok is set to whether the read succeeded
+ */
+DTask readId( DAsyncBus & bus, uint8_t address, bool * ok ) {
+    uint8_t value;
+    *ok = co_await bus.writeRead(address, REG_ID, &value, 1);
+}
+
+/**
+ * Fill every waiting slot of the loop, then run a coroutine that is not one
+ * of its tasks. Its transfer must fail at once, and the others must finish.
+ * Returns false otherwise
+ */
+bool fillLoop( DLoop & loop, DAsyncBus & bus ) {
+    bool read[COROUTINE_MAX_TASKS];
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ )
+        loop.spawn(readId(bus, SENSOR_A, &read[i]));
+
+    // Each task starts and waits for its transfer
+    loop.runOnce( );
+
+    bool extraRead = true;
+    std::coroutine_handle<> extra = readId(bus, SENSOR_B, &extraRead)
+            .release( );
+    extra.resume( );
+    bool rejected = extra.done( ) && !extraRead;
+    if ( extra.done( ) )
+        extra.destroy( );
+    printf("full loop: extra transfer %s\n", rejected ? "rejected" :
+            "not rejected");
+
+    loop.run( );
+    for ( int i = 0; i < COROUTINE_MAX_TASKS; i++ )
+        if ( !read[i] )
+            return false;
+    return rejected;
+}
+
+int main( void ) {
+    static const SimSlave slave = { sensorAddress, sensorWrite, sensorRead,
+            sensorStop, NULL };
+    simAttach(EUSCI_B0_BASE, &slave);
+
+    DWire wire;
+    wire.begin(EUSCI_B0_BASE);
+    DAsyncBus bus(&wire);
+
+    DLoop loop;
+    loop.onIdle(idle);
+    loop.spawn(sensorTask(bus, SENSOR_A, 0xA1, 3));
+    loop.spawn(sensorTask(bus, SENSOR_B, 0xB2, 3));
+    loop.spawn(sensorTask(bus, 0x20, 0x00, 3));
+    loop.run( );
+
+    if ( !fillLoop(loop, bus) )
+        return 1;
+
+    if ( coroutineAllocationFailures( ) ) {
+        printf("%u tasks did not get a frame\n",
+                (unsigned) coroutineAllocationFailures( ));
+        return 1;
+    }
+    return 0;
+}
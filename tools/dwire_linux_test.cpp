@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Runs the Linux backend against the stand-in adapter of host/sim_i2cdev.cpp
+ * and checks the ioctls it sends: the messages of a write, a write-read,
+ * writes queued with endTransmission(false), a streamed read and
+ * I2C_M_RECV_LEN block reads on an I2C adapter, and the SMBus commands
+ * used instead on an adapter without I2C_FUNC_I2C. Exits with 1 if any check fails.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -DDWIRE_LINUX -DDWIRE_LINUX_SIM -Ihost -I. \
+ *       tools/dwire_linux_test.cpp host/dwire_linux.cpp host/sim_i2cdev.cpp \
+ *       -o dwire_linux_test
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <linux/i2c-dev.h>
+
+#include "DWire.h"
+
+#define SLAVE_ADDRESS 0x50
+
+// A block at BLOCK_REGISTER: the count, the data and the PEC
+#define BLOCK_REGISTER 0x30
+#define BLOCK_LENGTH 3
+
+/**
+ * A slave with 256 registers and an auto-incrementing pointer, set by the
+ * first byte of a write
+ */
+typedef struct {
+    uint8_t registers[256];
+    uint8_t pointer;
+    bool first;
+} RegisterSlave;
+
+RegisterSlave slave;
+int failures = 0;
+
+#define CHECK(condition) do { \
+        if ( !(condition) ) { \
+            printf("FAIL line %d: %s\n", __LINE__, #condition); \
+            failures++; \
+        } \
+    } while ( 0 )
+
+bool slaveAddress( void * context, uint8_t address, bool read ) {
+    RegisterSlave * s = (RegisterSlave *) context;
+    s->first = !read;
+    return address == SLAVE_ADDRESS;
+}
+
+void slaveWrite( void * context, uint8_t data ) {
+    RegisterSlave * s = (RegisterSlave *) context;
+    if ( s->first ) {
+        s->pointer = data;
+        s->first = false;
+    } else
+        s->registers[s->pointer++] = data;
+}
+
+uint8_t slaveRead( void * context ) {
+    RegisterSlave * s = (RegisterSlave *) context;
+    return s->registers[s->pointer++];
+}
+
+void slaveStop( void * context ) {
+}
+
+uint8_t crc8( uint8_t crc, uint8_t data ) {
+    crc ^= data;
+    for ( int i = 0; i < 8; i++ )
+        crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    return crc;
+}
+
+/**
+ * Store the block and its PEC over the whole read transaction
+ */
+void setBlock( void ) {
+    const uint8_t block[BLOCK_LENGTH + 1] = { BLOCK_LENGTH, 0x0A, 0x0B, 0x0C };
+    uint8_t pec = crc8(0, SLAVE_ADDRESS << 1);
+    pec = crc8(pec, BLOCK_REGISTER);
+    pec = crc8(pec, (SLAVE_ADDRESS << 1) | 0x01);
+    for ( int i = 0; i <= BLOCK_LENGTH; i++ ) {
+        slave.registers[BLOCK_REGISTER + i] = block[i];
+        pec = crc8(pec, block[i]);
+    }
+    slave.registers[BLOCK_REGISTER + BLOCK_LENGTH + 1] = pec;
+}
+
+// A streamed read: its first register, and its length in whole chunks
+#define STREAM_REGISTER 0x80
+#define STREAM_CHUNKS 3
+
+/**
+ * Collects the chunks of a streamed read
+ */
+typedef struct {
+    uint8_t data[STREAM_CHUNKS * RX_BUFFER_SIZE];
+    uint32_t length;
+    uint8_t chunks;
+    bool done;
+} StreamSink;
+
+void streamSink( void * context, const uint8_t * data, uint8_t length ) {
+    StreamSink * stream = (StreamSink *) context;
+    for ( uint8_t i = 0; i < length; i++ )
+        stream->data[stream->length++] = data[i];
+    stream->chunks++;
+}
+
+void streamDone( void * context, bool nak ) {
+    ((StreamSink *) context)->done = !nak;
+}
+
+/**
+ * Checks a message of the last I2C_RDWR
+ */
+void checkMessage( uint8_t index, uint16_t flags, uint16_t length ) {
+    const SimI2cTransaction * last = simI2cdevLast( );
+    CHECK(last->messages[index].addr == SLAVE_ADDRESS);
+    CHECK(last->messages[index].flags == flags);
+    CHECK(last->messages[index].len == length);
+}
+
+void testI2C( void ) {
+    simI2cdevSetFunctions(I2C_FUNC_I2C | I2C_FUNC_SMBUS_READ_BLOCK_DATA);
+    DWire bus;
+    bus.begin(EUSCI_B1_BASE);
+    CHECK(!bus.hasFailed( ));
+    const SimI2cTransaction * last = simI2cdevLast( );
+
+    // A write is one message
+    uint32_t count = simI2cdevCount( );
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(0x10);
+    bus.write(0x01);
+    bus.write(0x02);
+    bus.endTransmission( );
+    CHECK(!bus.hasFailed( ));
+    CHECK(simI2cdevCount( ) == count + 1);
+    CHECK(last->request == I2C_RDWR && last->count == 1);
+    checkMessage(0, 0, 3);
+    CHECK(last->messages[0].data[0] == 0x10);
+    CHECK(last->messages[0].data[2] == 0x02);
+    CHECK(slave.registers[0x10] == 0x01 && slave.registers[0x11] == 0x02);
+
+    // A write-read is a write and a read in one transaction
+    count = simI2cdevCount( );
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(0x10);
+    bus.endTransmission(false);
+    CHECK(simI2cdevCount( ) == count);
+    CHECK(bus.requestFrom(SLAVE_ADDRESS, 2) == 2);
+    CHECK(bus.read( ) == 0x01 && bus.read( ) == 0x02);
+    CHECK(simI2cdevCount( ) == count + 1);
+    CHECK(last->count == 2);
+    checkMessage(0, 0, 1);
+    checkMessage(1, I2C_M_RD, 2);
+
+    // Writes ended without a STOP are queued until one with a STOP
+    count = simI2cdevCount( );
+    for ( uint8_t i = 0; i < 3; i++ ) {
+        bus.beginTransmission(SLAVE_ADDRESS);
+        bus.write(0x20 + i);
+        bus.write(0x40 + i);
+        bus.endTransmission(i == 2);
+    }
+    CHECK(simI2cdevCount( ) == count + 1);
+    CHECK(last->count == 3);
+    for ( uint8_t i = 0; i < 3; i++ ) {
+        checkMessage(i, 0, 2);
+        CHECK(last->messages[i].data[0] == 0x20 + i);
+    }
+    CHECK(slave.registers[0x22] == 0x42);
+
+    // A streamed read: the first chunk follows the write, and each further
+    // one is a read of its own
+    for ( int i = 0; i < STREAM_CHUNKS * RX_BUFFER_SIZE; i++ )
+        slave.registers[STREAM_REGISTER + i] = i;
+    StreamSink stream = { { 0 }, 0, 0, false };
+    uint8_t reg = STREAM_REGISTER;
+    count = simI2cdevCount( );
+    CHECK(bus.startStreamRead(SLAVE_ADDRESS, &reg, 1,
+            STREAM_CHUNKS * RX_BUFFER_SIZE - 1, streamSink, streamDone,
+            &stream));
+    CHECK(stream.done && stream.chunks == STREAM_CHUNKS);
+    CHECK(stream.length == STREAM_CHUNKS * RX_BUFFER_SIZE - 1);
+    bool intact = true;
+    for ( uint32_t i = 0; i < stream.length; i++ )
+        intact = intact && stream.data[i] == i;
+    CHECK(intact);
+    CHECK(simI2cdevCount( ) == count + STREAM_CHUNKS);
+    CHECK(last->count == 1);
+    checkMessage(0, I2C_M_RD, RX_BUFFER_SIZE - 1);
+
+    // A block read leaves the length to the adapter: buf[0] is 1
+    setBlock( );
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(BLOCK_REGISTER);
+    CHECK(bus.requestBlock(SLAVE_ADDRESS) == 1 + BLOCK_LENGTH);
+    CHECK(last->count == 2);
+    checkMessage(0, 0, 1);
+    CHECK(last->messages[1].flags == (I2C_M_RD | I2C_M_RECV_LEN));
+    CHECK(last->messages[1].len >= 1 + I2C_SMBUS_BLOCK_MAX);
+    CHECK(last->messages[1].data[0] == 1);
+    CHECK(bus.read( ) == BLOCK_LENGTH && bus.read( ) == 0x0A);
+
+    // With the PEC, buf[0] is 2 and the PEC is checked
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.setPEC(true);
+    bus.write(BLOCK_REGISTER);
+    CHECK(bus.requestBlock(SLAVE_ADDRESS) == 2 + BLOCK_LENGTH);
+    CHECK(last->messages[1].data[0] == 2);
+    CHECK(bus.isPECValid( ));
+
+    // A missing slave
+    bus.beginTransmission(SLAVE_ADDRESS + 1);
+    bus.write(0x00);
+    bus.endTransmission( );
+    CHECK(bus.hasFailed( ));
+}
+
+void testSMBus( void ) {
+    simI2cdevSetFunctions(I2C_FUNC_SMBUS_QUICK | I2C_FUNC_SMBUS_BYTE
+            | I2C_FUNC_SMBUS_BYTE_DATA | I2C_FUNC_SMBUS_WORD_DATA
+            | I2C_FUNC_SMBUS_I2C_BLOCK | I2C_FUNC_SMBUS_READ_BLOCK_DATA);
+    DWire bus;
+    bus.begin(EUSCI_B1_BASE);
+    const SimI2cTransaction * last = simI2cdevLast( );
+
+    // A register write of one byte
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(0x10);
+    bus.write(0x55);
+    bus.endTransmission( );
+    CHECK(!bus.hasFailed( ));
+    CHECK(last->request == I2C_SMBUS && last->address == SLAVE_ADDRESS);
+    CHECK(last->readWrite == I2C_SMBUS_WRITE);
+    CHECK(last->size == I2C_SMBUS_BYTE_DATA && last->command == 0x10);
+    CHECK(slave.registers[0x10] == 0x55);
+
+    // A longer write
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(0x10);
+    bus.write(0x66);
+    bus.write(0x77);
+    bus.write(0x88);
+    bus.endTransmission( );
+    CHECK(last->size == I2C_SMBUS_I2C_BLOCK_DATA);
+    CHECK(slave.registers[0x12] == 0x88);
+
+    // A write-read of two bytes
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(0x10);
+    bus.endTransmission(false);
+    CHECK(bus.requestFrom(SLAVE_ADDRESS, 2) == 2);
+    CHECK(last->readWrite == I2C_SMBUS_READ);
+    CHECK(last->size == I2C_SMBUS_WORD_DATA && last->command == 0x10);
+    CHECK(bus.read( ) == 0x66 && bus.read( ) == 0x77);
+
+    // A block read
+    setBlock( );
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(BLOCK_REGISTER);
+    CHECK(bus.requestBlock(SLAVE_ADDRESS) == 1 + BLOCK_LENGTH);
+    CHECK(last->size == I2C_SMBUS_BLOCK_DATA);
+    CHECK(last->command == BLOCK_REGISTER);
+    CHECK(bus.read( ) == BLOCK_LENGTH && bus.read( ) == 0x0A);
+
+    // Two queued writes have no SMBus equivalent
+    uint32_t count = simI2cdevCount( );
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(0x10);
+    bus.endTransmission(false);
+    bus.beginTransmission(SLAVE_ADDRESS);
+    bus.write(0x11);
+    bus.endTransmission( );
+    CHECK(bus.hasFailed( ));
+    CHECK(simI2cdevCount( ) == count);
+}
+
+int main( void ) {
+    SimSlave sim = { slaveAddress, slaveWrite, slaveRead, slaveStop, &slave };
+    simI2cdevAttach(&sim);
+
+    testI2C( );
+    testSMBus( );
+
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Replays a DWire bus capture against the simulated eUSCI_B modules and
+ * reports how long the driver, including its ISR, took to process it.
+ * The simulated slave answers with the captured data and NAKs where the
+ * capture shows a NAK, so the replay exercises the same code paths as the
+ * recorded session. Run it before and after a change to compare.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -O2 -Ihost -I. tools/dwire_replay.cpp host/sim_eusci.cpp \
+ *       DWire.cpp modulemap.cpp -o dwire_replay
+ *
+ * Usage:
+ *   dwire_replay <capture file> [repetitions]
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License 
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "sim_eusci.h"
+#include "DWire.h"
+#include "capture.h"
+#include "modulemap.h"
+
+/**
+ * A captured record
+ */
+struct Record {
+    uint8_t flags;
+    uint8_t address;
+    uint32_t timestamp;
+    std::vector<uint8_t> data;
+};
+
+/**
+ * One master transfer as issued to DWire: an optional write phase, an
+ * optional read phase and the number of NAKs that preceded it
+ */
+struct Transfer {
+    uint8_t module;
+    uint8_t address;
+    std::vector<uint8_t> tx;
+    std::vector<uint8_t> rx;
+    bool read;
+    uint16_t naks;
+};
+
+/**
+ * Scripted slave: NAKs the expected number of times, then checks the
+ * written bytes and returns the captured read data
+ */
+struct ScriptedSlave {
+    const Transfer * transfer;
+    uint16_t naksLeft;
+    size_t txIndex;
+    size_t rxIndex;
+    uint32_t mismatches;
+};
+
+static bool slaveAddress( void * context, uint8_t address, bool read ) {
+    ScriptedSlave * slave = (ScriptedSlave *) context;
+    if ( address != slave->transfer->address ) {
+        slave->mismatches++;
+        return false;
+    }
+    if ( slave->naksLeft ) {
+        slave->naksLeft--;
+        return false;
+    }
+    if ( read )
+        slave->rxIndex = 0;
+    else
+        slave->txIndex = 0;
+    return true;
+}
+
+static void slaveWrite( void * context, uint8_t data ) {
+    ScriptedSlave * slave = (ScriptedSlave *) context;
+    const std::vector<uint8_t> & tx = slave->transfer->tx;
+    if ( slave->txIndex >= tx.size( ) || tx[slave->txIndex] != data )
+        slave->mismatches++;
+    slave->txIndex++;
+}
+
+static uint8_t slaveRead( void * context ) {
+    ScriptedSlave * slave = (ScriptedSlave *) context;
+    const std::vector<uint8_t> & rx = slave->transfer->rx;
+    if ( slave->rxIndex < rx.size( ) )
+        return rx[slave->rxIndex++];
+    return 0xFF;
+}
+
+static void slaveStop( void * context ) {
+}
+
+static const uint32_t moduleBases[] = { EUSCI_B0_BASE, EUSCI_B1_BASE,
+        EUSCI_B2_BASE, EUSCI_B3_BASE };
+
+/**
+ * Parse a capture into records. Returns false on a truncated file
+ */
+static bool parseCapture( const std::vector<uint8_t> & raw,
+        std::vector<Record> & records ) {
+    size_t i = 0;
+    while ( i < raw.size( ) ) {
+        if ( i + CAPTURE_HEADER_SIZE > raw.size( ) )
+            return false;
+
+        Record record;
+        record.flags = raw[i];
+        record.address = raw[i + 1];
+        uint8_t length = raw[i + 2];
+        record.timestamp = raw[i + 3] | (raw[i + 4] << 8) | (raw[i + 5] << 16)
+                | ((uint32_t) raw[i + 6] << 24);
+        i += CAPTURE_HEADER_SIZE;
+
+        if ( i + length > raw.size( ) )
+            return false;
+        record.data.assign(raw.begin( ) + i, raw.begin( ) + i + length);
+        i += length;
+        records.push_back(record);
+    }
+    return true;
+}
+
+/**
+ * Group master records into transfers. Slave records are skipped, as they
+ * were driven by another master
+ */
+static void buildTransfers( const std::vector<Record> & records,
+        std::vector<Transfer> & transfers ) {
+    Transfer current;
+    bool pending = false;
+    uint16_t naks = 0;
+
+    for ( size_t i = 0; i < records.size( ); i++ ) {
+        const Record & record = records[i];
+        if ( record.flags & CAPTURE_SLAVE )
+            continue;
+
+        if ( record.flags & CAPTURE_NAK ) {
+            naks++;
+            continue;
+        }
+
+        if ( !(record.flags & CAPTURE_READ) ) {
+            current = Transfer( );
+            current.module = CAPTURE_GET_MODULE(record.flags);
+            current.address = record.address;
+            current.tx = record.data;
+            current.read = false;
+            current.naks = naks;
+            naks = 0;
+            if ( record.flags & CAPTURE_STOP )
+                transfers.push_back(current);
+            else
+                pending = true;
+            continue;
+        }
+
+        // A read after a write without STOP is a combined transfer
+        if ( !pending || current.address != record.address ) {
+            current = Transfer( );
+            current.module = CAPTURE_GET_MODULE(record.flags);
+            current.address = record.address;
+            current.naks = naks;
+            naks = 0;
+        }
+        current.rx = record.data;
+        current.read = true;
+        transfers.push_back(current);
+        pending = false;
+    }
+}
+
+int main( int argc, char ** argv ) {
+    if ( argc < 2 ) {
+        fprintf(stderr, "usage: %s <capture file> [repetitions]\n", argv[0]);
+        return 2;
+    }
+    int repetitions = argc > 2 ? atoi(argv[2]) : 1;
+
+    FILE * file = fopen(argv[1], "rb");
+    if ( !file ) {
+        perror(argv[1]);
+        return 2;
+    }
+    std::vector<uint8_t> raw;
+    int c;
+    while ( (c = fgetc(file)) != EOF )
+        raw.push_back(c);
+    fclose(file);
+
+    std::vector<Record> records;
+    if ( !parseCapture(raw, records) )
+        fprintf(stderr, "warning: capture is truncated\n");
+
+    std::vector<Transfer> transfers;
+    buildTransfers(records, transfers);
+
+    DWire buses[4];
+    ScriptedSlave slaves[4];
+    SimSlave simSlaves[4];
+    bool started[4] = { false, false, false, false };
+
+    uint32_t mismatches = 0;
+    uint32_t failures = 0;
+    uint64_t invocations = 0;
+    std::chrono::nanoseconds elapsed(0);
+
+    for ( int r = 0; r < repetitions; r++ ) {
+        for ( size_t i = 0; i < transfers.size( ); i++ ) {
+            const Transfer & transfer = transfers[i];
+            uint8_t m = transfer.module;
+
+            if ( !started[m] ) {
+                slaves[m] = ScriptedSlave( );
+                simSlaves[m] = { slaveAddress, slaveWrite, slaveRead,
+                        slaveStop, &slaves[m] };
+                simAttach(moduleBases[m], &simSlaves[m]);
+                buses[m].begin(moduleBases[m]);
+                if ( getInstance(moduleBases[m]) != &buses[m] ) {
+                    fprintf(stderr, "eUSCI_B%d is not enabled\n", m);
+                    return 2;
+                }
+                started[m] = true;
+            }
+
+            ScriptedSlave & slave = slaves[m];
+            slave.transfer = &transfer;
+            slave.naksLeft = transfer.naks;
+            slave.txIndex = 0;
+            slave.rxIndex = 0;
+            slave.mismatches = 0;
+
+            uint8_t rx[256];
+            DWire & bus = buses[m];
+            DWireNAKPolicy policy = { (uint16_t) (transfer.naks + 1), 0 };
+
+            std::chrono::steady_clock::time_point start =
+                    std::chrono::steady_clock::now( );
+            bool accepted = bus.startTransfer(transfer.address,
+                    transfer.tx.data( ), transfer.tx.size( ), rx,
+                    transfer.rx.size( ), NULL, NULL, &policy);
+            while ( accepted && bus.isBusy( ) ) {
+                uint32_t n = simRun( );
+                invocations += n;
+                if ( !n )
+                    break;
+            }
+            elapsed += std::chrono::steady_clock::now( ) - start;
+
+            if ( !accepted || bus.isBusy( ) || bus.hasFailed( ) )
+                failures++;
+            if ( transfer.read
+                    && memcmp(rx, transfer.rx.data( ), transfer.rx.size( )) )
+                slave.mismatches++;
+            mismatches += slave.mismatches;
+        }
+    }
+
+    uint32_t span = 0;
+    if ( records.size( ) > 1 )
+        span = records.back( ).timestamp - records.front( ).timestamp;
+
+    uint64_t ns = elapsed.count( );
+    printf("records:       %zu\n", records.size( ));
+    printf("transfers:     %zu x %d\n", transfers.size( ), repetitions);
+    printf("failures:      %u\n", failures);
+    printf("mismatches:    %u\n", mismatches);
+    printf("isr calls:     %llu\n", (unsigned long long) invocations);
+    printf("replay time:   %llu ns\n", (unsigned long long) ns);
+    if ( invocations )
+        printf("per isr call:  %llu ns\n",
+                (unsigned long long) (ns / invocations));
+    printf("captured span: %u cycles\n", span);
+
+    return failures || mismatches ? 1 : 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Runs DWire with the POSIX adapter of inc/dwire_rtos.h on the host
+ * simulation, with simRun() called from a thread standing in for the
+ * interrupt context. Checks that:
+ *
+ * - two threads sharing one module do not corrupt each other's transfers:
+ *   each writes its own registers and reads them back under lock();
+ * - a requestFrom() waiting for a slow slave blocks on the semaphore given
+ *   by the ISR instead of spinning, judged by the CPU time of its thread.
+ *
+ * Exits with 1 if any check fails.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -DDWIRE_RTOS_POSIX -pthread -Ihost -I. \
+ *       tools/dwire_rtos_test.cpp host/sim_eusci.cpp DWire.cpp modulemap.cpp \
+ *       -o dwire_rtos_test
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <thread>
+
+#include "sim_eusci.h"
+#include "DWire.h"
+
+#ifndef DWIRE_RTOS_POSIX
+#error "Build the test with DWIRE_RTOS_POSIX"
+#endif
+
+#define SLAVE_ADDRESS 0x10
+
+// Transfers per thread, and the registers each thread uses
+#define ROUNDS 500
+#define THREAD_REGISTERS 4
+
+// How long the slow slave holds the read, in milliseconds
+#define STALL_MS 200
+
+// Transfers that interfere may never finish: give up after this many seconds
+#define TIMEOUT_S 30
+
+/**
+ * A slave with registers behind an auto-incrementing pointer. While
+ * stalling, it holds the second byte of a read, as a slave stretching the
+ * clock would
+ */
+typedef struct {
+    uint8_t registers[16];
+    uint8_t pointer;
+    bool first;
+    uint8_t readIndex;
+    std::atomic<bool> stalling;
+    std::atomic<bool> stalled;
+} RegisterSlave;
+
+RegisterSlave slave;
+std::atomic<int> failures(0);
+
+#define CHECK(condition) do { \
+        if ( !(condition) ) { \
+            printf("FAIL line %d: %s\n", __LINE__, #condition); \
+            failures++; \
+        } \
+    } while ( 0 )
+
+bool slaveAddress( void * context, uint8_t address, bool read ) {
+    slave.first = !read;
+    slave.readIndex = 0;
+    return address == SLAVE_ADDRESS;
+}
+
+void slaveWrite( void * context, uint8_t data ) {
+    if ( slave.first ) {
+        slave.pointer = data;
+        slave.first = false;
+    } else
+        slave.registers[slave.pointer++ % 16] = data;
+}
+
+uint8_t slaveRead( void * context ) {
+    if ( slave.readIndex++ == 1 ) {
+        slave.stalled = true;
+        while ( slave.stalling )
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return slave.registers[slave.pointer++ % 16];
+}
+
+void slaveStop( void * context ) {
+}
+
+/**
+ * CPU time of the calling thread, in microseconds
+ */
+uint64_t threadCpuTime( void ) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Write a pattern to this thread's registers, read them back and compare
+ */
+void writeAndVerify( DWire * bus, uint8_t thread ) {
+    uint8_t base = thread * THREAD_REGISTERS;
+
+    for ( int round = 0; round < ROUNDS; round++ ) {
+        uint8_t pattern = (thread << 7) | (round & 0x7F);
+
+        bus->beginTransmission(SLAVE_ADDRESS);
+        bus->write(base);
+        for ( int i = 0; i < THREAD_REGISTERS; i++ )
+            bus->write(pattern + i);
+        bus->endTransmission( );
+
+        bus->lock( );
+        bus->beginTransmission(SLAVE_ADDRESS);
+        bus->write(base);
+        bool complete = bus->requestFrom(SLAVE_ADDRESS, THREAD_REGISTERS)
+                == THREAD_REGISTERS;
+        bool intact = complete;
+        for ( int i = 0; complete && i < THREAD_REGISTERS; i++ )
+            intact = (bus->read( ) == (uint8_t) (pattern + i)) && intact;
+        bus->unlock( );
+
+        if ( !intact ) {
+            printf("FAIL thread %u, round %d: read back other data\n",
+                    thread, round);
+            failures++;
+            return;
+        }
+    }
+}
+
+int main( void ) {
+    SimSlave sim = { slaveAddress, slaveWrite, slaveRead, slaveStop, NULL };
+    simAttach(EUSCI_B0_BASE, &sim);
+
+    std::thread watchdog([] {
+        sleep(TIMEOUT_S);
+        printf("FAIL: timed out\n");
+        fflush(stdout);
+        _exit(1);
+    });
+    watchdog.detach( );
+
+    std::atomic<bool> running(true);
+    std::thread interrupts([&] {
+        while ( running )
+            if ( !simRun( ) )
+                std::this_thread::yield( );
+    });
+
+    DWire bus;
+    bus.begin(EUSCI_B0_BASE);
+
+    // Two threads on one module
+    std::thread first(writeAndVerify, &bus, 0);
+    std::thread second(writeAndVerify, &bus, 1);
+    first.join( );
+    second.join( );
+
+    // A read held up by the slave: the waiting thread must sleep
+    slave.registers[8] = 0x81;
+    slave.registers[9] = 0x82;
+    slave.stalling = true;
+    slave.stalled = false;
+
+    uint8_t length = 0;
+    uint8_t data[2] = { 0, 0 };
+    uint64_t cpu = 0;
+    std::thread waiter([&] {
+        uint64_t start = threadCpuTime( );
+        bus.beginTransmission(SLAVE_ADDRESS);
+        bus.write(8);
+        length = bus.requestFrom(SLAVE_ADDRESS, 2);
+        data[0] = bus.read( );
+        data[1] = bus.read( );
+        cpu = threadCpuTime( ) - start;
+    });
+
+    while ( !slave.stalled )
+        std::this_thread::yield( );
+    std::this_thread::sleep_for(std::chrono::milliseconds(STALL_MS));
+    slave.stalling = false;
+    waiter.join( );
+
+    CHECK(length == 2 && data[0] == 0x81 && data[1] == 0x82);
+    printf("waiter: %u us of CPU time in a %u ms wait\n", (unsigned) cpu,
+            STALL_MS);
+    CHECK(cpu < STALL_MS * 1000 / 5);
+
+    running = false;
+    interrupts.join( );
+
+    printf("%d failure(s)\n", (int) failures);
+    return failures ? 1 : 0;
+}
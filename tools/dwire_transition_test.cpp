@@ -0,0 +1,471 @@
+/*
+ * Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+ *
+ * Tests the ISR's transition table one entry at a time. Instead of letting
+ * simRun() deliver the interrupts, the test calls
+ * irqTransitions[state][event] itself, as IRQHandler() would, and checks
+ * the next state and what the transition did on the simulated bus. Every
+ * entry that is not the default (ignore the event) must be exercised, and
+ * every default entry must leave the state and the bus alone. A master
+ * runs on EUSCI_B0 with a register slave attached, a slave on EUSCI_B1.
+ * Exits with 1 if any check fails.
+ *
+ * Build (from the repository root):
+ *   g++ -std=c++11 -Ihost -I. tools/dwire_transition_test.cpp \
+ *       host/sim_eusci.cpp DWire.cpp modulemap.cpp -o dwire_transition_test
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License
+ * version 3, both as published by the Free Software Foundation.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim_eusci.h"
+#include "DWire.h"
+
+#ifdef DWIRE_DEFERRED
+#error "The slave checks expect the handlers to be called from the ISR"
+#endif
+
+#define SLAVE_ADDRESS 0x10
+#define OWN_ADDRESS 0x20
+
+static const char * stateNames[STATE_COUNT] = { "IDLE", "MASTER_TX",
+        "MASTER_RX", "MASTER_STREAM", "SCAN", "SLAVE_IDLE", "SLAVE_RX",
+        "SLAVE_TX", "ARBITRATION", "NAK_RETRY", "RETRY_WAIT" };
+static const char * eventNames[EVENT_COUNT] = { "RX", "TX", "NAK", "STOP",
+        "ARBITRATION", "TIMER" };
+
+/**
+ * The slave of the master: registers behind a pointer, and what it saw
+ */
+typedef struct {
+    bool present;
+    uint8_t registers[16];
+    uint8_t pointer;
+    bool first;
+    uint8_t lastAddress;
+    uint32_t starts;
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t stops;
+} RegisterSlave;
+
+RegisterSlave device;
+
+// The completion of the last asynchronous transfer
+struct {
+    uint32_t calls;
+    bool nak;
+} completion;
+
+// What the slave on EUSCI_B1 was given
+uint8_t receivedLength;
+uint32_t requests;
+uint8_t streamed[8];
+uint8_t streamedLength;
+
+bool covered[STATE_COUNT][EVENT_COUNT];
+int failures = 0;
+
+DWire master;
+DWire slave;
+
+#define CHECK(condition) do { \
+        if ( !(condition) ) { \
+            printf("FAIL line %d: %s\n", __LINE__, #condition); \
+            failures++; \
+        } \
+    } while ( 0 )
+
+bool deviceAddress( void * context, uint8_t address, bool read ) {
+    device.lastAddress = address;
+    device.starts++;
+    device.first = !read;
+    return device.present && address == SLAVE_ADDRESS;
+}
+
+void deviceWrite( void * context, uint8_t data ) {
+    device.writes++;
+    if ( device.first ) {
+        device.pointer = data;
+        device.first = false;
+    } else
+        device.registers[device.pointer++ % 16] = data;
+}
+
+uint8_t deviceRead( void * context ) {
+    device.reads++;
+    return device.registers[device.pointer++ % 16];
+}
+
+void deviceStop( void * context ) {
+    device.stops++;
+}
+
+void transferDone( void * context, bool nak ) {
+    completion.calls++;
+    completion.nak = nak;
+}
+
+void streamSink( void * context, const uint8_t * data, uint8_t length ) {
+    memcpy(&streamed[streamedLength], data, length);
+    streamedLength += length;
+}
+
+void slaveReceived( uint8_t length ) {
+    receivedLength = length;
+}
+
+void slaveRequested( void ) {
+    requests++;
+    slave.write(0xA5);
+    slave.write(0x5A);
+}
+
+/**
+ * Run the transition for the event in the module's current state, as
+ * IRQHandler() does, and check the state it leads to
+ */
+void fire( IRQParam * param, uint8_t event, uint8_t expected, int line ) {
+    uint8_t state = param->state;
+    covered[state][event] = true;
+    param->state = irqTransitions[state][event](param);
+    if ( param->state != expected ) {
+        printf("FAIL line %d: %s + %s went to %s, not %s\n", line,
+                stateNames[state], eventNames[event],
+                stateNames[param->state], stateNames[expected]);
+        failures++;
+    }
+}
+
+#define FIRE(param, event, expected) fire(param, event, expected, __LINE__)
+
+/**
+ * A fresh start for the next case: the slave acknowledges, the master
+ * gives up on the first NAK or lost arbitration
+ */
+void reset( void ) {
+    IRQParam * param = &EUSCIB0_irqParam;
+    CHECK(param->state == STATE_IDLE);
+    CHECK(!master.isBusy( ));
+    device.present = true;
+    completion.calls = 0;
+    master.setNAKRetry(1, 0);
+    master.setArbitrationRetry(0, 0);
+}
+
+/**
+ * The bus events seen by the register slave, to check that a transition
+ * did nothing
+ */
+uint32_t busEvents( void ) {
+    return device.starts + device.reads + device.writes + device.stops;
+}
+
+void testMasterTransmit( void ) {
+    IRQParam * param = &EUSCIB0_irqParam;
+    uint8_t tx[3] = { 0x02, 0x11, 0x22 };
+
+    // TX: the next byte, then the STOP after the last one
+    reset( );
+    CHECK(master.startTransfer(SLAVE_ADDRESS, tx, 3, NULL, 0, transferDone,
+            NULL));
+    CHECK(param->state == STATE_MASTER_TX && device.writes == 1);
+    FIRE(param, EVENT_TX, STATE_MASTER_TX);
+    CHECK(device.writes == 2);
+    FIRE(param, EVENT_TX, STATE_MASTER_TX);
+    uint32_t stops = device.stops;
+    FIRE(param, EVENT_TX, STATE_IDLE);
+    CHECK(device.stops == stops + 1);
+    CHECK(device.registers[2] == 0x11 && device.registers[3] == 0x22);
+    CHECK(completion.calls == 1 && !completion.nak);
+
+    // NAK without a retry: STOP, and the transfer fails
+    reset( );
+    device.present = false;
+    CHECK(master.startTransfer(SLAVE_ADDRESS, tx, 1, NULL, 0, transferDone,
+            NULL));
+    stops = device.stops;
+    FIRE(param, EVENT_NAK, STATE_IDLE);
+    CHECK(device.stops == stops + 1);
+    CHECK(completion.calls == 1 && completion.nak && master.hasFailed( ));
+
+    // NAK with an immediate retry: a repeated START
+    reset( );
+    device.present = false;
+    master.setNAKRetry(2, 0);
+    uint32_t retries = master.getStats( )->nakRetries;
+    CHECK(master.startTransfer(SLAVE_ADDRESS, tx, 1, NULL, 0, transferDone,
+            NULL));
+    uint32_t starts = device.starts;
+    device.present = true;
+    FIRE(param, EVENT_NAK, STATE_MASTER_TX);
+    CHECK(device.starts == starts + 1);
+    CHECK(master.getStats( )->nakRetries == retries + 1);
+    FIRE(param, EVENT_TX, STATE_IDLE);
+    CHECK(completion.calls == 1 && !completion.nak);
+
+    // NAK with a retry interval: STOP, wait for it, then for the timer
+    reset( );
+    device.present = false;
+    master.setNAKRetry(2, 100);
+    CHECK(master.startTransfer(SLAVE_ADDRESS, tx, 1, NULL, 0, transferDone,
+            NULL));
+    stops = device.stops;
+    FIRE(param, EVENT_NAK, STATE_NAK_RETRY);
+    CHECK(device.stops == stops + 1);
+    CHECK(simInterruptEnables(EUSCI_B0_BASE) & EUSCI_B_I2C_STOP_INTERRUPT);
+    FIRE(param, EVENT_STOP, STATE_RETRY_WAIT);
+    CHECK(!(simInterruptEnables(EUSCI_B0_BASE) & EUSCI_B_I2C_STOP_INTERRUPT));
+    CHECK(param->retryTicks != 0);
+
+    // The timer has expired, as DWIRE_RETRY_HANDLER would find
+    param->retryTicks = 0;
+    device.present = true;
+    starts = device.starts;
+    FIRE(param, EVENT_TIMER, STATE_MASTER_TX);
+    CHECK(device.starts == starts + 1 && device.lastAddress == SLAVE_ADDRESS);
+    FIRE(param, EVENT_TX, STATE_IDLE);
+    CHECK(completion.calls == 1 && !completion.nak);
+
+    // Lost arbitration: wait for the winner's STOP, then start again
+    reset( );
+    master.setArbitrationRetry(1, 0);
+    uint32_t lost = master.getStats( )->arbitrationLost;
+    CHECK(master.startTransfer(SLAVE_ADDRESS, tx, 1, NULL, 0, transferDone,
+            NULL));
+    FIRE(param, EVENT_ARBITRATION, STATE_ARBITRATION);
+    CHECK(master.getStats( )->arbitrationLost == lost + 1);
+    CHECK(simInterruptEnables(EUSCI_B0_BASE) & EUSCI_B_I2C_STOP_INTERRUPT);
+    starts = device.starts;
+    FIRE(param, EVENT_STOP, STATE_MASTER_TX);
+    CHECK(device.starts == starts + 1);
+    FIRE(param, EVENT_TX, STATE_IDLE);
+    CHECK(completion.calls == 1 && !completion.nak);
+
+    // Lost arbitration without retries left: the transfer fails
+    reset( );
+    CHECK(master.startTransfer(SLAVE_ADDRESS, tx, 1, NULL, 0, transferDone,
+            NULL));
+    FIRE(param, EVENT_ARBITRATION, STATE_IDLE);
+    CHECK(completion.calls == 1 && completion.nak);
+}
+
+void testMasterReceive( void ) {
+    IRQParam * param = &EUSCIB0_irqParam;
+    uint8_t tx = 0x04;
+    uint8_t rx[2];
+    device.registers[4] = 0x44;
+    device.registers[5] = 0x55;
+
+    // RX: each byte, with the STOP requested before the last
+    reset( );
+    device.pointer = 4;
+    CHECK(master.startTransfer(SLAVE_ADDRESS, NULL, 0, rx, 2, transferDone,
+            NULL));
+    CHECK(param->state == STATE_MASTER_RX);
+    FIRE(param, EVENT_RX, STATE_MASTER_RX);
+    uint32_t stops = device.stops;
+    FIRE(param, EVENT_RX, STATE_IDLE);
+    CHECK(device.stops == stops + 1);
+    CHECK(rx[0] == 0x44 && rx[1] == 0x55);
+    CHECK(completion.calls == 1 && !completion.nak);
+
+    // NAK of the read address
+    reset( );
+    device.present = false;
+    CHECK(master.startTransfer(SLAVE_ADDRESS, NULL, 0, rx, 2, transferDone,
+            NULL));
+    FIRE(param, EVENT_NAK, STATE_IDLE);
+    CHECK(completion.calls == 1 && completion.nak);
+
+    // Lost arbitration during a read that followed a write: the write is
+    // sent again before the read
+    reset( );
+    master.setArbitrationRetry(1, 0);
+    CHECK(master.startTransfer(SLAVE_ADDRESS, &tx, 1, rx, 2, transferDone,
+            NULL));
+    FIRE(param, EVENT_TX, STATE_MASTER_RX);
+    FIRE(param, EVENT_ARBITRATION, STATE_ARBITRATION);
+    uint32_t writes = device.writes;
+    FIRE(param, EVENT_STOP, STATE_MASTER_TX);
+    CHECK(device.writes == writes + 1 && device.pointer == 4);
+    FIRE(param, EVENT_TX, STATE_MASTER_RX);
+    FIRE(param, EVENT_RX, STATE_MASTER_RX);
+    FIRE(param, EVENT_RX, STATE_IDLE);
+    CHECK(rx[0] == 0x44 && rx[1] == 0x55);
+    CHECK(completion.calls == 1 && !completion.nak);
+}
+
+void testMasterStream( void ) {
+    IRQParam * param = &EUSCIB0_irqParam;
+    uint8_t tx = 0x04;
+    device.registers[6] = 0x66;
+
+    // RX: the bytes go to the sink, the last one ends the read
+    reset( );
+    streamedLength = 0;
+    CHECK(master.startStreamRead(SLAVE_ADDRESS, &tx, 1, 3, streamSink,
+            transferDone, NULL));
+    FIRE(param, EVENT_TX, STATE_MASTER_STREAM);
+    FIRE(param, EVENT_RX, STATE_MASTER_STREAM);
+    FIRE(param, EVENT_RX, STATE_MASTER_STREAM);
+    CHECK(streamedLength == 0);
+    FIRE(param, EVENT_RX, STATE_IDLE);
+    CHECK(streamedLength == 3 && streamed[0] == 0x44 && streamed[2] == 0x66);
+    CHECK(completion.calls == 1 && !completion.nak);
+
+    // NAK of the read address
+    reset( );
+    device.present = false;
+    CHECK(master.startStreamRead(SLAVE_ADDRESS, NULL, 0, 3, streamSink,
+            transferDone, NULL));
+    FIRE(param, EVENT_NAK, STATE_IDLE);
+    CHECK(completion.calls == 1 && completion.nak);
+
+    // Lost arbitration: the stream restarts from its first byte
+    reset( );
+    master.setArbitrationRetry(1, 0);
+    streamedLength = 0;
+    device.pointer = 4;
+    CHECK(master.startStreamRead(SLAVE_ADDRESS, NULL, 0, 2, streamSink,
+            transferDone, NULL));
+    FIRE(param, EVENT_ARBITRATION, STATE_ARBITRATION);
+    device.pointer = 4;
+    FIRE(param, EVENT_STOP, STATE_MASTER_STREAM);
+    FIRE(param, EVENT_RX, STATE_MASTER_STREAM);
+    FIRE(param, EVENT_RX, STATE_IDLE);
+    CHECK(streamedLength == 2 && streamed[0] == 0x44 && streamed[1] == 0x55);
+}
+
+void testScan( void ) {
+    IRQParam * param = &EUSCIB0_irqParam;
+    uint8_t bitmap[SCAN_BITMAP_SIZE];
+
+    // Each probe: TX (address acknowledged) or NAK, then its STOP
+    reset( );
+    CHECK(master.startScan(bitmap));
+    for ( int address = SCAN_FIRST_ADDRESS; address <= SCAN_LAST_ADDRESS;
+            address++ ) {
+        CHECK(device.lastAddress == address);
+        uint32_t stops = device.stops;
+        if ( address == SLAVE_ADDRESS )
+            FIRE(param, EVENT_TX, STATE_SCAN);
+        else
+            FIRE(param, EVENT_NAK, STATE_SCAN);
+        CHECK(device.stops == stops + 1);
+        FIRE(param, EVENT_STOP,
+                address == SCAN_LAST_ADDRESS ? STATE_IDLE : STATE_SCAN);
+    }
+    for ( int address = 0; address < 128; address++ )
+        CHECK(master.isPresent(bitmap, address) == (address == SLAVE_ADDRESS));
+    CHECK(!(simInterruptEnables(EUSCI_B0_BASE) & EUSCI_B_I2C_STOP_INTERRUPT));
+
+    // Lost arbitration: the probe is repeated, or the scan ends
+    reset( );
+    master.setArbitrationRetry(1, 0);
+    CHECK(master.startScan(bitmap));
+    FIRE(param, EVENT_ARBITRATION, STATE_ARBITRATION);
+    uint32_t starts = device.starts;
+    FIRE(param, EVENT_STOP, STATE_SCAN);
+    CHECK(device.starts == starts + 1
+            && device.lastAddress == SCAN_FIRST_ADDRESS);
+    FIRE(param, EVENT_ARBITRATION, STATE_IDLE);
+    CHECK(!master.isBusy( ));
+}
+
+void testSlave( void ) {
+    IRQParam * param = &EUSCIB1_irqParam;
+    CHECK(param->state == STATE_SLAVE_IDLE);
+
+    // A write: RX for each byte, STOP hands them to onReceive
+    simMasterWrite(EUSCI_B1_BASE, 0x31);
+    FIRE(param, EVENT_RX, STATE_SLAVE_RX);
+    simMasterWrite(EUSCI_B1_BASE, 0x32);
+    FIRE(param, EVENT_RX, STATE_SLAVE_RX);
+    receivedLength = 0;
+    FIRE(param, EVENT_STOP, STATE_SLAVE_IDLE);
+    CHECK(receivedLength == 2);
+    CHECK(slave.read( ) == 0x31 && slave.read( ) == 0x32);
+
+    // A STOP without data does not call onReceive
+    receivedLength = 0;
+    FIRE(param, EVENT_STOP, STATE_SLAVE_IDLE);
+    CHECK(receivedLength == 0);
+
+    // A write turned into a read: onReceive, then onRequest
+    simMasterWrite(EUSCI_B1_BASE, 0x33);
+    FIRE(param, EVENT_RX, STATE_SLAVE_RX);
+    requests = 0;
+    FIRE(param, EVENT_TX, STATE_SLAVE_TX);
+    CHECK(receivedLength == 1 && slave.read( ) == 0x33);
+    CHECK(requests == 1 && simMasterRead(EUSCI_B1_BASE) == 0xA5);
+    FIRE(param, EVENT_TX, STATE_SLAVE_TX);
+    CHECK(requests == 1 && simMasterRead(EUSCI_B1_BASE) == 0x5A);
+
+    // STOP ends the response; the next request asks for a new one
+    FIRE(param, EVENT_STOP, STATE_SLAVE_IDLE);
+    FIRE(param, EVENT_TX, STATE_SLAVE_TX);
+    CHECK(requests == 2 && simMasterRead(EUSCI_B1_BASE) == 0xA5);
+
+    // A master writing right after a read, without a STOP
+    simMasterWrite(EUSCI_B1_BASE, 0x34);
+    FIRE(param, EVENT_RX, STATE_SLAVE_RX);
+    FIRE(param, EVENT_STOP, STATE_SLAVE_IDLE);
+    CHECK(receivedLength == 1 && slave.read( ) == 0x34);
+}
+
+/**
+ * Every default entry keeps the state and does nothing on the bus, and
+ * every other entry has been exercised
+ */
+void testDefaults( void ) {
+    IRQTransition ignore = irqTransitions[STATE_IDLE][EVENT_RX];
+    IRQParam * param = &EUSCIB0_irqParam;
+
+    for ( int state = 0; state < STATE_COUNT; state++ ) {
+        for ( int event = 0; event < EVENT_COUNT; event++ ) {
+            if ( irqTransitions[state][event] != ignore ) {
+                if ( !covered[state][event] ) {
+                    printf("FAIL: %s + %s is not tested\n", stateNames[state],
+                            eventNames[event]);
+                    failures++;
+                }
+                continue;
+            }
+
+            uint32_t events = busEvents( );
+            uint16_t enables = simInterruptEnables(EUSCI_B0_BASE);
+            param->state = state;
+            FIRE(param, event, state);
+            CHECK(busEvents( ) == events);
+            CHECK(simInterruptEnables(EUSCI_B0_BASE) == enables);
+        }
+    }
+    param->state = STATE_IDLE;
+}
+
+int main( void ) {
+    SimSlave sim = { deviceAddress, deviceWrite, deviceRead, deviceStop,
+            NULL };
+    simAttach(EUSCI_B0_BASE, &sim);
+
+    master.begin(EUSCI_B0_BASE);
+    slave.begin(EUSCI_B1_BASE, OWN_ADDRESS);
+    slave.onReceive(slaveReceived);
+    slave.onRequest(slaveRequested);
+
+    testMasterTransmit( );
+    testMasterReceive( );
+    testMasterStream( );
+    testScan( );
+    testSlave( );
+    testDefaults( );
+
+    printf("%d failure(s)\n", failures);
+    return failures ? 1 : 0;
+}
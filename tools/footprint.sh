@@ -0,0 +1,59 @@
+#!/bin/sh
+#
+# Copyright (c) 2016 by Stefan van der Linden <spvdlinden@gmail.com>
+#
+# Footprint report: builds DWire for the MSP432 with one, two, three and
+# four eUSCI_B modules enabled and prints the flash (text + data) and RAM
+# (data + bss) used, plus the cost of each additional module.
+#
+# Usage (from the repository root):
+#   tools/footprint.sh <driverlib include dir> [extra compiler flags]
+#
+# e.g. tools/footprint.sh ~/ti/msp432/driverlib/MSP432P4xx -DTX_BUFFER_SIZE=16
+#
+# This file is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License
+# version 3, both as published by the Free Software Foundation.
+#
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 <driverlib include dir> [extra compiler flags]" >&2
+    exit 2
+fi
+
+DRIVERLIB=$1
+shift
+
+CXX=${CXX:-arm-none-eabi-g++}
+SIZE=${SIZE:-arm-none-eabi-size}
+CXXFLAGS="-mcpu=cortex-m4 -mthumb -mfloat-abi=hard -mfpu=fpv4-sp-d16 \
+-Os -ffunction-sections -fdata-sections -fno-exceptions -fno-rtti \
+-D__MSP432P401R__ -I$DRIVERLIB -I. $*"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+MODULES=""
+PREV_FLASH=0
+PREV_RAM=0
+
+printf "%-28s %8s %8s %8s %8s\n" "modules" "flash" "ram" "+flash" "+ram"
+
+for N in 0 1 2 3; do
+    MODULES="$MODULES -DUSING_EUSCI_B$N"
+
+    for SRC in DWire.cpp modulemap.cpp; do
+        $CXX $CXXFLAGS $MODULES -c $SRC -o "$WORK/${SRC%.cpp}.o" || exit 1
+    done
+
+    # Berkeley format: text data bss dec hex filename, summed over the objects
+    set -- $($SIZE -t "$WORK/DWire.o" "$WORK/modulemap.o" | tail -n 1)
+    FLASH=$(($1 + $2))
+    RAM=$(($2 + $3))
+
+    printf "%-28s %8d %8d %8d %8d\n" "$(echo $MODULES | sed 's/-DUSING_EUSCI_//g')" \
+        $FLASH $RAM $((FLASH - PREV_FLASH)) $((RAM - PREV_RAM))
+
+    PREV_FLASH=$FLASH
+    PREV_RAM=$RAM
+done